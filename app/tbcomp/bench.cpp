@@ -0,0 +1,307 @@
+#include "bench.hpp"
+#include "wdlcomp.hpp"
+#include "wdlfile.hpp"
+#include "bitarray.hpp"
+#include "huffman.hpp"
+#include "repair.hpp"
+#include "tbutil.hpp"
+#include "chessParseError.hpp"
+#include "moveGen.hpp"
+#include "util/random.hpp"
+#include "util/timeUtil.hpp"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <sstream>
+#include <iostream>
+
+
+Bench::Bench(const std::string& tbType, int nThreads, double entropyBits, U64 nSymbols)
+    : tbType(tbType), nThreads(nThreads), entropyBits(entropyBits), nSymbols(nSymbols) {
+}
+
+void
+Bench::run(std::ostream& os) {
+    results.clear();
+    benchTablebase();
+    benchSymbols();
+
+    for (const Result& r : results) {
+        os << "phase:" << r.phase << " n:" << r.n << " time:" << r.time
+           << " nsPerItem:" << (r.n > 0 ? r.time * 1e9 / r.n : 0.0);
+        if (r.bytes > 0)
+            os << " bytes:" << r.bytes;
+        os << '\n';
+    }
+    os << std::flush;
+}
+
+void
+Bench::addResult(const std::string& phase, U64 n, double t, U64 bytes) {
+    results.push_back(Result{phase, n, t, bytes});
+}
+
+void
+Bench::benchTablebase() {
+    const int maxTreeDepth = 10;
+    const int maxCollectorNodes = 100000;
+    const U64 nProbes = 100000;
+    const U64 nRandomAccess = 1000000;
+
+    double t0 = currentTime();
+    WdlCompress wdlComp(tbType, false, 4.1, -1, "", true, nThreads);
+    double t1 = currentTime();
+    const PosIndex& posIdx = *wdlComp.posIndex;
+    const U64 size = posIdx.tbSize();
+    addResult("gen", size, t1 - t0);
+
+    {
+        t0 = currentTime();
+        Position pos;
+        PosIterator posIter(posIdx, pos);
+        U64 nValid = 0;
+        for (U64 idx = 0; idx < size; idx++)
+            if (posIter.setIndex(idx))
+                nValid++;
+        t1 = currentTime();
+        std::cout << "valid:" << nValid << std::endl;
+        addResult("idxdecode", size, t1 - t0);
+    }
+
+    ScratchArray<WDLInfo> data(size, "");
+    BitArray active(size, true);
+    t0 = currentTime();
+    wdlComp.initializeData(data);
+    t1 = currentTime();
+
+    // Random positions with known WDL values, used to verify the probe results
+    struct ProbePos {
+        Position pos;
+        int captWdl; // Side to move perspective
+        int wdl;     // Side to move perspective
+    };
+    std::vector<ProbePos> probes;
+    {
+        Random rnd(1);
+        Position pos;
+        while (probes.size() < nProbes) {
+            U64 idx = rnd.nextU64() % size;
+            int wdl = data[idx].getWdl();
+            if (wdl > 2 || !posIdx.index2Pos(idx, pos))
+                continue;
+            const bool wtm = pos.isWhiteMove();
+            int captWdl = data[idx].getCaptureWdl();
+            probes.push_back(ProbePos{pos, wtm ? captWdl : -captWdl, wtm ? wdl : -wdl});
+        }
+    }
+
+    double t2 = currentTime();
+    wdlComp.computeOptimalCaptures(data);
+    std::array<U64,8> cnt{};
+    wdlComp.computeStatistics(data, cnt);
+    wdlComp.replaceDontCares(data, active);
+    double t3 = currentTime();
+    addResult("wdlinit", size, (t1 - t0) + (t3 - t2));
+
+    std::vector<U8> treeData;
+    {
+        WDLNodeFactory factory(false, 4.1);
+        WDLUncompressedData uncompData(data.data());
+        DecisionTree dt(factory, posIdx, uncompData, active, -1);
+        dt.computeTree(maxTreeDepth, maxCollectorNodes, nThreads);
+        dt.serialize(treeData);
+        const DecisionTree::PhaseTimes& pt = dt.getPhaseTimes();
+        addResult("stats", pt.nApplied, pt.stats);
+        addResult("select", pt.nIter, pt.select);
+        addResult("encode", size, pt.encode, treeData.size());
+    }
+
+    std::vector<U8> residuals(size);
+    for (U64 idx = 0; idx < size; idx++)
+        residuals[idx] = data[idx].getData();
+    std::vector<U8> compData;
+    {
+        std::vector<U8> tmp(residuals);
+        t0 = currentTime();
+        RePairComp comp(tmp, 8, 65535, nThreads);
+        BitBufferWriter bw;
+        comp.toBitBuf(bw, RePairComp::defaultBlockSize);
+        t1 = currentTime();
+        compData = bw.getBuf();
+        addResult("repaircomp", size, t1 - t0, compData.size());
+    }
+
+    {
+        const U64 nSegments = 8;
+        const U64 segmentSize = (size + nSegments - 1) / nSegments;
+        U64 segBytes = 0;
+        t0 = currentTime();
+        RePairComp::compressSegments(size, segmentSize, 8, 65535, RePairComp::defaultBlockSize,
+                                     nThreads,
+                                     [&residuals](U64 beg, U64 end, std::vector<U8>& vec) {
+            vec.assign(residuals.begin() + beg, residuals.begin() + end);
+        }, [&segBytes](const std::vector<U8>& buf) {
+            std::vector<U8> tmp;
+            writeVarUInt(buf.size(), tmp);
+            segBytes += tmp.size() + buf.size();
+        });
+        t1 = currentTime();
+        std::cout << "segments:" << nSegments << " segmentBytes:" << segBytes
+                  << " monolithicBytes:" << compData.size()
+                  << " sizeCost:" << ((double)segBytes / compData.size() - 1) * 100 << '%'
+                  << std::endl;
+        addResult("repairsegcomp", size, t1 - t0, segBytes);
+    }
+
+    RePairDeComp deComp(compData.data());
+    {
+        U64 n = 0;
+        t0 = currentTime();
+        deComp.deCompressAll([&n](const std::vector<U8>& d) { n += d.size(); });
+        t1 = currentTime();
+        if (n != size)
+            throw ChessParseError("Re-pair decompression failed");
+        addResult("repairdecomp", size, t1 - t0);
+    }
+
+    {
+        std::vector<U64> indices(nRandomAccess);
+        Random rnd(2);
+        for (U64& idx : indices)
+            idx = rnd.nextU64() % size;
+        U64 nMismatch = 0;
+        t0 = currentTime();
+        for (U64 idx : indices)
+            if (deComp[idx] != residuals[idx])
+                nMismatch++;
+        t1 = currentTime();
+        if (nMismatch > 0)
+            throw ChessParseError("Re-pair random access failed");
+        addResult("repairrandom", nRandomAccess, t1 - t0);
+    }
+
+    {
+        std::stringstream ss;
+        WdlFile::write(ss, posIdx, wdlComp.bestWtm, wdlComp.bestBtm, wdlComp.ignore50,
+                       treeData, size, RePairComp::defaultBlockSize, nThreads,
+                       [&residuals](U64 beg, U64 end, std::vector<U8>& vec) {
+            vec.assign(residuals.begin() + beg, residuals.begin() + end);
+        });
+        const std::string str = ss.str();
+        WdlFile wdlFile(std::vector<U8>(str.begin(), str.end()));
+
+        U64 nMismatch = 0;
+        t0 = currentTime();
+        for (const ProbePos& p : probes)
+            if (wdlFile.probe(p.pos, p.captWdl) != p.wdl)
+                nMismatch++;
+        t1 = currentTime();
+        if (nMismatch > 0)
+            throw ChessParseError("WDL probe mismatch");
+        addResult("wdlprobe", probes.size(), t1 - t0, str.size());
+    }
+}
+
+void
+Bench::benchSymbols() {
+    std::vector<U8> symbols;
+    makeSymbols(nSymbols, entropyBits, 3, symbols);
+
+    {
+        std::vector<U64> freq(256);
+        std::vector<int> data(symbols.begin(), symbols.end());
+        double t0 = currentTime();
+        for (int d : data)
+            freq[d]++;
+        Huffman huff;
+        HuffCode code;
+        huff.computePrefixCode(freq, code);
+        BitBufferWriter bw;
+        code.toBitBuf(bw, false);
+        huff.encode(data, code, bw);
+        double t1 = currentTime();
+        const std::vector<U8>& buf = bw.getBuf();
+        addResult("huffcomp", nSymbols, t1 - t0, buf.size());
+
+        std::vector<int> data2;
+        data2.reserve(nSymbols);
+        t0 = currentTime();
+        BitBufferReader br(buf.data());
+        HuffCode code2;
+        code2.fromBitBuf(br, 256);
+        huff.decode(br, nSymbols, code2, data2);
+        t1 = currentTime();
+        if (data2 != data)
+            throw ChessParseError("Huffman decompression failed");
+        addResult("huffdecomp", nSymbols, t1 - t0);
+    }
+
+    {
+        std::vector<U8> tmp(symbols);
+        double t0 = currentTime();
+        RePairComp comp(tmp, 8, 65535, nThreads);
+        BitBufferWriter bw;
+        comp.toBitBuf(bw, RePairComp::defaultBlockSize);
+        double t1 = currentTime();
+        const std::vector<U8>& buf = bw.getBuf();
+        addResult("symrepaircomp", nSymbols, t1 - t0, buf.size());
+
+        std::vector<U8> out;
+        out.reserve(nSymbols);
+        RePairDeComp deComp(buf.data());
+        t0 = currentTime();
+        deComp.deCompressAll([&out](const std::vector<U8>& d) {
+            out.insert(out.end(), d.begin(), d.end());
+        });
+        t1 = currentTime();
+        if (out != symbols)
+            throw ChessParseError("Re-pair decompression failed");
+        addResult("symrepairdecomp", nSymbols, t1 - t0);
+    }
+}
+
+void
+Bench::makeSymbols(U64 n, double entropyBits, U64 seed, std::vector<U8>& out) {
+    const int nSyms = 256;
+    auto getProbs = [](double r, std::array<double,nSyms>& prob) {
+        double p = 1, sum = 0;
+        for (int k = 0; k < nSyms; k++) {
+            prob[k] = p;
+            sum += p;
+            p *= r;
+        }
+        double entr = 0;
+        for (int k = 0; k < nSyms; k++) {
+            prob[k] /= sum;
+            if (prob[k] > 0)
+                entr -= prob[k] * std::log2(prob[k]);
+        }
+        return entr;
+    };
+
+    std::array<double,nSyms> prob;
+    double lo = 0, hi = 1;
+    for (int i = 0; i < 60; i++) {
+        double r = (lo + hi) / 2;
+        if (getProbs(r, prob) < entropyBits)
+            lo = r;
+        else
+            hi = r;
+    }
+    getProbs(lo, prob);
+
+    std::array<double,nSyms> cdf;
+    double sum = 0;
+    for (int k = 0; k < nSyms; k++) {
+        sum += prob[k];
+        cdf[k] = sum;
+    }
+    cdf[nSyms-1] = 2; // Avoid rounding problems
+
+    Random rnd(seed);
+    out.resize(n);
+    for (U64 i = 0; i < n; i++) {
+        double u = (rnd.nextU64() >> 11) * (1.0 / (1ULL << 53));
+        out[i] = std::upper_bound(cdf.begin(), cdf.end(), u) - cdf.begin();
+    }
+}
@@ -0,0 +1,56 @@
+#ifndef BENCH_HPP_
+#define BENCH_HPP_
+
+#include "util/util.hpp"
+#include <string>
+#include <vector>
+#include <ostream>
+
+
+/** Benchmark of the compression phases, using only deterministic synthetic
+ *  input, so no tablebase files are needed. A pawnless tablebase class is
+ *  computed by TBGenerator and compressed as by the wdlcomp command. A random
+ *  symbol stream with a given entropy is used for the general purpose
+ *  Huffman and re-pair phases. */
+class Bench {
+public:
+    /** Constructor. "tbType" is the tablebase class, "nThreads" the number of
+     *  threads used by multithreaded phases. The symbol stream has "nSymbols"
+     *  symbols and "entropyBits" bits of entropy per symbol. */
+    Bench(const std::string& tbType, int nThreads, double entropyBits, U64 nSymbols);
+
+    /** Run all phases and write the results to "os", one line per phase:
+     *  phase:name n:items time:seconds nsPerItem:ns [bytes:size]
+     *  Progress information is written to std::cout. */
+    void run(std::ostream& os);
+
+    /** Create "n" independent random symbols, where symbol k has probability
+     *  proportional to r^k, k=0..255, and r is chosen so that the entropy is
+     *  "entropyBits" bits per symbol. */
+    static void makeSymbols(U64 n, double entropyBits, U64 seed, std::vector<U8>& out);
+
+private:
+    /** Compress a generated tablebase and measure random access probing. */
+    void benchTablebase();
+
+    /** Huffman and re-pair compression of a synthetic symbol stream. */
+    void benchSymbols();
+
+    void addResult(const std::string& phase, U64 n, double t, U64 bytes = 0);
+
+    const std::string tbType;
+    const int nThreads;
+    const double entropyBits;
+    const U64 nSymbols;
+
+    struct Result {
+        std::string phase;
+        U64 n;
+        double time;
+        U64 bytes;
+    };
+    std::vector<Result> results;
+};
+
+
+#endif /* BENCH_HPP_ */
@@ -2,26 +2,29 @@
 #define BITARRAY_HPP_
 
 #include "util/util.hpp"
-#include <vector>
+#include "scratcharray.hpp"
+#include <algorithm>
 
 
 class BitArray {
 public:
-    BitArray(U64 size, bool initialVal);
+    /** Constructor. If "filePrefix" is not empty, the data is stored in a
+     *  memory mapped scratch file. See ScratchMemory. */
+    BitArray(U64 size, bool initialVal, const std::string& filePrefix = "");
 
     bool get(U64 idx) const;
     void set(U64 idx, bool val);
 
 private:
-    std::vector<U64> vec;
+    ScratchArray<U64> vec;
 };
 
 
 inline
-BitArray::BitArray(U64 size, bool initialVal) {
-    U64 len = (size + 63) / 64;
-    U64 val = initialVal ? ~(0ULL) : 0;
-    vec.assign(len, val);
+BitArray::BitArray(U64 size, bool initialVal, const std::string& filePrefix)
+    : vec((size + 63) / 64, filePrefix) {
+    if (initialVal)
+        std::fill(vec.data(), vec.data() + vec.size(), ~(0ULL));
 }
 
 inline bool
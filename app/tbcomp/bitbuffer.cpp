@@ -29,6 +29,26 @@ BitBufferWriter::writeData() {
     buf[i++] = val & 0xff; val >>= 8;
     buf[i++] = val & 0xff; val >>= 8;
     buf[i++] = val & 0xff;
+    if (os && buf.size() >= flushSize)
+        flush();
+}
+
+void
+BitBufferWriter::finish() {
+    assert(os);
+    if (nDataBits > 0) {
+        data <<= 64 - nDataBits;
+        nDataBits = 0;
+        writeData();
+    }
+    flush();
+}
+
+void
+BitBufferWriter::flush() {
+    os->write((const char*)buf.data(), buf.size());
+    nFlushed += buf.size();
+    buf.clear();
 }
 
 
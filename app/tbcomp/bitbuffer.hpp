@@ -2,6 +2,8 @@
 #define BITBUFFER_HPP_
 
 #include "util/util.hpp"
+#include <ostream>
+#include <cassert>
 
 
 class BitBufferWriter {
@@ -9,6 +11,11 @@ public:
     /** Constructor. */
     BitBufferWriter();
 
+    /** Constructor. The data is written to "os" in chunks of flushSize bytes
+     *  as it is produced, so the whole output is never held in memory.
+     *  finish() must be called when all data has been written. */
+    explicit BitBufferWriter(std::ostream& os);
+
     /** Store "nBits" bits in the buffer, defined by the least
      *  significant bits in "val". The other bits in "val" must be 0.
      *  The bits are stored in big-endian order.
@@ -19,18 +26,29 @@ public:
     void writeU64(U64 val);
 
     /** Return total number of written bits. */
-    U64 getNumBits() const { return buf.size() * 8 + nDataBits; }
+    U64 getNumBits() const { return (nFlushed + buf.size()) * 8 + nDataBits; }
 
     /** Return the underlying data buffer.
-     *  Must be called only once when all data has been written. */
+     *  Must be called only once when all data has been written.
+     *  Not allowed if the data is written to an output stream. */
     const std::vector<U8>& getBuf();
 
+    /** Write remaining data to the output stream. Must be called only once
+     *  when all data has been written. */
+    void finish();
+
+    /** Number of buffered bytes that triggers a write to the output stream. */
+    static const U64 flushSize = 1024 * 1024;
+
 private:
     void writeData();
+    void flush();
 
     std::vector<U8> buf;
     U64 data;
     int nDataBits;
+    std::ostream* os = nullptr; // Output stream, or nullptr to keep all data in buf
+    U64 nFlushed = 0;           // Number of bytes written to os
 };
 
 
@@ -39,6 +57,9 @@ public:
     /** Constructor. */
     explicit BitBufferReader(const U8* buf);
 
+    /** Constructor. Start reading at bit position "bitPos" in "buf". */
+    BitBufferReader(const U8* buf, U64 bitPos);
+
     /** Return the next "nBits" bits.
      *  The bits are read in big-endian order.
      *  @pre nBits < 64 */
@@ -50,10 +71,38 @@ public:
     /** Return the next bit. */
     bool readBit();
 
+    /** Return the next "nBits" bits without consuming them. Only bits that have
+     *  already been loaded from the buffer are returned, other bits are 0.
+     *  @pre 0 < nBits < 64 */
+    U64 peekBits(int nBits) const { return data >> (64 - nBits); }
+
+    /** Return the next 64 bits without consuming them. If fewer than 64 bits
+     *  are loaded, bits are taken from the next word in the buffer, so this
+     *  must only be used if the buffer contains that word. */
+    U64 peekBits64() const;
+
+    /** Return the loaded but not yet consumed bits, left aligned. Bits after
+     *  the first getNumLoaded() bits are 0. */
+    U64 getLoadedBits() const { return data; }
+
+    /** Return the number of bits that have been loaded from the buffer but
+     *  not yet consumed. */
+    int getNumLoaded() const { return nDataBits; }
+
+    /** Consume "nBits" bits. @pre nBits <= getNumLoaded() and nBits < 64 */
+    void skipBits(int nBits) { data <<= nBits; nDataBits -= nBits; }
+
+    /** Return current bit position, relative to the start of the buffer. */
+    U64 getBitPos() const { return (buf - bufStart) * 8 - nDataBits; }
+
 private:
     /** Read next 64 bits from buf. */
     void readData();
 
+    /** Return the 64 bits starting at "ptr". */
+    static U64 loadWord(const U8* ptr);
+
+    const U8* bufStart;
     const U8* buf;
     U64 data;
     int nDataBits; // Number of valid bits in data
@@ -80,8 +129,15 @@ BitBufferWriter::writeBits(U64 val, int nBits) {
     }
 }
 
+inline
+BitBufferWriter::BitBufferWriter(std::ostream& os)
+    : data(0), nDataBits(0), os(&os) {
+    buf.reserve(flushSize + 8);
+}
+
 inline const std::vector<U8>&
 BitBufferWriter::getBuf() {
+    assert(!os);
     if (nDataBits > 0) {
         data <<= 64 - nDataBits;
         writeData();
@@ -91,7 +147,13 @@ BitBufferWriter::getBuf() {
 
 inline
 BitBufferReader::BitBufferReader(const U8* buf)
-    : buf(buf), data(0), nDataBits(0) {
+    : bufStart(buf), buf(buf), data(0), nDataBits(0) {
+}
+
+inline
+BitBufferReader::BitBufferReader(const U8* buf, U64 bitPos)
+    : bufStart(buf), buf(buf + bitPos / 64 * 8), data(0), nDataBits(0) {
+    readBits(bitPos % 64);
 }
 
 inline U64
@@ -122,9 +184,22 @@ BitBufferReader::readBit() {
     return ret;
 }
 
+inline U64
+BitBufferReader::peekBits64() const {
+    if (nDataBits == 64)
+        return data;
+    return data | (loadWord(buf) >> nDataBits);
+}
+
 inline void
 BitBufferReader::readData() {
-    const U8* ptr = buf;
+    data = loadWord(buf);
+    buf += 8;
+    nDataBits += 64;
+}
+
+inline U64
+BitBufferReader::loadWord(const U8* ptr) {
     U64 val = (*ptr++);
     val |= (U64)(*ptr++) << (8*1);
     val |= (U64)(*ptr++) << (8*2);
@@ -133,9 +208,7 @@ BitBufferReader::readData() {
     val |= (U64)(*ptr++) << (8*5);
     val |= (U64)(*ptr++) << (8*6);
     val |= (U64)(*ptr++) << (8*7);
-    buf = ptr;
-    data = val;
-    nDataBits += 64;
+    return val;
 }
 
 #endif /* BITBUFFER_HPP_ */
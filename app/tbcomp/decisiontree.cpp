@@ -9,6 +9,7 @@
 #include "threadpool.hpp"
 #include "tbutil.hpp"
 #include <fstream>
+#include <unordered_map>
 #include <cassert>
 #include <cfloat>
 
@@ -17,28 +18,50 @@ DecisionTree::DecisionTree(DT::NodeFactory& nodeFactory, const PosIndex& posIdx,
                            DT::UncompressedData& data, const BitArray& active,
                            int samplingLogFactor)
     : nodeFactory(nodeFactory), posIdx(posIdx), data(data), active(active) {
-    nStatsChunks = 1 << samplingLogFactor;
+    adaptiveChunks = samplingLogFactor < 0;
+    nStatsChunks = adaptiveChunks ? maxAdaptiveChunks : 1 << samplingLogFactor;
+}
+
+int
+DecisionTree::numChunks(U64 nPositions) const {
+    if (!adaptiveChunks)
+        return nStatsChunks;
+    int n = 1;
+    while (n < nStatsChunks && nPositions / (2 * n) >= minChunkPositions)
+        n *= 2;
+    return n;
 }
 
 void
 DecisionTree::computeTree(int maxDepth, int maxCollectorNodes, int nThreads) {
     auto ctx = nodeFactory.makeEvalContext(posIdx);
-    root = nodeFactory.makeStatsCollector(*ctx, nStatsChunks, -1.0);
+    initStats(*ctx);
 
+    phaseTimes = PhaseTimes();
     S64 t0 = currentTimeMillis();
     double costThreshold = ctx->getMergeThreshold();
     int chunkNo = 0;
     for (int iter = 0; ; iter++) {
-        updateStats(chunkNo);
+        double ts = currentTime();
+        U64 n = updateStats(chunkNo, nThreads);
+        phaseTimes.stats += currentTime() - ts;
+        phaseTimes.nIter++;
+        phaseTimes.nApplied += n;
         chunkNo = (chunkNo + 1) & (nStatsChunks - 1);
 
-        std::cout << "iter:" << iter << " cost:" << root->cost(*ctx) << std::endl;
+        std::cout << "iter:" << iter << " cost:" << root->cost(*ctx)
+                  << " applied:" << n << std::endl;
 
-        if (!selectBestPreds(maxDepth, maxCollectorNodes, costThreshold))
+        ts = currentTime();
+        bool more = selectBestPreds(maxDepth, maxCollectorNodes, costThreshold, nThreads);
+        phaseTimes.select += currentTime() - ts;
+        if (!more)
             break;
     }
+    leafPositions.clear();
     S64 t1 = currentTimeMillis();
 
+    double te = currentTime();
     simplifyTree();
     double cost = root->cost(*ctx);
     std::cout << '\n' << root->describe(0, *ctx) << std::endl;
@@ -47,54 +70,230 @@ DecisionTree::computeTree(int maxDepth, int maxCollectorNodes, int nThreads) {
     std::cout << '\n' << root->describe(0, *ctx) << "cost:" << cost
               << " numLeafs:" << getNumLeafNodes() << std::endl;
     std::cout << "time:" << (t1 -t0) * 1e-3 << std::endl;
+    std::cout << "totApplied:" << phaseTimes.nApplied << std::endl;
 
     encodeValues(nThreads);
+    phaseTimes.encode = currentTime() - te;
 }
 
 void
-DecisionTree::updateStats(unsigned int chunkNo) {
-    U64 nPos = posIdx.tbSize();
-    Position pos;
-    auto ctx = nodeFactory.makeEvalContext(posIdx);
+DecisionTree::initStats(const DT::EvalContext& ctx) {
+    root = nodeFactory.makeStatsCollector(ctx, numChunks(posIdx.tbSize()), -1.0);
+    leafPositions.clear();
+    leafPositions.emplace_back();
+    leafPositions.back().node = root.get();
+    leafPositions.back().allActive = true;
+}
 
-    struct Visitor {
-        Visitor(const Position& pos, DT::EvalContext& ctx) : pos(pos), ctx(ctx) {}
-        void visit(DT::PredicateNode& node) {
-            return node.getChild(pos, ctx).accept(*this);
-        }
-        void visit(DT::StatsNode& node) {
-            result = false;
-        }
-        void visit(DT::StatsCollectorNode& node) {
-            result = node.applyData(pos, value, ctx);
-        }
-        void visit(DT::EncoderNode& node) {
-            assert(false);
-        }
-        const Position& pos;
-        DT::EvalContext& ctx;
-        int value = 0;
-        bool result = false;
+U64
+DecisionTree::updateStats(unsigned int chunkNo, int nThreads) {
+    // Number all StatsCollectorNodes so that workers can find their private copies
+    std::vector<DT::StatsCollectorNode*> collectors;
+    std::unordered_map<const DT::StatsCollectorNode*, int> collectorIdx;
+    {
+        struct Visitor : public DT::Visitor {
+            using DT::Visitor::visit;
+            void visit(DT::PredicateNode& node) {
+                node.left->accept(*this);
+                node.right->accept(*this);
+            }
+            void visit(DT::StatsCollectorNode& node) {
+                collectors.push_back(&node);
+            }
+            std::vector<DT::StatsCollectorNode*> collectors;
+        };
+        Visitor visitor;
+        root->accept(visitor);
+        collectors = std::move(visitor.collectors);
+        for (int i = 0; i < (int)collectors.size(); i++)
+            collectorIdx[collectors[i]] = i;
+    }
+    const int nColl = collectors.size();
+
+    // shards[workerNo][i] collects data for collectors[i] in worker workerNo.
+    // Not used in single threaded mode, where data is applied directly to the tree.
+    const bool useShards = nThreads > 1;
+    using Shards = std::vector<std::unique_ptr<DT::StatsCollectorNode>>;
+    std::vector<Shards> shards(useShards ? nThreads : 0);
+    for (Shards& s : shards)
+        s.resize(nColl);
+
+    // Divide the work in tasks of about batchSize positions. Each task
+    // processes a sequence of work items, where an item is an index range
+    // for an allActive LeafPositions, otherwise a range of index list blocks.
+    struct WorkItem {
+        int entryNo;
+        U64 beg;
+        U64 end;
     };
-    Visitor visitor(pos, *ctx);
-
-    for (U64 idx = 0; idx < nPos; idx++) {
-        if ((hashU64(idx) & (nStatsChunks - 1)) != chunkNo)
-            continue;
-        if (!active.get(idx) || data.isHandled(idx))
-            continue;
+    const U64 size = posIdx.tbSize();
+    const U64 batchSize = std::max((U64)128*1024, (size + 1023) / 1024);
+    std::vector<std::vector<WorkItem>> tasks(1);
+    {
+        U64 taskPositions = 0;
+        auto addItem = [&tasks,&taskPositions,batchSize](int entryNo, U64 beg, U64 end,
+                                                         U64 nPositions) {
+            if (taskPositions >= batchSize) {
+                tasks.emplace_back();
+                taskPositions = 0;
+            }
+            tasks.back().push_back(WorkItem{entryNo, beg, end});
+            taskPositions += nPositions;
+        };
+        for (int e = 0; e < (int)leafPositions.size(); e++) {
+            const LeafPositions& lp = leafPositions[e];
+            if (lp.allActive) {
+                for (U64 b = 0; b < size; b += batchSize) {
+                    U64 end = std::min(b + batchSize, size);
+                    addItem(e, b, end, end - b);
+                }
+            } else {
+                for (int b = 0; b < lp.indices.numBlocks(); b++)
+                    addItem(e, b, b + 1, lp.indices.blockLength(b));
+            }
+        }
+    }
 
-        bool valid = posIdx.index2Pos(idx, pos);
-        assert(valid);
-        ctx->init(pos, data, idx);
+    // taskLists[t] contains the positions task t found for each StatsCollectorNode
+    // below a LeafPositions node that is not itself a StatsCollectorNode.
+    std::vector<std::vector<std::pair<int,IndexList>>> taskLists(tasks.size());
+    ThreadPool<U64> pool(nThreads);
+    for (int t = 0; t < (int)tasks.size(); t++) {
+        auto task = [this,chunkNo,t,&tasks,&taskLists,&collectorIdx,&shards,
+                     useShards](int workerNo) {
+            Position pos;
+            PosIterator posIter(posIdx, pos);
+            auto ctx = nodeFactory.makeEvalContext(posIdx);
+            struct Visitor {
+                Visitor(const Position& pos, DT::EvalContext& ctx, DT::NodeFactory& nodeFactory,
+                        const std::unordered_map<const DT::StatsCollectorNode*, int>& collectorIdx,
+                        Shards* shards, unsigned int chunkNo)
+                    : pos(pos), ctx(ctx), nodeFactory(nodeFactory), collectorIdx(collectorIdx),
+                      shards(shards), chunkNo(chunkNo) {}
+                void visit(DT::PredicateNode& node) {
+                    return node.getChild(pos, ctx).accept(*this);
+                }
+                void visit(DT::StatsNode& node) {
+                    leaf = -1;
+                }
+                void visit(DT::StatsCollectorNode& node) {
+                    leaf = collectorIdx.find(&node)->second;
+                    if (!node.useChunk(chunk, chunkNo))
+                        return;
+                    DT::StatsCollectorNode* target = &node;
+                    if (shards) {
+                        auto& shard = (*shards)[leaf];
+                        if (!shard)
+                            shard = nodeFactory.makeStatsCollector(ctx, node.getNumChunks(),
+                                                                   node.getPriorCost());
+                        target = shard.get();
+                    }
+                    target->applyData(pos, value, ctx);
+                    nApplied++;
+                }
+                void visit(DT::EncoderNode& node) {
+                    assert(false);
+                }
+                const Position& pos;
+                DT::EvalContext& ctx;
+                DT::NodeFactory& nodeFactory;
+                const std::unordered_map<const DT::StatsCollectorNode*, int>& collectorIdx;
+                Shards* shards;
+                const unsigned int chunkNo;
+                U64 chunk = 0;
+                int value = 0;
+                int leaf = -1; // Index of reached StatsCollectorNode, or -1
+                U64 nApplied = 0;
+            };
+            Visitor visitor(pos, *ctx, nodeFactory, collectorIdx,
+                            useShards ? &shards[workerNo] : nullptr, chunkNo);
+
+            std::unordered_map<int,IndexList> lists;
+            for (const WorkItem& item : tasks[t]) {
+                const LeafPositions& lp = leafPositions[item.entryNo];
+                DT::StatsCollectorNode* collector = dynamic_cast<DT::StatsCollectorNode*>(lp.node);
+                auto handlePos = [&](U64 idx) {
+                    const U64 chunk = hashU64(idx) & (nStatsChunks - 1);
+                    if (collector && !collector->useChunk(chunk, chunkNo))
+                        return;
+
+                    bool valid = posIter.setIndex(idx);
+                    assert(valid);
+                    ctx->init(pos, data, idx);
+
+                    visitor.chunk = chunk;
+                    visitor.value = data.getValue(idx);
+                    lp.node->accept(visitor);
+                    if (!collector && visitor.leaf >= 0)
+                        lists[visitor.leaf].add(idx);
+                };
+                if (lp.allActive) {
+                    for (U64 idx = item.beg; idx < item.end; idx++)
+                        if (active.get(idx))
+                            handlePos(idx);
+                } else {
+                    for (U64 b = item.beg; b < item.end; b++)
+                        lp.indices.forEach(b, handlePos);
+                }
+            }
+            for (auto& e : lists)
+                taskLists[t].emplace_back(e.first, std::move(e.second));
+            return visitor.nApplied;
+        };
+        pool.addTask(task);
+    }
+    U64 nApplied = 0;
+    U64 n;
+    while (pool.getResult(n))
+        nApplied += n;
+
+    // Reduce worker statistics into the tree. Each collector is handled by
+    // one task, adding shards in worker order, so the result is deterministic.
+    if (useShards) {
+        const int reduceBatchSize = std::max(1, nColl / nThreads / 4);
+        for (int b = 0; b < nColl; b += reduceBatchSize) {
+            auto task = [&collectors,&shards,nColl,reduceBatchSize,b](int workerNo) {
+                int end = std::min(b + reduceBatchSize, nColl);
+                for (int i = b; i < end; i++) {
+                    for (Shards& s : shards) {
+                        if (s[i]) {
+                            collectors[i]->addStats(*s[i]);
+                            s[i].reset();
+                        }
+                    }
+                }
+                return (U64)0;
+            };
+            pool.addTask(task);
+        }
+        while (pool.getResult(n))
+            ;
+    }
 
-        visitor.value = data.getValue(idx);
-        root->accept(visitor);
-        if (!visitor.result)
-            data.setHandled(idx, true);
+    // Replace subtree LeafPositions with one entry per reached StatsCollectorNode.
+    // Tasks cover increasing index ranges, so concatenating the task lists in
+    // task order keeps the indices sorted.
+    {
+        std::vector<IndexList> collectorLists(nColl);
+        for (auto& lists : taskLists)
+            for (auto& e : lists)
+                collectorLists[e.first].append(std::move(e.second));
+        std::vector<LeafPositions> newLeafPositions;
+        for (LeafPositions& lp : leafPositions)
+            if (dynamic_cast<DT::StatsCollectorNode*>(lp.node))
+                newLeafPositions.push_back(std::move(lp));
+        for (int i = 0; i < nColl; i++) {
+            if (collectorLists[i].size() > 0) {
+                newLeafPositions.emplace_back();
+                newLeafPositions.back().node = collectors[i];
+                newLeafPositions.back().indices = std::move(collectorLists[i]);
+            }
+        }
+        leafPositions = std::move(newLeafPositions);
     }
 
     statsChunkAdded();
+    return nApplied;
 }
 
 void
@@ -114,12 +313,15 @@ DecisionTree::statsChunkAdded() {
 }
 
 bool
-DecisionTree::selectBestPreds(int maxDepth, int maxCollectorNodes, double& costThreshold) {
+DecisionTree::selectBestPreds(int maxDepth, int maxCollectorNodes, double& costThreshold,
+                              int nThreads) {
+    // Find all StatsCollectorNodes, in depth first order
+    struct Collector {
+        DT::StatsCollectorNode* node;
+        std::unique_ptr<DT::Node>* owner;
+        int level;
+    };
     struct Visitor : public DT::Visitor {
-        Visitor(DT::NodeFactory& nodeFactory, DT::EvalContext& ctx, int nStatsChunks,
-                int maxDepth, double costThreshold) :
-            nodeFactory(nodeFactory), ctx(ctx), nStatsChunks(nStatsChunks),
-            maxDepth(maxDepth), costThreshold(costThreshold) {}
         using DT::Visitor::visit;
         void visit(DT::PredicateNode& node, std::unique_ptr<DT::Node>& owner, int level) {
             depth = std::max(depth, level + 1);
@@ -128,67 +330,113 @@ DecisionTree::selectBestPreds(int maxDepth, int maxCollectorNodes, double& costT
         }
         void visit(DT::StatsCollectorNode& node, std::unique_ptr<DT::Node>& owner, int level) {
             depth = std::max(depth, level + 1);
-            {
-                std::unique_ptr<DT::Node> repl = node.getBestReplacement(ctx);
-                if (!repl) {
-                    double cost = node.getPriorCost();
-                    if (cost >= 0 && cost < costThreshold)
-                        nOldStatsCollectors++;
-                    else
-                        nStatsCollectors++;
-                    return;
-                }
-                owner = std::move(repl);
-                treeModified = true;
-            }
-
-            if (level + 1 < maxDepth) {
-                DT::PredicateNode* predNode = dynamic_cast<DT::PredicateNode*>(owner.get());
-                if (predNode) {
-                    double leftCost = predNode->left->cost(ctx);
-                    if (leftCost > costThreshold) {
-                        predNode->left = nodeFactory.makeStatsCollector(ctx, nStatsChunks, leftCost);
-                        nStatsCollectors++;
-                        minCost = std::min(minCost, leftCost);
-                    }
-                    double rightCost = predNode->right->cost(ctx);
-                    if (rightCost > costThreshold) {
-                        predNode->right = nodeFactory.makeStatsCollector(ctx, nStatsChunks, rightCost);
-                        nStatsCollectors++;
-                        minCost = std::min(minCost, rightCost);
-                    }
-                }
-            }
+            collectors.push_back(Collector{&node, &owner, level});
         }
-        DT::NodeFactory& nodeFactory;
-        const DT::EvalContext& ctx;
-        const int nStatsChunks;
-        const int maxDepth;
-        const double costThreshold;
-        double minCost = DBL_MAX;
-        bool treeModified = false;
-        int nStatsCollectors = 0;
-        int nOldStatsCollectors = 0;
+        std::vector<Collector> collectors;
         int depth = 0;
     };
-    auto ctx = nodeFactory.makeEvalContext(posIdx);
-    Visitor visitor(nodeFactory, *ctx, nStatsChunks, maxDepth, costThreshold);
+    Visitor visitor;
     root->accept(visitor, root, 0);
+    const std::vector<Collector>& collectors = visitor.collectors;
+    const int nColl = collectors.size();
+
+    // Compute the best replacement for all nodes in parallel
+    auto ctx = nodeFactory.makeEvalContext(posIdx);
+    std::vector<std::unique_ptr<DT::Node>> repl(nColl);
+    {
+        const int batchSize = std::max(1, nColl / nThreads / 4);
+        ThreadPool<int> pool(nThreads);
+        for (int b = 0; b < nColl; b += batchSize) {
+            auto task = [&collectors,&repl,&ctx,nColl,batchSize,b](int workerNo) {
+                int end = std::min(b + batchSize, nColl);
+                for (int i = b; i < end; i++)
+                    repl[i] = collectors[i].node->getBestReplacement(*ctx);
+                return 0;
+            };
+            pool.addTask(task);
+        }
+        int dummy;
+        while (pool.getResult(dummy))
+            ;
+    }
+
+    // Modify the tree in depth first order, so the result does not depend
+    // on the order in which the replacements were computed
+    double minCost = DBL_MAX;
+    bool treeModified = false;
+    int nStatsCollectors = 0;
+    int nOldStatsCollectors = 0;
+    // Replace a StatsNode with a StatsCollectorNode if its cost is large enough.
+    // Return true if the node was replaced.
+    auto makeCollector = [this,&ctx,&minCost,&nStatsCollectors,costThreshold](
+            std::unique_ptr<DT::Node>& node) -> bool {
+        double cost = node->cost(*ctx);
+        if (cost > costThreshold) {
+            int nChunks = numChunks(node->getStats(*ctx)->getNumPositions());
+            node = nodeFactory.makeStatsCollector(*ctx, nChunks, cost);
+            nStatsCollectors++;
+            minCost = std::min(minCost, cost);
+            return true;
+        }
+        return false;
+    };
+    // Replaced StatsCollectorNode -> new subtree, or nullptr if the
+    // new subtree has no StatsCollectorNodes
+    std::unordered_map<const DT::Node*, DT::Node*> replaced;
+    for (int i = 0; i < nColl; i++) {
+        const Collector& c = collectors[i];
+        if (!repl[i]) {
+            double cost = c.node->getPriorCost();
+            if (cost >= 0 && cost < costThreshold)
+                nOldStatsCollectors++;
+            else
+                nStatsCollectors++;
+            continue;
+        }
+        const DT::Node* oldNode = c.node;
+        std::unique_ptr<DT::Node>& owner = *c.owner;
+        owner = std::move(repl[i]);
+        treeModified = true;
+
+        bool newCollectors = false;
+        if (c.level + 1 < maxDepth) {
+            DT::PredicateNode* predNode = dynamic_cast<DT::PredicateNode*>(owner.get());
+            if (predNode) {
+                newCollectors |= makeCollector(predNode->left);
+                newCollectors |= makeCollector(predNode->right);
+            }
+        }
+        replaced[oldNode] = newCollectors ? owner.get() : nullptr;
+    }
+
+    // Positions of a replaced node are assigned to the new collectors during
+    // the next updateStats() call
+    std::vector<LeafPositions> newLeafPositions;
+    for (LeafPositions& lp : leafPositions) {
+        auto it = replaced.find(lp.node);
+        if (it != replaced.end()) {
+            if (!it->second)
+                continue;
+            lp.node = it->second;
+        }
+        newLeafPositions.push_back(std::move(lp));
+    }
+    leafPositions = std::move(newLeafPositions);
 
-    if (visitor.treeModified) {
+    if (treeModified) {
         std::cout << "  numLeafs:" << getNumLeafNodes() << " depth:" << visitor.depth
-                << " nStats:" << visitor.nStatsCollectors << ' '
-                << visitor.nOldStatsCollectors << std::endl;
+                << " nStats:" << nStatsCollectors << ' '
+                << nOldStatsCollectors << std::endl;
     }
 
-    if (visitor.nStatsCollectors > maxCollectorNodes) {
-        if (visitor.minCost < DBL_MAX)
-            costThreshold = std::max(costThreshold, visitor.minCost);
+    if (nStatsCollectors > maxCollectorNodes) {
+        if (minCost < DBL_MAX)
+            costThreshold = std::max(costThreshold, minCost);
         costThreshold *= 2;
         std::cout << "  costThreshold:" << costThreshold << std::endl;
     }
 
-    return visitor.nStatsCollectors + visitor.nOldStatsCollectors > 0;
+    return nStatsCollectors + nOldStatsCollectors > 0;
 }
 
 void
@@ -255,6 +503,33 @@ DecisionTree::getNumLeafNodes() {
     return visitor.nLeafs;
 }
 
+int
+DecisionTree::encodeValue(DT::Node& node, const Position& pos, DT::EvalContext& ctx,
+                          int value) {
+    struct Visitor {
+        Visitor(const Position& pos, DT::EvalContext& ctx, int value)
+            : pos(pos), ctx(ctx), value(value) {}
+        void visit(DT::PredicateNode& node) {
+            return node.getChild(pos, ctx).accept(*this);
+        }
+        void visit(DT::StatsNode& node) {
+            assert(false);
+        }
+        void visit(DT::StatsCollectorNode& node) {
+            assert(false);
+        }
+        void visit(DT::EncoderNode& node) {
+            value = node.encodeValue(pos, value, ctx);
+        }
+        const Position& pos;
+        DT::EvalContext& ctx;
+        int value;
+    };
+    Visitor visitor(pos, ctx, value);
+    node.accept(visitor);
+    return visitor.value;
+}
+
 void
 DecisionTree::encodeValues(int nThreads) {
     const U64 size = posIdx.tbSize();
@@ -263,26 +538,8 @@ DecisionTree::encodeValues(int nThreads) {
     for (U64 b = 0; b < size; b += batchSize) {
         auto task = [this,size,batchSize,b](int workerNo) {
             Position pos;
+            PosIterator posIter(posIdx, pos);
             auto ctx = nodeFactory.makeEvalContext(posIdx);
-            struct Visitor {
-                Visitor(const Position& pos, DT::EvalContext& ctx) : pos(pos), ctx(ctx) {}
-                void visit(DT::PredicateNode& node) {
-                    return node.getChild(pos, ctx).accept(*this);
-                }
-                void visit(DT::StatsNode& node) {
-                    assert(false);
-                }
-                void visit(DT::StatsCollectorNode& node) {
-                    assert(false);
-                }
-                void visit(DT::EncoderNode& node) {
-                    value = node.encodeValue(pos, value, ctx);
-                }
-                const Position& pos;
-                DT::EvalContext& ctx;
-                int value = 0;
-            };
-            Visitor visitor(pos, *ctx);
 
             U64 end = std::min(b + batchSize, size);
             std::vector<U64> hist;
@@ -290,13 +547,11 @@ DecisionTree::encodeValues(int nThreads) {
                 if (!active.get(idx))
                     continue;
 
-                bool valid = posIdx.index2Pos(idx, pos);
+                bool valid = posIter.setIndex(idx);
                 assert(valid);
                 ctx->init(pos, data, idx);
 
-                visitor.value = data.getValue(idx);
-                root->accept(visitor);
-                int encVal = visitor.value;
+                int encVal = encodeValue(*root, pos, *ctx, data.getValue(idx));
                 if (encVal >= 0) {
                     if ((int)hist.size() < encVal + 1)
                         hist.resize(encVal + 1);
@@ -359,5 +614,28 @@ DecisionTree::logMisPredicted(U64 remaining) {
 
 void
 DecisionTree::serialize(std::vector<U8>& out) {
-
+    struct Visitor {
+        explicit Visitor(std::vector<U8>& out) : out(out) {}
+        void visit(DT::PredicateNode& node) {
+            node.pred->serialize(out);
+            std::vector<U8> leftCode;
+            Visitor leftVisitor(leftCode);
+            node.left->accept(leftVisitor);
+            writeVarUInt(leftCode.size(), out);
+            out.insert(out.end(), leftCode.begin(), leftCode.end());
+            node.right->accept(*this);
+        }
+        void visit(DT::StatsNode& node) {
+            assert(false);
+        }
+        void visit(DT::StatsCollectorNode& node) {
+            assert(false);
+        }
+        void visit(DT::EncoderNode& node) {
+            node.serialize(out);
+        }
+        std::vector<U8>& out;
+    };
+    Visitor visitor(out);
+    root->accept(visitor);
 }
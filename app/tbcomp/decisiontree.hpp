@@ -2,6 +2,7 @@
 #define DECISIONTREE_HPP_
 
 #include "dtnode.hpp"
+#include "indexlist.hpp"
 #include "util/util.hpp"
 #include <vector>
 
@@ -12,10 +13,14 @@ class Position;
 
 /** Class to compute a decision tree that predicts the values in a tablebase. */
 class DecisionTree {
+    friend class Test;
 public:
     /** "active" contains one bit for each element in data. A bit
      *  is set to false if the corresponding position can be handled
-     *  without using a decision tree. */
+     *  without using a decision tree. If "samplingLogFactor" >= 0, statistics
+     *  for all nodes are collected in chunks of 1 in 2^samplingLogFactor
+     *  positions. If it is negative, the number of chunks is chosen for each
+     *  StatsCollectorNode based on its estimated number of positions. */
     DecisionTree(DT::NodeFactory& nodeFactory, const PosIndex& posIdx,
                  DT::UncompressedData& data, const BitArray& active,
                  int samplingLogFactor);
@@ -25,20 +30,56 @@ public:
      *  stats collector nodes are allowed in the tree. */
     void computeTree(int maxDepth, int maxCollectorNodes, int nThreads);
 
-    /** Create serialized bytecode representation of the tree. */
+    /** Create serialized bytecode representation of the tree. Must be called
+     *  after computeTree(). The format is described in treeinterp.hpp. */
     void serialize(std::vector<U8>& out);
 
+    /** Time in seconds spent in the phases of computeTree(). */
+    struct PhaseTimes {
+        double stats = 0;  // updateStats()
+        double select = 0; // selectBestPreds()
+        double encode = 0; // Tree simplification and encoding of all values
+        int nIter = 0;     // Number of updateStats() calls
+        U64 nApplied = 0;  // Number of positions applied to StatsCollectorNodes
+    };
+    const PhaseTimes& getPhaseTimes() const { return phaseTimes; }
+
+    /** Encode "value" for position "pos" using the encoder tree rooted at
+     *  "node". "ctx" must have been initialized for "pos". */
+    static int encodeValue(DT::Node& node, const Position& pos, DT::EvalContext& ctx,
+                           int value);
+
 private:
-    /** Update statistics for all MultiPredicate nodes. */
-    void updateStats(unsigned int chunkNo);
+    /** Create a tree consisting of a single StatsCollectorNode, that initially
+     *  gets all active positions. */
+    void initStats(const DT::EvalContext& ctx);
+
+    /** Update statistics for all StatsCollectorNodes, using "nThreads" threads.
+     *  Each node collects data for the positions in its chunk "chunkNo" and
+     *  the number of applied positions is returned. Only positions in
+     *  leafPositions are visited, so positions that have reached a final
+     *  StatsNode are not decoded again.
+     *  When more than one thread is used, each worker collects statistics in
+     *  private copies of the StatsCollectorNodes, which are added to the tree
+     *  when all positions have been processed. The result is independent of
+     *  the number of threads. */
+    U64 updateStats(unsigned int chunkNo, int nThreads);
+
+    /** Return number of chunks to use for a StatsCollectorNode corresponding
+     *  to "nPositions" positions. */
+    int numChunks(U64 nPositions) const;
 
     /** For all StatsCollectorNodes report that one chunk has been processed. */
     void statsChunkAdded();
 
     /** For each StatsCollectorNode, if it is accurate enough, replace it with
      *  a tree consisting of the best predicate and two new StatsCollectorNodes.
+     *  The best predicates are computed using "nThreads" threads. The tree is
+     *  modified in depth first order, so the result does not depend on the
+     *  number of threads.
      *  @return True if there are still StatsCollectorNodes in the tree. */
-    bool selectBestPreds(int maxDepth, int maxCollectorNodes, double& costThreshold);
+    bool selectBestPreds(int maxDepth, int maxCollectorNodes, double& costThreshold,
+                         int nThreads);
 
     /** Merge nodes if they are equivalent or if the cost change is small enough. */
     void simplifyTree();
@@ -61,7 +102,26 @@ private:
     const BitArray& active;
 
     std::unique_ptr<DT::Node> root;
-    int nStatsChunks;     // Must be power of 2
+    PhaseTimes phaseTimes;
+
+    /** The positions that can reach a StatsCollectorNode. If "node" is a
+     *  StatsCollectorNode the list contains exactly its positions. Otherwise
+     *  "node" is a subtree that replaced a StatsCollectorNode in the last call
+     *  to selectBestPreds(), and the positions are assigned to the collectors
+     *  in the subtree by the next updateStats() call. If "allActive" is true,
+     *  "indices" is not used and the list contains all active positions. */
+    struct LeafPositions {
+        DT::Node* node = nullptr;
+        bool allActive = false;
+        IndexList indices;
+    };
+    std::vector<LeafPositions> leafPositions;
+    int nStatsChunks;     // Must be power of 2. Max number of chunks for a node.
+    bool adaptiveChunks;  // True if number of chunks depends on node size
+
+    // In adaptive mode, a node is sampled in chunks of at least this many positions
+    static const U64 minChunkPositions = 64 * 1024;
+    static const int maxAdaptiveChunks = 1024;
 };
 
 #endif
@@ -8,6 +8,64 @@
 
 namespace DT {
 
+EvalContext::EvalContext(const PosIndex& posIdx)
+    : posIdx(posIdx), nPieces(posIdx.numPieces()) {
+    assert(nPieces <= maxPieces);
+    for (int i = 0; i < nPieces; i++)
+        pieceTypes[i] = posIdx.getPieceType(i);
+}
+
+void
+EvalContext::computeFeatures(const Position& pos) {
+    // Pieces of the same type are numbered consecutively, in square order
+    U64 m = 0;
+    for (int i = 0; i < nPieces; i++) {
+        if (i == 0 || pieceTypes[i] != pieceTypes[i-1])
+            m = pos.pieceTypeBB(pieceTypes[i]);
+        squares[i] = BitBoard::extractSquare(m);
+    }
+
+    const U64 occupied = pos.occupiedBB();
+    knightAttacks[0] = knightAttacks[1] = 0;
+    for (int i = 0; i < nPieces; i++) {
+        const int sq = squares[i];
+        U64 atk;
+        switch (pieceTypes[i]) {
+        case Piece::WKING: case Piece::BKING:
+            atk = BitBoard::kingAttacks(sq);
+            break;
+        case Piece::WQUEEN: case Piece::BQUEEN:
+            atk = BitBoard::bishopAttacks(sq, occupied) | BitBoard::rookAttacks(sq, occupied);
+            break;
+        case Piece::WROOK: case Piece::BROOK:
+            atk = BitBoard::rookAttacks(sq, occupied);
+            break;
+        case Piece::WBISHOP: case Piece::BBISHOP:
+            atk = BitBoard::bishopAttacks(sq, occupied);
+            break;
+        case Piece::WKNIGHT: case Piece::BKNIGHT:
+            atk = BitBoard::knightAttacks(sq);
+            knightAttacks[Piece::isWhite(pieceTypes[i])] |= atk;
+            break;
+        case Piece::WPAWN:
+            atk = BitBoard::wPawnAttacks(sq);
+            break;
+        case Piece::BPAWN:
+            atk = BitBoard::bPawnAttacks(sq);
+            break;
+        default:
+            assert(false);
+            atk = 0;
+            break;
+        }
+        attacks[i] = atk;
+
+        kingDist[i][i] = 0;
+        for (int j = 0; j < i; j++)
+            kingDist[i][j] = kingDist[j][i] = BitBoard::getKingDistance(sq, squares[j]);
+    }
+}
+
 PredicateNode::PredicateNode()
   : Node(NodeType::PREDICATE) {
 }
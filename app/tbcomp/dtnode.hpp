@@ -60,14 +60,13 @@ public:
     virtual int getValue(U64 idx) const = 0;
     virtual void setEncoded(U64 idx, int value) = 0;
     virtual int getEncoded(U64 idx) const = 0;
-
-    virtual bool isHandled(U64 idx) const = 0;
-    virtual void setHandled(U64 idx, bool active) = 0;
 };
 
+/** Per-thread context used when evaluating predicates. init() must be called
+ *  for each position before any predicate is evaluated for that position. */
 class EvalContext {
 public:
-    explicit EvalContext(const PosIndex& posIdx) : posIdx(posIdx) {}
+    explicit EvalContext(const PosIndex& posIdx);
     virtual ~EvalContext() = default;
 
     virtual void init(const Position& pos, const UncompressedData& data, U64 idx) = 0;
@@ -75,10 +74,32 @@ public:
 
     int numPieces() const;
     Piece::Type getPieceType(int pieceNo) const;
-    int getPieceSquare(int pieceNo, const Position& pos) const;
+
+    /** Per-position features computed by computeFeatures(). */
+    int getPieceSquare(int pieceNo) const;
+    /** Squares attacked by a piece, using the position occupancy for sliders. */
+    U64 getAttacks(int pieceNo) const;
+    /** King distance between two pieces. */
+    int getKingDistance(int p1, int p2) const;
+    /** Union of squares attacked by all white/black knights. */
+    U64 getKnightAttacks(bool white) const;
 
 protected:
+    /** Compute the features shared by all predicates for "pos".
+     *  Must be called by init(). */
+    void computeFeatures(const Position& pos);
+
     const PosIndex& posIdx;
+
+private:
+    static const int maxPieces = 8;
+    const int nPieces;
+    std::array<Piece::Type,maxPieces> pieceTypes;
+
+    std::array<int,maxPieces> squares;
+    std::array<U64,maxPieces> attacks;
+    std::array<std::array<U8,maxPieces>,maxPieces> kingDist;
+    std::array<U64,2> knightAttacks; // [white]
 };
 
 class PredicateNode : public Node {
@@ -113,6 +134,9 @@ public:
 
     /** Get encoder node corresponding to the statistics in this node. */
     virtual std::unique_ptr<EncoderNode> getEncoder() const = 0;
+
+    /** Return the (estimated) number of positions corresponding to this node. */
+    virtual U64 getNumPositions() const = 0;
 };
 
 /** A collection of all possible predicates. Collects statistics about
@@ -126,9 +150,25 @@ public:
      *  @return True if application was successful, false otherwise. */
     virtual bool applyData(const Position& pos, int value, EvalContext& ctx) = 0;
 
+    /** Add statistics collected by "other" to this node. "other" must have been
+     *  created by the same NodeFactory and EvalContext type as this node. */
+    virtual void addStats(const StatsCollectorNode& other) = 0;
+
     /** Called after applyData() has been called for all positions in a chunk. */
     void chunkAdded();
 
+    /** Return number of chunks the data for this node is partitioned in. */
+    int getNumChunks() const { return nChunks; }
+
+    /** Return true if a position in global sampling chunk "chunk" belongs to
+     *  the chunk this node collects data for in iteration "chunkNo". nChunks
+     *  must be a power of two, so that during nChunks consecutive iterations
+     *  all positions are applied exactly once. */
+    bool useChunk(U64 chunk, unsigned int chunkNo) const {
+        const U64 mask = nChunks - 1;
+        return (chunk & mask) == (chunkNo & mask);
+    }
+
     double cost(const DT::EvalContext& ctx) const override;
 
     std::unique_ptr<StatsNode> getStats(const DT::EvalContext& ctx) const override;
@@ -159,6 +199,10 @@ public:
      *  encoded as 0, second most likely as 1, etc. */
     virtual int encodeValue(const Position& pos, int value, EvalContext& ctx) const = 0;
 
+    /** Append serialized representation to "out". The first byte must
+     *  have the most significant bit set, to distinguish it from a predicate. */
+    virtual void serialize(std::vector<U8>& out) const = 0;
+
     double cost(const DT::EvalContext& ctx) const override;
 };
 
@@ -193,17 +237,32 @@ void Node::accept(Visitor& visitor, Args&&... args) {
 
 inline int
 EvalContext::numPieces() const {
-    return posIdx.numPieces();
+    return nPieces;
 }
 
 inline Piece::Type
 EvalContext::getPieceType(int pieceNo) const {
-    return posIdx.getPieceType(pieceNo);
+    return pieceTypes[pieceNo];
 }
 
 inline int
-EvalContext::getPieceSquare(int pieceNo, const Position& pos) const {
-    return posIdx.getPieceSquare(pieceNo, pos);
+EvalContext::getPieceSquare(int pieceNo) const {
+    return squares[pieceNo];
+}
+
+inline U64
+EvalContext::getAttacks(int pieceNo) const {
+    return attacks[pieceNo];
+}
+
+inline int
+EvalContext::getKingDistance(int p1, int p2) const {
+    return kingDist[p1][p2];
+}
+
+inline U64
+EvalContext::getKnightAttacks(bool white) const {
+    return knightAttacks[white];
 }
 
 inline Node&
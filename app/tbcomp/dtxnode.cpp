@@ -1 +1,209 @@
 #include "dtxnode.hpp"
+#include "tbutil.hpp"
+#include <numeric>
+#include <algorithm>
+
+
+double
+DTXStats::splitCost(const DTXStats& statsFalse, const DTXStats& statsTrue, bool useGini) {
+    return statsFalse.adjustedCost(useGini) + statsTrue.adjustedCost(useGini);
+}
+
+double
+DTXStats::cost(bool useGini) const {
+    if (useGini) {
+        return ::giniImpurity(count.begin(), count.end());
+    } else {
+        return ::entropy(count.begin(), count.end());
+    }
+}
+
+double
+DTXStats::costError(bool useGini) const {
+    if (useGini) {
+        return ::giniImpurityError(count.begin(), count.end());
+    } else {
+        return ::entropyError(count.begin(), count.end());
+    }
+}
+
+double
+DTXStats::adjustedCost(bool useGini) const {
+    U64 sum = std::accumulate(count.begin(), count.end(), (U64)0);
+    int bits = (sum >= (1ULL<<32)) ? floorLog2((U32)(sum >> 32)) + 32 : floorLog2((U32)sum);
+    return cost(useGini) + (64 - bits) * 1e-4;
+}
+
+std::string
+DTXStats::describe(const DT::EvalContext& ctx) const {
+    U64 tot = std::accumulate(count.begin(), count.end(), (U64)0);
+
+    std::stringstream ss;
+    ss << std::scientific << std::setprecision(2) << (double)tot;
+    ss << " [";
+    for (int i = 0; i < nVals; i++) {
+        if (i > 0) ss << ' ';
+        ss << count[i];
+    }
+    ss << "] ";
+
+    bool useGini = static_cast<const DTXEvalContext&>(ctx).useGini();
+    ss << cost(useGini);
+
+    return ss.str();
+}
+
+// ------------------------------------------------------------
+
+double
+DTXStatsNode::cost(const DT::EvalContext& ctx) const {
+    bool useGini = static_cast<const DTXEvalContext&>(ctx).useGini();
+    return stats.cost(useGini);
+}
+
+double
+DTXStatsNode::costError(const DT::EvalContext& ctx) const {
+    bool useGini = static_cast<const DTXEvalContext&>(ctx).useGini();
+    return stats.costError(useGini);
+}
+
+std::unique_ptr<DT::StatsNode>
+DTXStatsNode::getStats(const DT::EvalContext& ctx) const {
+    return make_unique<DTXStatsNode>(*this);
+}
+
+std::string
+DTXStatsNode::describe(int indentLevel, const DT::EvalContext& ctx) const {
+    std::stringstream ss;
+    ss << std::string(indentLevel*2, ' ') << stats.describe(ctx) << '\n';
+    return ss.str();
+}
+
+void
+DTXStatsNode::addStats(const DT::StatsNode* other) {
+    stats.addStats(static_cast<const DTXStatsNode&>(*other).stats);
+}
+
+bool
+DTXStatsNode::isEmpty() const {
+    return stats.isEmpty();
+}
+
+std::unique_ptr<DT::StatsNode>
+DTXStatsNode::mergeWithNode(const DT::StatsNode& other, const DT::EvalContext& ctx) const {
+    const DTXStatsNode& otherDtx = static_cast<const DTXStatsNode&>(other);
+    bool merge = false;
+
+    DTXStats sum(stats);
+    sum.addStats(otherDtx.stats);
+    const auto& dtxCtx = static_cast<const DTXEvalContext&>(ctx);
+    bool useGini = false;
+    double costDiff = sum.cost(useGini) - (stats.cost(useGini) + otherDtx.stats.cost(useGini));
+    if (costDiff <= dtxCtx.getMergeThreshold())
+        merge = true;
+
+    if (!merge) {
+        DTXEncoderNode enc1(stats);
+        DTXEncoderNode enc2(otherDtx.stats);
+        if (enc1 == enc2)
+            merge = true;
+    }
+
+    if (!merge)
+        return nullptr;
+
+    return make_unique<DTXStatsNode>(sum);
+}
+
+std::unique_ptr<DT::EncoderNode>
+DTXStatsNode::getEncoder() const {
+    return make_unique<DTXEncoderNode>(stats);
+}
+
+// ------------------------------------------------------------
+
+DTXEncoderNode::DTXEncoderNode(const DTXStats& stats) {
+    constexpr int N = DTXStats::nVals;
+    std::array<std::pair<U64,int>,N> srt;
+    const U64 maxVal = ~0ULL;
+    for (int i = 0; i < N; i++)
+        srt[i] = std::make_pair(maxVal - stats.getCount(i), i);
+    std::sort(srt.begin(), srt.end());
+    for (int i = 0; i < N; i++)
+        order[i] = srt[i].second;
+}
+
+int
+DTXEncoderNode::encodeValue(const Position& pos, int value, DT::EvalContext& ctx) const {
+    if (value > DTXStats::maxVal)
+        return DTXStats::escapeVal;
+    const int bucket = DTXStats::valueIndex(value);
+    int ret = 0;
+    for (int b : order) {
+        if (b == bucket)
+            return ret + value - DTXStats::bucketLow(b);
+        ret += DTXStats::bucketSize(b);
+    }
+    assert(false);
+    return ret;
+}
+
+std::unique_ptr<DT::StatsNode>
+DTXEncoderNode::getStats(const DT::EvalContext& ctx) const {
+    return make_unique<DTXStatsNode>(DTXStats{});
+}
+
+std::string
+DTXEncoderNode::describe(int indentLevel, const DT::EvalContext& ctx) const {
+    std::stringstream ss;
+    ss << std::string(indentLevel*2, ' ');
+    for (int b : order)
+        ss << "0123456789abcdef"[b];
+    ss << '\n';
+    return ss.str();
+}
+
+void
+DTXEncoderNode::serialize(std::vector<U8>& out) const {
+    out.push_back(0x80);
+    for (int i = 0; i < DTXStats::nVals; i += 2)
+        out.push_back(order[i] | (order[i+1] << 4));
+}
+
+int
+DTXEncoderNode::decodeLeafValue(const U8* leaf, int encVal) {
+    if (encVal == DTXStats::escapeVal)
+        return -1;
+    for (int i = 0; i < DTXStats::nVals; i++) {
+        int b = (leaf[1 + i / 2] >> ((i & 1) * 4)) & 15;
+        int size = DTXStats::bucketSize(b);
+        if (encVal < size)
+            return DTXStats::bucketLow(b) + encVal;
+        encVal -= size;
+    }
+    assert(false);
+    return -1;
+}
+
+// ------------------------------------------------------------
+
+std::unique_ptr<DT::StatsCollectorNode>
+DTXNodeFactory::makeStatsCollector(const DT::EvalContext& ctx, int nChunks,
+                                   double priorCost) {
+    return make_unique<DTXStatsCollectorNode>(ctx, nChunks, priorCost);
+}
+
+std::unique_ptr<DT::EvalContext>
+DTXNodeFactory::makeEvalContext(const PosIndex& posIdx) {
+    return make_unique<DTXEvalContext>(posIdx, useGiniImpurity, mergeThreshold);
+}
+
+// ------------------------------------------------------------
+
+void
+DTXEvalContext::init(const Position& pos,
+                     const DT::UncompressedData& data, U64 idx) {
+    computeFeatures(pos);
+    const DTXUncompressedData& dtxData = static_cast<const DTXUncompressedData&>(data);
+    wdl = dtxData.getWdl(idx);
+}
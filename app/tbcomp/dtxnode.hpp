@@ -2,24 +2,299 @@
 #define DTXNODE_HPP_
 
 #include "dtnode.hpp"
+#include "predicates.hpp"
+#include "statscollector.hpp"
+#include <array>
+#include <cmath>
 
 
-#if 0
+class DTXStatsNode;
+class DTXEvalContext;
+
+
+/** Statistics for DTZ/DTM metrics. Values are distances >= 1. Values up to
+ *  maxVal are counted in nVals buckets of increasing width. Larger values
+ *  are counted in the last bucket, and encoded as escapeVal. */
+class DTXStats {
+public:
+    constexpr static int nVals = 16;
+    constexpr static int maxVal = 255;
+    constexpr static int escapeVal = 255;
+
+    DTXStats() : count{} {}
+
+    template <typename Pred>
+    static std::unique_ptr<DT::Node> makeNode(const Pred& pred,
+                                              const DTXStats& statsFalse,
+                                              const DTXStats& statsTrue);
+
+    /** Create from nVals counts. */
+    explicit DTXStats(const U64* cnt) {
+        for (int i = 0; i < nVals; i++)
+            count[i] = cnt[i];
+    }
+
+    /** Cost of a split into statsFalse/statsTrue. Lower is better. */
+    static double splitCost(const DTXStats& statsFalse, const DTXStats& statsTrue,
+                            bool useGini);
+
+    /** Return the bucket containing "value". */
+    static int valueIndex(int value);
+    /** Return the smallest value in a bucket. */
+    static int bucketLow(int bucket);
+    /** Return the number of values in a bucket. */
+    static int bucketSize(int bucket);
+
+    void addStats(const DTXStats& other) {
+        for (int i = 0; i < nVals; i++)
+            count[i] += other.count[i];
+    }
+
+    void subStats(const DTXStats& other) {
+        for (int i = 0; i < nVals; i++)
+            count[i] -= other.count[i];
+    }
+
+    bool isEmpty() const {
+        for (U64 cnt : count)
+            if (cnt != 0)
+                return false;
+        return true;
+    }
+
+    /** Return cost. (entropy or Gini impurity of the bucket distribution). */
+    double cost(bool useGini) const;
+    double costError(bool useGini) const;
+
+    /** String representation of data, for debugging. */
+    std::string describe(const DT::EvalContext& ctx) const;
+
+    /** Get the i:th count. */
+    U64 getCount(int i) const { return count[i]; }
+
+    /** Get the sum of all counts. */
+    U64 getTotalCount() const {
+        U64 sum = 0;
+        for (U64 cnt : count)
+            sum += cnt;
+        return sum;
+    }
+
+    void scaleCounts(int nChunks, int appliedChunks) {
+        if (nChunks != appliedChunks)
+            for (int i = 0; i < nVals; i++)
+                count[i] = (U64)std::round((double)count[i] * nChunks / appliedChunks);
+    }
+
+private:
+    /** Cost adjusted to prefer an even split when the real cost is the same. */
+    double adjustedCost(bool useGini) const;
+
+    std::array<U64,nVals> count;
+};
 
 /** Statistics node for DTZ/DTM metrics. */
-class DTXStatsNode : public StatsNode {
+class DTXStatsNode : public DT::StatsNode {
+public:
+    explicit DTXStatsNode(const DTXStats& stats) : stats(stats) {}
+
+    double cost(const DT::EvalContext& ctx) const override;
+    double costError(const DT::EvalContext& ctx) const;
+    std::unique_ptr<DT::StatsNode> getStats(const DT::EvalContext& ctx) const override;
+    std::string describe(int indentLevel, const DT::EvalContext& ctx) const override;
+
+    void addStats(const DT::StatsNode* other) override;
+    bool isEmpty() const override;
+    std::unique_ptr<DT::StatsNode> mergeWithNode(const DT::StatsNode& other,
+                                                 const DT::EvalContext& ctx) const override;
+
+    std::unique_ptr<DT::EncoderNode> getEncoder() const override;
+
+    U64 getNumPositions() const override { return stats.getTotalCount(); }
+
+    void scaleStats(int nChunks, int appliedChunks) {
+        stats.scaleCounts(nChunks, appliedChunks);
+    }
+
+private:
     DTXStats stats;
 };
 
-class DTXStatsCollectorNode : public StatsCollectorNode {
-    StatsCollector<WTMPredicate, DTXStats> wtm;
-    StatsCollector<InCheckPredicate, DTXStats> inCheck;
-    StatsCollector<BishopPairPredicate<true>, DTXStats> bPairW;
-    StatsCollector<BishopPairPredicate<false>, DTXStats> bPairB;
+// ------------------------------------------------------------
+
+/** The WDL score (white perspective) of the position. For DTZ/DTM tables the
+ *  WDL score is known by the prober before the distance is needed. */
+class PosWdlPredicate : public MultiPredicate {
+public:
+    constexpr static int minVal = -2;
+    constexpr static int maxVal = 2;
+    int eval(const Position& pos, DT::EvalContext& ctx) const override;
+    void serialize(std::vector<U8>& out) const override {
+        out.push_back((U8)PredOp::POSWDL);
+    }
+    std::string name() const override {
+        return "posWdl";
+    }
 };
 
-#endif
+// ------------------------------------------------------------
+
+/** Statistics collector for DTZ/DTM values. */
+class DTXStatsCollectorNode : public PredStatsCollectorNode<DTXStats, DTXStatsNode,
+                                                            DTXEvalContext, PosWdlPredicate> {
+public:
+    using PredStatsCollectorNode::PredStatsCollectorNode;
+};
+
+/** Encodes a value as its rank in a list of all values ordered by decreasing
+ *  predicted probability. Buckets are ordered by decreasing count, and values
+ *  within a bucket are ordered by increasing value. */
+class DTXEncoderNode : public DT::EncoderNode {
+public:
+    explicit DTXEncoderNode(const DTXStats& stats);
+
+    int encodeValue(const Position& pos, int value, DT::EvalContext& ctx) const override;
+    std::unique_ptr<DT::StatsNode> getStats(const DT::EvalContext& ctx) const override;
+    std::string describe(int indentLevel, const DT::EvalContext& ctx) const override;
+
+    /** Store the bucket order as 0x80 followed by nVals/2 bytes, two bucket
+     *  numbers per byte. */
+    void serialize(std::vector<U8>& out) const override;
+
+    /** Inverse of encodeValue(), for a leaf created by serialize().
+     *  Returns -1 if "encVal" is the escape value. */
+    static int decodeLeafValue(const U8* leaf, int encVal);
+
+    bool operator==(const DTXEncoderNode& other) const {
+        return order == other.order;
+    }
+
+private:
+    std::array<U8, DTXStats::nVals> order; // Bucket numbers, most frequent first
+};
+
+/** Class to compactly store DTZ/DTM related information for a position. */
+class DTZInfo {
+public:
+    int getDtx() const { return getBits(0, 10); }
+    int getWdl() const { return getBits(10, 3) - 2; }
+    U16 getData() const { return data; }
+
+    /** Set distance value, values larger than 1023 are stored as 1023. */
+    void setDtx(int dtx) & { setBits(0, 10, std::min(dtx, 1023)); }
+    void setWdl(int wdl) & { setBits(10, 3, wdl + 2); }
+    void setData(U16 val) & { data = val; }
+
+private:
+    void setBits(int first, int size, int val) {
+        int mask = ((1 << size) - 1) << first;
+        data = (data & ~mask) | ((val << first) & mask);
+    }
+
+    int getBits(int first, int size) const {
+        int mask = ((1 << size) - 1);
+        return (data >> first) & mask;
+    }
+
+    U16 data = 0; // Bit 0-9  : min(abs(dtx), 1023)
+                  // Bit 10-12: wdl + 2
+                  // Bit 13-15: Not used
+};
+
+class DTXUncompressedData : public DT::UncompressedData {
+public:
+    DTXUncompressedData(DTZInfo* data) : data(data) {}
+
+    int getValue(U64 idx) const override { return data[idx].getDtx(); }
+    void setEncoded(U64 idx, int value) override { data[idx].setData(value); }
+    int getEncoded(U64 idx) const override { return data[idx].getData(); }
+
+    int getWdl(U64 idx) const { return data[idx].getWdl(); }
+
+private:
+    DTZInfo* data;
+};
+
+class DTXNodeFactory : public DT::NodeFactory {
+public:
+    explicit DTXNodeFactory(bool gini, double mergeThreshold)
+    : useGiniImpurity(gini), mergeThreshold(mergeThreshold) {}
+
+    std::unique_ptr<DT::StatsCollectorNode> makeStatsCollector(const DT::EvalContext& ctx,
+                                                               int nChunks, double priorCost) override;
+
+    std::unique_ptr<DT::EvalContext> makeEvalContext(const PosIndex& posIdx) override;
+
+private:
+    const bool useGiniImpurity;
+    const double mergeThreshold;
+};
+
+class DTXEvalContext : public DT::EvalContext {
+public:
+    DTXEvalContext(const PosIndex& posIdx, bool gini, double mergeThreshold)
+    : DT::EvalContext(posIdx), gini(gini), mergeThreshold(mergeThreshold) {}
+
+    void init(const Position& pos, const DT::UncompressedData& data, U64 idx) override;
+
+    int getWdl() const { return wdl; }
+
+    bool useGini() const { return gini; }
+    double getMergeThreshold() const override { return mergeThreshold; }
+
+private:
+    int wdl = 0;
+    const bool gini;
+    const double mergeThreshold;
+};
+
+template <typename Pred>
+std::unique_ptr<DT::Node> DTXStats::makeNode(const Pred& pred,
+                                             const DTXStats& statsFalse,
+                                             const DTXStats& statsTrue) {
+    if (statsFalse.isEmpty()) {
+        return make_unique<DTXStatsNode>(statsTrue);
+    } else if (statsTrue.isEmpty()) {
+        return make_unique<DTXStatsNode>(statsFalse);
+    } else {
+        auto ret = make_unique<DT::PredicateNode>();
+        ret->pred = make_unique<Pred>(pred);
+        ret->left = make_unique<DTXStatsNode>(statsFalse);
+        ret->right = make_unique<DTXStatsNode>(statsTrue);
+        return std::move(ret);
+    }
+}
+
+inline int
+DTXStats::valueIndex(int value) {
+    if (value <= 4)
+        return value - 1;
+    int u = std::min(value, maxVal) - 1;
+    int k = floorLog2((U32)u);
+    return 2 * k + ((u >> (k - 1)) & 1);
+}
+
+inline int
+DTXStats::bucketLow(int bucket) {
+    if (bucket < 4)
+        return bucket + 1;
+    int k = bucket / 2;
+    return 1 + ((2 + (bucket & 1)) << (k - 1));
+}
 
+inline int
+DTXStats::bucketSize(int bucket) {
+    if (bucket < 4)
+        return 1;
+    if (bucket == nVals - 1)
+        return maxVal + 1 - bucketLow(bucket);
+    return 1 << (bucket / 2 - 1);
+}
 
+inline int
+PosWdlPredicate::eval(const Position& pos, DT::EvalContext& ctx) const {
+    const DTXEvalContext& dtxCtx = static_cast<const DTXEvalContext&>(ctx);
+    return dtxCtx.getWdl();
+}
 
 #endif /* DTXNODE_HPP_ */
@@ -96,6 +96,26 @@ HuffCode::computeTree() {
             bits = (bits + 1) << (syms[i+1].first - syms[i].first);
     }
 
+    int maxLen = 0;
+    for (int len : symLen)
+        maxLen = std::max(maxLen, len);
+    tableBits = std::min(maxLen, maxTableBits);
+    table.assign(1 << tableBits, 0);
+    if (nodes.empty())
+        tableBits = 0;
+    for (int i = 0; i < (int)table.size() && !nodes.empty(); i++) {
+        int n = 0;
+        int len = 0;
+        while (len < tableBits) {
+            bool b = (i >> (tableBits - 1 - len)) & 1;
+            n = b ? nodes[n].right : nodes[n].left;
+            len++;
+            if (n <= 0)
+                break;
+        }
+        table[i] = n <= 0 ? ((-n) << 8) | len : n << 8;
+    }
+
 #if 0
     for (int i = 0; i < nSym; i++) {
         int len = syms[i].first;
@@ -114,11 +134,7 @@ HuffCode::computeTree() {
 }
 
 int
-HuffCode::decodeSymbol(BitBufferReader& buf) const {
-    if (defaultSymbol >= 0)
-        return defaultSymbol;
-
-    int n = 0;
+HuffCode::decodeSymbolSlow(BitBufferReader& buf, int n) const {
     while (true) {
         bool b = buf.readBit();
         n = b ? nodes[n].right : nodes[n].left;
@@ -127,6 +143,39 @@ HuffCode::decodeSymbol(BitBufferReader& buf) const {
     }
 }
 
+void
+HuffCode::decodeSymbols(BitBufferReader& buf, U64 nSymbols, std::vector<int>& data) const {
+    U64 pos = data.size();
+    data.resize(pos + nSymbols);
+    if (defaultSymbol >= 0) {
+        std::fill(data.begin() + pos, data.end(), defaultSymbol);
+        return;
+    }
+
+    const int shift = 64 - tableBits;
+    while (pos < data.size()) {
+        // Decode symbols ending before the last loaded bit using a local
+        // copy of the loaded bits
+        U64 win = buf.getLoadedBits();
+        const int nBits = buf.getNumLoaded();
+        int used = 0;
+        while (pos < data.size()) {
+            const U32 e = table[win >> shift];
+            const int len = e & 0xff;
+            if (len == 0 || len >= nBits - used)
+                break;
+            data[pos++] = e >> 8;
+            win <<= len;
+            used += len;
+        }
+        buf.skipBits(used);
+
+        // Decode a symbol that is long or crosses a word boundary
+        if (pos < data.size())
+            data[pos++] = decodeSymbol(buf);
+    }
+}
+
 void
 HuffCode::encodeSymbol(int data, BitBufferWriter& buf) const {
     buf.writeBits(symBits[data], symLen[data]);
@@ -235,7 +284,5 @@ Huffman::encode(const std::vector<int>& data, const HuffCode& code,
 void
 Huffman::decode(BitBufferReader& in, U64 nSymbols, const HuffCode& code,
                 std::vector<int>& data) {
-    data.reserve(nSymbols);
-    while (nSymbols-- != 0)
-        data.push_back(code.decodeSymbol(in));
+    code.decodeSymbols(in, nSymbols, data);
 }
@@ -22,13 +22,24 @@ public:
     /** Decode one symbol. */
     int decodeSymbol(BitBufferReader& buf) const;
 
+    /** Decode "nSymbols" symbols and append them to "data". Faster than
+     *  calling decodeSymbol() repeatedly, since symbols contained in the
+     *  loaded bits are decoded without updating the reader state. */
+    void decodeSymbols(BitBufferReader& buf, U64 nSymbols, std::vector<int>& data) const;
+
     /** Encode one symbol. */
     void encodeSymbol(int data, BitBufferWriter& buf) const;
 
+    /** Return the number of bits encodeSymbol() writes for symbol "data". */
+    int codeLength(int data) const { return symLen[data]; }
+
 private:
-    /** Compute canonical Huffman tree from symbol lengths. */
+    /** Compute canonical Huffman tree and decoding table from symbol lengths. */
     void computeTree();
 
+    /** Decode one symbol, starting at tree node "n", one bit at a time. */
+    int decodeSymbolSlow(BitBufferReader& buf, int n) const;
+
     std::vector<int> symLen;  // Symbol lengths
     std::vector<U64> symBits; // Symbol bit patterns
     int defaultSymbol = -1;   // Default symbol in case all symLen == 0
@@ -38,6 +49,14 @@ private:
         int right;  // Right child, or -symVal if right child is a leaf node
     };
     std::vector<Node> nodes;
+
+    // Decoding table indexed by the next tableBits bits. An entry is
+    // (sym << 8) | len for a code of length len <= tableBits, or
+    // (node << 8) if the code is longer than tableBits, where "node" is
+    // the tree node reached after tableBits bits.
+    static const int maxTableBits = 11;
+    int tableBits = 0;
+    std::vector<U32> table;
 };
 
 
@@ -55,4 +74,33 @@ public:
 };
 
 
+inline int
+HuffCode::decodeSymbol(BitBufferReader& buf) const {
+    if (defaultSymbol >= 0)
+        return defaultSymbol;
+
+    const U32 e = table[buf.peekBits(tableBits)];
+    const int len = e & 0xff;
+    const int nLoaded = buf.getNumLoaded();
+    if (len > 0) {
+        if (len <= nLoaded) {
+            buf.skipBits(len);
+            return e >> 8;
+        }
+    } else if (tableBits <= nLoaded) {
+        buf.skipBits(tableBits);
+        return decodeSymbolSlow(buf, e >> 8);
+    }
+
+    // The code extends into the next word, so the buffer contains that word
+    const U32 e2 = table[buf.peekBits64() >> (64 - tableBits)];
+    const int len2 = e2 & 0xff;
+    if (len2 > 0) {
+        buf.readBits(len2);
+        return e2 >> 8;
+    }
+    buf.readBits(tableBits);
+    return decodeSymbolSlow(buf, e2 >> 8);
+}
+
 #endif /* HUFFMAN_HPP_ */
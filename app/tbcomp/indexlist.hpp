@@ -0,0 +1,106 @@
+#ifndef INDEXLIST_HPP_
+#define INDEXLIST_HPP_
+
+#include "util/util.hpp"
+#include "tbutil.hpp"
+#include <vector>
+#include <iterator>
+
+
+/** A list of strictly increasing position indices. The indices are stored
+ *  in blocks of at most blockSize elements. Each block stores the distances
+ *  between consecutive indices in writeVarUInt() format, so the blocks can
+ *  be decoded independently, for example by different threads. */
+class IndexList {
+public:
+    static const U32 blockSize = 32 * 1024;
+
+    /** Append "idx", which must be larger than all indices in the list. */
+    void add(U64 idx);
+
+    /** Append all indices in "other", which must be larger than all indices
+     *  in this list. The blocks in "other" are moved, not re-encoded. */
+    void append(IndexList&& other);
+
+    /** Return the number of indices in the list. */
+    U64 size() const { return nIndices; }
+
+    /** Return the number of blocks. */
+    int numBlocks() const { return blocks.size(); }
+
+    /** Return the number of indices in block "blockNo". */
+    U32 blockLength(int blockNo) const { return blocks[blockNo].n; }
+
+    /** Call func(idx) for all indices in block "blockNo", in increasing order. */
+    template <typename Func>
+    void forEach(int blockNo, Func func) const;
+
+private:
+    struct Block {
+        U64 last = 0; // Last index in the block
+        U32 n = 0;    // Number of indices in the block
+        std::vector<U8> data;
+    };
+    std::vector<Block> blocks;
+    U64 nIndices = 0;
+};
+
+
+inline void
+IndexList::add(U64 idx) {
+    if (blocks.empty() || blocks.back().n >= blockSize) {
+        blocks.emplace_back();
+        Block& b = blocks.back();
+        writeVarUInt(idx, b.data);
+        b.last = idx;
+        b.n = 1;
+    } else {
+        Block& b = blocks.back();
+        writeVarUInt(idx - b.last - 1, b.data);
+        b.last = idx;
+        b.n++;
+    }
+    nIndices++;
+}
+
+inline void
+IndexList::append(IndexList&& other) {
+    if (nIndices == 0) {
+        *this = std::move(other);
+        other = IndexList();
+        return;
+    }
+    auto it = other.blocks.begin();
+    if (it != other.blocks.end() && blocks.back().n + it->n <= blockSize) {
+        // Merge first block in "other" into the last block, by replacing its
+        // first index with a distance and copying the remaining data
+        Block& b = blocks.back();
+        const U8* ptr = it->data.data();
+        const U8* end = ptr + it->data.size();
+        U64 first = readVarUInt(ptr);
+        writeVarUInt(first - b.last - 1, b.data);
+        b.data.insert(b.data.end(), ptr, end);
+        b.last = it->last;
+        b.n += it->n;
+        ++it;
+    }
+    blocks.insert(blocks.end(), std::make_move_iterator(it),
+                  std::make_move_iterator(other.blocks.end()));
+    nIndices += other.nIndices;
+    other = IndexList();
+}
+
+template <typename Func>
+inline void
+IndexList::forEach(int blockNo, Func func) const {
+    const Block& b = blocks[blockNo];
+    const U8* ptr = b.data.data();
+    U64 idx = readVarUInt(ptr);
+    func(idx);
+    for (U32 i = 1; i < b.n; i++) {
+        idx += readVarUInt(ptr) + 1;
+        func(idx);
+    }
+}
+
+#endif /* INDEXLIST_HPP_ */
@@ -302,6 +302,153 @@ PosIndex::computeCombInverse(int a, int b, std::vector<U64>& vec) const {
 
 // ------------------------------------------------------------
 
+PosIterator::PosIterator(const PosIndex& posIdx, Position& pos)
+    : posIdx(posIdx), pos(pos) {
+    static const Piece::Type wTypes[5] = { Piece::WQUEEN, Piece::WROOK, Piece::WBISHOP,
+                                           Piece::WKNIGHT, Piece::WPAWN };
+    static const Piece::Type bTypes[5] = { Piece::BQUEEN, Piece::BROOK, Piece::BBISHOP,
+                                           Piece::BKNIGHT, Piece::BPAWN };
+    radix[0] = posIdx.kingFactor;
+    combInv[0] = nullptr;
+    stepPiece[0] = Piece::EMPTY;
+    for (int s = 1; s < nSteps; s++) {
+        int i = 4 - (s - 1) / 2;
+        bool white = (s - 1) % 2 == 0;
+        radix[s] = white ? posIdx.wFactors[i] : posIdx.bFactors[i];
+        combInv[s] = white ? posIdx.wCombInv[i].data() : posIdx.bCombInv[i].data();
+        stepPiece[s] = white ? wTypes[i] : bTypes[i];
+    }
+}
+
+bool
+PosIterator::setIndex(U64 idx) {
+    if (haveIdx && idx == curIdx)
+        return posValid;
+    int first = -1;
+    if (haveIdx && idx > curIdx)
+        first = addToIndex(idx - curIdx);
+    if (first < 0)
+        first = decodeIndex(idx);
+    curIdx = idx;
+    return placePieces(first);
+}
+
+int
+PosIterator::decodeIndex(U64 idx) {
+    std::array<U32,nSteps> d;
+    for (int i = 0; i < 5; i++) {
+        d[nSteps - 1 - 2 * i] = posIdx.bDividers[i].modDiv(idx);
+        d[nSteps - 2 - 2 * i] = posIdx.wDividers[i].modDiv(idx);
+    }
+    d[0] = posIdx.kingDivider.modDiv(idx);
+    int newSide = posIdx.sideFactor > 1 ? idx : 0;
+
+    int first = 0;
+    if (haveIdx && newSide == side)
+        while (first < nSteps && d[first] == digit[first])
+            first++;
+    side = newSide;
+    digit = d;
+    haveIdx = true;
+    return first;
+}
+
+int
+PosIterator::addToIndex(U64 delta) {
+    for (int s = nSteps - 1; s >= 0; s--) {
+        if (radix[s] == 1)
+            continue;
+        if (delta >= radix[s])
+            return -1;
+        U64 v = digit[s] + delta;
+        if (v < radix[s]) {
+            digit[s] = v;
+            return s;
+        }
+        digit[s] = v - radix[s];
+        delta = 1;
+    }
+    side++;
+    assert(side < posIdx.sideFactor);
+    return 0;
+}
+
+bool
+PosIterator::placePieces(int first) {
+    const std::array<U64,nSteps> oldMask = mask;
+    const int oldWKing = wKing;
+    const int oldBKing = bKing;
+    if (first == 0) {
+        KingIndex ki(posIdx.hasPawn);
+        ki.indexToKings(digit[0], wKing, bKing);
+        mask[0] = (1ULL << wKing) | (1ULL << bKing);
+        first = 1;
+    }
+
+    U64 occupied = 0;
+    if (first <= 2) {
+        occupied = BitBoard::maskRow1Row8 | (first == 2 ? mask[1] : 0);
+    } else {
+        for (int s = 0; s < first; s++)
+            occupied |= mask[s];
+    }
+    for (int s = first; s < nSteps; s++) {
+        const bool pawn = s <= 2;
+        if (s == 3)
+            occupied = mask[0] | mask[1] | mask[2];
+        U64 m = combInv[s][digit[s]];
+        U64 newMask = 0;
+        while (m) {
+            int sq0 = BitBoard::extractSquare(m);
+            int sq = sq0 + (pawn ? 8 : 0);
+            while (true) {
+                int tmp = sq0 + BitBoard::bitCount(occupied & ((2ULL<<sq)-1));
+                if (tmp == sq)
+                    break;
+                sq = tmp;
+            }
+            newMask |= 1ULL << sq;
+        }
+        mask[s] = newMask;
+        occupied |= newMask;
+    }
+
+    if ((mask[1] | mask[2]) & mask[0]) { // Pawn on king square
+        posValid = false;
+        return false;
+    }
+
+    if (posValid) {
+        const bool newKings = wKing != oldWKing || bKing != oldBKing;
+        if (newKings)
+            for (U64 m = oldMask[0]; m; )
+                pos.clearPiece(BitBoard::extractSquare(m));
+        for (int s = 1; s < nSteps; s++)
+            for (U64 m = oldMask[s] & ~mask[s]; m; )
+                pos.clearPiece(BitBoard::extractSquare(m));
+        if (newKings) {
+            pos.setPiece(wKing, Piece::WKING);
+            pos.setPiece(bKing, Piece::BKING);
+        }
+        for (int s = 1; s < nSteps; s++)
+            for (U64 m = mask[s] & ~oldMask[s]; m; )
+                pos.setPiece(BitBoard::extractSquare(m), stepPiece[s]);
+    } else {
+        for (U64 m = pos.occupiedBB(); m; ) // Clear position
+            pos.clearPiece(BitBoard::extractSquare(m));
+        pos.setPiece(wKing, Piece::WKING);
+        pos.setPiece(bKing, Piece::BKING);
+        for (int s = 1; s < nSteps; s++)
+            for (U64 m = mask[s]; m; )
+                pos.setPiece(BitBoard::extractSquare(m), stepPiece[s]);
+    }
+    pos.setWhiteMove(side == 0);
+    posValid = true;
+    return true;
+}
+
+// ------------------------------------------------------------
+
 int KingIndex::symmetryTable[8][64];
 int KingIndex::indexTable[2][64][64];
 int KingIndex::symmetryTypeTable[2][64][64];
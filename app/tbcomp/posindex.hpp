@@ -90,6 +90,7 @@ public:
     static void staticInitialize();
 
 private:
+    friend class PosIterator;
 
     static U64 binCoeff(int a, int b);
 
@@ -123,6 +124,52 @@ private:
     std::array<std::vector<U64>,5> bCombInv;
 };
 
+/** Incremental version of PosIndex::index2Pos(), for loops that visit
+ *  indices in increasing order. An index is a mixed radix number where the
+ *  least significant digits correspond to the pieces placed last by
+ *  index2Pos(), so for consecutive indices typically only one piece type
+ *  has to be moved, and no divisions are needed. */
+class PosIterator {
+public:
+    /** Constructor. "pos" is the position updated by setIndex(). It must not be
+     *  modified by the caller between calls to setIndex(), except temporarily,
+     *  for example by makeMove() followed by unMakeMove(). */
+    PosIterator(const PosIndex& posIdx, Position& pos);
+
+    /** Update the position to correspond to "idx". Equivalent to
+     *  posIdx.index2Pos(idx, pos), but faster if idx is slightly larger than
+     *  the index used in the previous call. If false is returned, the
+     *  position is not valid and its contents are undefined. */
+    bool setIndex(U64 idx);
+
+private:
+    static const int nSteps = 11; // Kings, then piece types in index2Pos() order
+
+    /** Set digits from "idx" using divisions. Return first changed step. */
+    int decodeIndex(U64 idx);
+    /** Add "delta" to the digits. Return first changed step, or -1 if
+     *  delta is too large for incremental update. */
+    int addToIndex(U64 delta);
+    /** Compute piece masks for steps >= "first" and update the position
+     *  accordingly. Return false if the position is not valid. */
+    bool placePieces(int first);
+
+    const PosIndex& posIdx;
+    Position& pos;
+    bool haveIdx = false;  // True if digits correspond to curIdx
+    U64 curIdx = 0;
+    bool posValid = false; // True if pos corresponds to curIdx and is valid
+
+    int side = 0;                           // 0 for white to move, 1 for black
+    std::array<U32,nSteps> digit{};         // Kings index, then piece type indices
+    std::array<U32,nSteps> radix;           // Number of possible values for each digit
+    std::array<const U64*,nSteps> combInv;  // Combination index to squares for each step
+    std::array<Piece::Type,nSteps> stepPiece;
+    std::array<U64,nSteps> mask{};          // Squares occupied by pieces placed in each step
+    int wKing = -1;
+    int bKing = -1;
+};
+
 
 // Number of legal king constellations for pawn/no pawn symmetry
 const int nKingPawn   = 2*(64-4) + 12*(64-6) + 3*6*(64-9);
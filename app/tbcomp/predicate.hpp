@@ -2,6 +2,7 @@
 #define PREDICATE_HPP_
 
 #include "util/util.hpp"
+#include <vector>
 
 
 class Position;
@@ -9,6 +10,33 @@ namespace DT {
     class EvalContext;
 }
 
+/** Predicate opcodes used in serialized decision trees. Opcodes for
+ *  multi-valued predicates are followed by a limit and mean "value <= limit". */
+enum class PredOp : U8 {
+    WTM,         // No parameters
+    INCHECK,
+    BPAIR_W,
+    BPAIR_B,
+    SAME_B,
+    OPPO_B,
+    DARKSQ,      // pieceNo
+    KPAWNSQ,     // pieceNo
+    ATTACK,      // p1 << 4 | p2
+    SAMEDIAG,    // p1 << 4 | p2
+    FORK,        // p1 << 4 | p2
+    PRACE,       // limit
+    CAPTWDL,     // limit
+    FILE,        // pieceNo, limit
+    RANK,        // pieceNo, limit
+    FILEDELTA,   // p1 << 4 | p2, limit
+    RANKDELTA,   // p1 << 4 | p2, limit
+    FILEDIST,    // p1 << 4 | p2, limit
+    RANKDIST,    // p1 << 4 | p2, limit
+    KINGDIST,    // p1 << 4 | p2, limit
+    TAXIDIST,    // p1 << 4 | p2, limit
+    POSWDL,      // limit
+};
+
 class Predicate {
 public:
     virtual ~Predicate() = default;
@@ -16,6 +44,9 @@ public:
     /** Return true if predicate is true for "pos". */
     virtual bool eval(const Position& pos, DT::EvalContext& ctx) const = 0;
 
+    /** Append opcode and parameters to "out". */
+    virtual void serialize(std::vector<U8>& out) const = 0;
+
     /** For debugging. */
     virtual std::string name() const = 0;
 };
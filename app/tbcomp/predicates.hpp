@@ -14,6 +14,9 @@ public:
     bool eval(const Position& pos, DT::EvalContext& ctx) const override {
         return pos.isWhiteMove();
     }
+    void serialize(std::vector<U8>& out) const override {
+        out.push_back((U8)PredOp::WTM);
+    }
     std::string name() const override {
         return "wtm";
     }
@@ -25,6 +28,9 @@ public:
     bool eval(const Position& pos, DT::EvalContext& ctx) const override {
         return MoveGen::inCheck(pos);
     }
+    void serialize(std::vector<U8>& out) const override {
+        out.push_back((U8)PredOp::INCHECK);
+    }
     std::string name() const override {
         return "incheck";
     }
@@ -39,6 +45,9 @@ public:
         return (b & BitBoard::maskDarkSq) &&
                 (b & BitBoard::maskLightSq);
     }
+    void serialize(std::vector<U8>& out) const override {
+        out.push_back((U8)(white ? PredOp::BPAIR_W : PredOp::BPAIR_B));
+    }
     std::string name() const override {
         return white ? "bPairW" : "bPairB";
     }
@@ -61,6 +70,9 @@ public:
                    ((wb & l) && (bb & d));
         }
     }
+    void serialize(std::vector<U8>& out) const override {
+        out.push_back((U8)(sameColor ? PredOp::SAME_B : PredOp::OPPO_B));
+    }
     std::string name() const override {
         return sameColor ? "sameB" : "oppoB";
     }
@@ -71,9 +83,13 @@ class DarkSquarePredicate : public Predicate {
 public:
     explicit DarkSquarePredicate(int pieceNo) : pieceNo(pieceNo) {}
     bool eval(const Position& pos, DT::EvalContext& ctx) const override {
-        int sq = ctx.getPieceSquare(pieceNo, pos);
+        int sq = ctx.getPieceSquare(pieceNo);
         return BitBoard::maskDarkSq & (1ULL << sq);
     }
+    void serialize(std::vector<U8>& out) const override {
+        out.push_back((U8)PredOp::DARKSQ);
+        out.push_back(pieceNo);
+    }
     std::string name() const override {
         return "darkSq" + num2Str(pieceNo);
     }
@@ -86,10 +102,17 @@ class KingInPawnSquarePredicate : public Predicate {
 public:
     explicit KingInPawnSquarePredicate(int pieceNo) : pieceNo(pieceNo) {}
     bool eval(const Position& pos, DT::EvalContext& ctx) const override {
-        int pSq = ctx.getPieceSquare(pieceNo, pos);
+        return compute(pos, ctx.getPieceType(pieceNo), ctx.getPieceSquare(pieceNo));
+    }
+    void serialize(std::vector<U8>& out) const override {
+        out.push_back((U8)PredOp::KPAWNSQ);
+        out.push_back(pieceNo);
+    }
+    /** Predicate value for a piece of type "pt" on square "pSq". */
+    static bool compute(const Position& pos, Piece::Type pt, int pSq) {
         int x = Square::getX(pSq);
         int y = Square::getY(pSq);
-        switch (ctx.getPieceType(pieceNo)) {
+        switch (pt) {
         case Piece::WPAWN: {
             int kSq = pos.getKingSq(false);
             int pawnDist = std::min(5, 7 - y);
@@ -122,19 +145,26 @@ class AttackPredicate : public Predicate {
 public:
     AttackPredicate(int p1, int p2) : p1(p1), p2(p2) {}
     bool eval(const Position& pos, DT::EvalContext& ctx) const override {
-        int sq1 = ctx.getPieceSquare(p1, pos);
-        U64 sq2Mask = 1ULL << ctx.getPieceSquare(p2, pos);
-        switch (ctx.getPieceType(p1)) {
+        return ctx.getAttacks(p1) & (1ULL << ctx.getPieceSquare(p2));
+    }
+    void serialize(std::vector<U8>& out) const override {
+        out.push_back((U8)PredOp::ATTACK);
+        out.push_back((p1 << 4) | p2);
+    }
+    /** Return true if a piece of type "pt" on sq1 attacks sq2. */
+    static bool compute(Piece::Type pt, int sq1, int sq2, U64 occupied) {
+        U64 sq2Mask = 1ULL << sq2;
+        switch (pt) {
         case Piece::WKING: case Piece::BKING:
             return BitBoard::kingAttacks(sq1) & sq2Mask;
         case Piece::WQUEEN: case Piece::BQUEEN:
-            if (BitBoard::bishopAttacks(sq1, pos.occupiedBB()) & sq2Mask)
+            if (BitBoard::bishopAttacks(sq1, occupied) & sq2Mask)
                 return true;
             // Fall through
         case Piece::WROOK: case Piece::BROOK:
-            return BitBoard::rookAttacks(sq1, pos.occupiedBB()) & sq2Mask;
+            return BitBoard::rookAttacks(sq1, occupied) & sq2Mask;
         case Piece::WBISHOP: case Piece::BBISHOP:
-            return BitBoard::bishopAttacks(sq1, pos.occupiedBB()) & sq2Mask;
+            return BitBoard::bishopAttacks(sq1, occupied) & sq2Mask;
         case Piece::WKNIGHT: case Piece::BKNIGHT:
             return BitBoard::knightAttacks(sq1) & sq2Mask;
         case Piece::WPAWN:
@@ -158,10 +188,14 @@ class SameDiagPredicate : public Predicate {
 public:
     SameDiagPredicate(int p1, int p2) : p1(p1), p2(p2) {}
     bool eval(const Position& pos, DT::EvalContext& ctx) const override {
-        int sq1 = ctx.getPieceSquare(p1, pos);
-        int sq2 = ctx.getPieceSquare(p2, pos);
+        int sq1 = ctx.getPieceSquare(p1);
+        int sq2 = ctx.getPieceSquare(p2);
         return BitBoard::bishopAttacks(sq1, 0) & (1ULL << sq2);
     }
+    void serialize(std::vector<U8>& out) const override {
+        out.push_back((U8)PredOp::SAMEDIAG);
+        out.push_back((p1 << 4) | p2);
+    }
     std::string name() const override {
         return "diag" + num2Str(p1) + num2Str(p2);
     }
@@ -177,8 +211,17 @@ public:
         forker = Piece::isWhite(ctx.getPieceType(p1)) ? Piece::BKNIGHT : Piece::WKNIGHT;
     }
     bool eval(const Position& pos, DT::EvalContext& ctx) const override {
-        int sq1 = ctx.getPieceSquare(p1, pos);
-        int sq2 = ctx.getPieceSquare(p2, pos);
+        U64 atk = ctx.getKnightAttacks(Piece::isWhite(forker));
+        atk &= BitBoard::knightAttacks(ctx.getPieceSquare(p1));
+        atk &= BitBoard::knightAttacks(ctx.getPieceSquare(p2));
+        return atk != 0;
+    }
+    void serialize(std::vector<U8>& out) const override {
+        out.push_back((U8)PredOp::FORK);
+        out.push_back((p1 << 4) | p2);
+    }
+    /** Return true if a knight of type "forker" can fork sq1 and sq2. */
+    static bool compute(const Position& pos, Piece::Type forker, int sq1, int sq2) {
         U64 atk = 0;
         U64 m = pos.pieceTypeBB(forker);
         while (m) {
@@ -200,44 +243,6 @@ private:
 
 // ----------------------------------------------------------------------------
 
-template <typename Pred, typename Stats>
-class StatsCollector {
-public:
-    template <typename... Args>
-    explicit StatsCollector(Args&&... args) : pred(std::forward<Args>(args)...) {}
-
-    void applyData(const Position& pos, DT::EvalContext& ctx, int value) {
-        stats[pred.eval(pos,ctx)].applyData(value);
-    }
-
-    /** Update best if this node has lower cost. */
-    void updateBest(std::unique_ptr<DT::Node>& best, double& bestCost,
-                    const DT::EvalContext& ctx) const {
-        if (Stats::better(best.get(), bestCost, stats[0], stats[1], ctx))
-            best = Stats::makeNode(pred, stats[0], stats[1]);
-    }
-
-    /** Like updateBest but also keeps track of second best predicate. */
-    void updateBest2(std::unique_ptr<DT::Node>& best, double& bestCost,
-                     std::unique_ptr<DT::Node>& secondBest, double& secondBestCost,
-                     const DT::EvalContext& ctx) const {
-        double oldBestCost = bestCost;
-        if (Stats::better(best.get(), bestCost, stats[0], stats[1], ctx)) {
-            secondBest = std::move(best);
-            secondBestCost = oldBestCost;
-            best = Stats::makeNode(pred, stats[0], stats[1]);
-        } else if (Stats::better(secondBest.get(), secondBestCost, stats[0], stats[1], ctx)) {
-            secondBest = Stats::makeNode(pred, stats[0], stats[1]);
-        }
-    }
-
-private:
-    Pred pred;
-    Stats stats[2];
-};
-
-// ----------------------------------------------------------------------------
-
 class MultiPredicate {
 public:
     virtual ~MultiPredicate() = default;
@@ -245,6 +250,9 @@ public:
     /** Return predicate value for "pos". */
     virtual int eval(const Position& pos, DT::EvalContext& ctx) const = 0;
 
+    /** Append opcode and parameters to "out". */
+    virtual void serialize(std::vector<U8>& out) const = 0;
+
     /** For debugging. */
     virtual std::string name() const = 0;
 };
@@ -255,6 +263,14 @@ public:
     constexpr static int maxVal = 5;
 
     int eval(const Position& pos, DT::EvalContext& ctx) const override {
+        return compute(pos);
+    }
+
+    void serialize(std::vector<U8>& out) const override {
+        out.push_back((U8)PredOp::PRACE);
+    }
+
+    static int compute(const Position& pos) {
         U64 wPawnMask = pos.pieceTypeBB(Piece::WPAWN);
         U64 bPawnMask = pos.pieceTypeBB(Piece::BPAWN);
         int wRank = wPawnMask == 0 ? 1 : Square::getY(BitBoard::extractSquare(wPawnMask));
@@ -277,9 +293,13 @@ public:
     constexpr static int maxVal = 7;
     explicit FileRankPredicate(int pieceNo) : pieceNo(pieceNo) {}
     int eval(const Position& pos, DT::EvalContext& ctx) const override {
-        int sq = ctx.getPieceSquare(pieceNo, pos);
+        int sq = ctx.getPieceSquare(pieceNo);
         return file ? Square::getX(sq) : Square::getY(sq);
     }
+    void serialize(std::vector<U8>& out) const override {
+        out.push_back((U8)(file ? PredOp::FILE : PredOp::RANK));
+        out.push_back(pieceNo);
+    }
     std::string name() const override {
         return (file ? "file" : "rank") + num2Str(pieceNo);
     }
@@ -294,14 +314,20 @@ public:
     constexpr static int maxVal = 7;
     FileRankDeltaPredicate(int p1, int p2) : p1(p1), p2(p2) {}
     int eval(const Position& pos, DT::EvalContext& ctx) const override {
-        int sq1 = ctx.getPieceSquare(p1, pos);
-        int sq2 = ctx.getPieceSquare(p2, pos);
+        int sq1 = ctx.getPieceSquare(p1);
+        int sq2 = ctx.getPieceSquare(p2);
         int d = file ? Square::getX(sq2) - Square::getX(sq1)
                      : Square::getY(sq2) - Square::getY(sq1);
         if (absVal)
             d = std::abs(d);
         return d;
     }
+    void serialize(std::vector<U8>& out) const override {
+        PredOp op = file ? (absVal ? PredOp::FILEDIST : PredOp::FILEDELTA)
+                         : (absVal ? PredOp::RANKDIST : PredOp::RANKDELTA);
+        out.push_back((U8)op);
+        out.push_back((p1 << 4) | p2);
+    }
     std::string name() const override {
         return std::string(file ? "file" : "rank") + (absVal ? "Dist" : "Delta") +
                num2Str(p1) + num2Str(p2);
@@ -318,10 +344,13 @@ public:
     constexpr static int maxVal = taxi ? 14 : 7;
     DistancePredicate(int p1, int p2) : p1(p1), p2(p2) {}
     int eval(const Position& pos, DT::EvalContext& ctx) const override {
-        int sq1 = ctx.getPieceSquare(p1, pos);
-        int sq2 = ctx.getPieceSquare(p2, pos);
-        return taxi ? BitBoard::getTaxiDistance(sq1, sq2)
-                    : BitBoard::getKingDistance(sq1, sq2);
+        if (!taxi)
+            return ctx.getKingDistance(p1, p2);
+        return BitBoard::getTaxiDistance(ctx.getPieceSquare(p1), ctx.getPieceSquare(p2));
+    }
+    void serialize(std::vector<U8>& out) const override {
+        out.push_back((U8)(taxi ? PredOp::TAXIDIST : PredOp::KINGDIST));
+        out.push_back((p1 << 4) | p2);
     }
     std::string name() const override {
         return std::string(taxi ? "taxi" : "dist") + num2Str(p1) + num2Str(p2);
@@ -340,6 +369,10 @@ public:
     bool eval(const Position& pos, DT::EvalContext& ctx) const override {
         return pred.eval(pos, ctx) <= limit;
     }
+    void serialize(std::vector<U8>& out) const override {
+        pred.serialize(out);
+        out.push_back((U8)(S8)limit);
+    }
     std::string name() const override {
         return pred.name() + "<=" + num2Str(limit);
     }
@@ -348,62 +381,5 @@ private:
     int limit;
 };
 
-template <typename MultiPred, typename Stats>
-class MultiPredStatsCollector {
-    constexpr static int minVal = MultiPred::minVal;
-    constexpr static int maxVal = MultiPred::maxVal;
-public:
-    template <typename... Args>
-    explicit MultiPredStatsCollector(Args&&... args) : pred(std::forward<Args>(args)...) {}
-
-    void applyData(const Position& pos, DT::EvalContext& ctx, int value) {
-        int idx = pred.eval(pos, ctx) - minVal;
-        stats[idx].applyData(value);
-    }
-
-    void updateBest(std::unique_ptr<DT::Node>& best, double& bestCost,
-                    const DT::EvalContext& ctx) const {
-        const int N = maxVal - minVal + 1;
-        Stats statsTrue, statsFalse;
-        for (int i = 0; i < N; i++)
-            statsFalse.addStats(stats[i]);
-        for (int i = 0; i < N-1; i++) {
-            statsTrue.addStats(stats[i]);
-            statsFalse.subStats(stats[i]);
-            if (Stats::better(best.get(), bestCost, statsFalse, statsTrue, ctx))
-                best = Stats::makeNode(MultiPredBound<MultiPred>(pred, minVal + i),
-                                       statsFalse, statsTrue);
-        }
-    }
-
-    void updateBest2(std::unique_ptr<DT::Node>& best, double& bestCost,
-                     std::unique_ptr<DT::Node>& secondBest, double& secondBestCost,
-                     const DT::EvalContext& ctx) const {
-        const int N = maxVal - minVal + 1;
-        Stats statsTrue, statsFalse;
-        for (int i = 0; i < N; i++)
-            statsFalse.addStats(stats[i]);
-        for (int i = 0; i < N-1; i++) {
-            statsTrue.addStats(stats[i]);
-            statsFalse.subStats(stats[i]);
-
-            double oldBestCost = bestCost;
-            if (Stats::better(best.get(), bestCost, statsFalse, statsTrue, ctx)) {
-                secondBest = std::move(best);
-                secondBestCost = oldBestCost;
-                best = Stats::makeNode(MultiPredBound<MultiPred>(pred, minVal + i),
-                                       statsFalse, statsTrue);
-            } else if (Stats::better(secondBest.get(), secondBestCost, statsFalse, statsTrue, ctx)) {
-                secondBest = Stats::makeNode(MultiPredBound<MultiPred>(pred, minVal + i),
-                                             statsFalse, statsTrue);
-            }
-        }
-    }
-
-private:
-    MultiPred pred;
-    Stats stats[maxVal - minVal + 1];
-};
-
 
 #endif /* PREDICATES_HPP_ */
@@ -2,29 +2,81 @@
 #include "huffman.hpp"
 #include "threadpool.hpp"
 #include "tbutil.hpp"
-#include <boost/multi_index_container.hpp>
-#include <boost/multi_index/ordered_index.hpp>
-#include <boost/multi_index/hashed_index.hpp>
-#include <boost/multi_index/composite_key.hpp>
-#include <boost/multi_index/member.hpp>
-#include <boost/multi_index/mem_fun.hpp>
+#include <set>
 #include <cassert>
 #include <iostream>
 
 RePairComp::RePairComp(std::vector<U8>& inData, int minFreq, int maxSyms)
-    : RePairComp(inData, minFreq, maxSyms, -1) {
+    : RePairComp(inData.data(), inData.size(), minFreq, maxSyms, -1, 0) {
 }
 
-RePairComp::RePairComp(std::vector<U8>& inData, int minFreq, int maxSyms, int chunkSize)
-    : sa(inData, chunkSize) {
+RePairComp::RePairComp(std::vector<U8>& inData, int minFreq, int maxSyms, int nThreads)
+    : RePairComp(inData.data(), inData.size(), minFreq, maxSyms, -1, nThreads) {
+}
+
+RePairComp::RePairComp(U8* inData, U64 size, int minFreq, int maxSyms, int nThreads)
+    : RePairComp(inData, size, minFreq, maxSyms, -1, nThreads) {
+}
+
+RePairComp::RePairComp(U8* inData, U64 size, int minFreq, int maxSyms, int chunkSize,
+                       int nThreads)
+    : sa(inData, size, chunkSize), nThreads(nThreads) {
     std::cout << "nChunks:" << sa.getChunks().size()
               << " chunkSize:" << (sa.getChunks()[0].end - sa.getChunks()[0].beg) << std::endl;
-    nThreads = std::thread::hardware_concurrency();
+    if (this->nThreads <= 0)
+        this->nThreads = std::thread::hardware_concurrency();
     compress((U64)minFreq, maxSyms);
 }
 
 void
-RePairComp::toBitBuf(BitBufferWriter& out) {
+RePairComp::compressSegments(U64 size, U64 segmentSize, int minFreq, int maxSyms,
+                             U64 blockSize, int nThreads,
+                             const std::function<void(U64,U64,std::vector<U8>&)>& getData,
+                             const std::function<void(const std::vector<U8>&)>& writeSegment) {
+    if (nThreads <= 0)
+        nThreads = std::thread::hardware_concurrency();
+    const U64 nSegments = (size + segmentSize - 1) / segmentSize;
+    std::vector<std::vector<U8>> segBufs(nSegments);
+
+    // Use remaining threads inside each segment if there are few segments
+    const int nWorkers = (int)std::min((U64)nThreads, std::max(nSegments, (U64)1));
+    const int segThreads = std::max(1, nThreads / nWorkers);
+
+    ThreadPool<U64> pool(nWorkers);
+    for (U64 seg = 0; seg < nSegments; seg++) {
+        auto task = [&,seg](int workerNo) {
+            U64 beg = seg * segmentSize;
+            U64 end = std::min(beg + segmentSize, size);
+            std::vector<U8> data;
+            getData(beg, end, data);
+            BitBufferWriter bw;
+            {
+                RePairComp comp(data, minFreq, maxSyms, segThreads);
+                comp.toBitBuf(bw, blockSize);
+            }
+            segBufs[seg] = bw.getBuf();
+            return seg;
+        };
+        pool.addTask(task);
+    }
+
+    // Write finished segments as soon as all earlier segments have been written
+    std::vector<bool> done(nSegments);
+    U64 nextSeg = 0;
+    U64 seg;
+    while (pool.getResult(seg)) {
+        std::cout << "Compressed segment:" << seg << " of " << nSegments << std::endl;
+        done[seg] = true;
+        while (nextSeg < nSegments && done[nextSeg]) {
+            writeSegment(segBufs[nextSeg]);
+            segBufs[nextSeg] = std::vector<U8>();
+            nextSeg++;
+        }
+    }
+}
+
+void
+RePairComp::toBitBuf(BitBufferWriter& out, U64 blockSize) {
     const int symTableSize = symbols.size();
 
     // Write symbol table
@@ -53,20 +105,64 @@ RePairComp::toBitBuf(BitBufferWriter& out) {
     huff.computePrefixCode(freq, code);
     code.toBitBuf(out, true);
     out.writeU64(nSyms);
+
+    // Compute block index. Offsets are relative to the start of the encoded symbols.
+    std::vector<std::pair<U64,U64>> blockIndex; // (bit offset, skip)
+    U64 dataLen = 0;
+    U64 nSymBits = 0;
     it = sa.iterAtChunk(0);
     while (true) {
         int sym = it.getSymbol();
-        assert(sym != -1);
-        code.encodeSymbol(sym, out);
+        U64 symLen = symbols[sym].getLength();
+        if (blockSize > 0) {
+            while (blockIndex.size() * blockSize < dataLen + symLen) {
+                U64 skip = blockIndex.size() * blockSize - dataLen;
+                blockIndex.emplace_back(nSymBits, skip);
+            }
+        }
+        nSymBits += code.codeLength(sym);
+        dataLen += symLen;
+        if (!it.moveToNext())
+            break;
+    }
+
+    // Write block index
+    out.writeU64(blockSize);
+    if (blockSize > 0) {
+        auto nBits = [](U64 val) -> int {
+            int n = 0;
+            while (val > 0) {
+                val >>= 1;
+                n++;
+            }
+            return n;
+        };
+        U64 maxOffs = 0, maxSkip = 0;
+        for (const auto& e : blockIndex) {
+            maxOffs = std::max(maxOffs, e.first);
+            maxSkip = std::max(maxSkip, e.second);
+        }
+        const int offsBits = nBits(maxOffs);
+        const int skipBits = nBits(maxSkip);
+        out.writeU64(dataLen);
+        out.writeBits(offsBits, 6);
+        out.writeBits(skipBits, 6);
+        for (const auto& e : blockIndex) {
+            out.writeBits(e.first, offsBits);
+            out.writeBits(e.second, skipBits);
+        }
+    }
+
+    // Write encoded symbols
+    it = sa.iterAtChunk(0);
+    while (true) {
+        code.encodeSymbol(it.getSymbol(), out);
         if (!it.moveToNext())
             break;
     }
 }
 
 namespace RePairImpl {
-    using namespace boost;
-    using namespace boost::multi_index;
-
     struct PairCand {
         U16 p1;
         U16 p2;
@@ -74,49 +170,238 @@ namespace RePairImpl {
         U64 freq;
         std::vector<U64> indices;
         U64 freqPrio() const { return (freq << 8) + 255 - depth; }
-        U64 cachePrio() const { return (indices.empty() ? (1ULL<<63) : 0) + freq; }
+
+        U64 seqNo = 0;             // Insertion order, used to break priority ties
+        PairCand* prev = nullptr;  // Links in a FreqQueue bucket
+        PairCand* next = nullptr;
+    };
+
+    static U32 pairKey(U16 p1, U16 p2) { return ((U32)p1 << 16) | p2; }
+
+    /** Priority queue of pair candidates, ordered by decreasing freqPrio().
+     *  Candidates with equal priority are ordered by insertion order.
+     *  Low priorities, which is where most candidates are, are stored in
+     *  one linked list per priority value, so insert and remove are O(1).
+     *  The few high priority candidates are stored in an ordered set. */
+    class FreqQueue {
+    public:
+        FreqQueue() : buckets(nLowPrio) {}
+
+        void insert(PairCand* pc);
+        void remove(PairCand* pc);
+        size_t size() const { return nLow + high.size(); }
+        bool empty() const { return size() == 0; }
+
+        /** Return candidate with highest priority. Queue must not be empty. */
+        PairCand* top();
+        /** Return candidate with lowest priority. Queue must not be empty. */
+        PairCand* bottom();
+
+        /** Call func(pc) for candidates in priority order, until func returns false. */
+        template <typename Func> void forEach(Func func) const;
+
+    private:
+        static const U64 nLowPrio = 1024 << 8; // Priorities for freq < 1024
+        struct Bucket {
+            PairCand* first = nullptr;
+            PairCand* last = nullptr;
+        };
+        std::vector<Bucket> buckets;
+        size_t nLow = 0;
+        U64 maxLow = 0; // No non-empty bucket above maxLow
+        U64 minLow = nLowPrio; // No non-empty bucket below minLow
+
+        struct HighCmp {
+            bool operator()(const PairCand* a, const PairCand* b) const {
+                if (a->freqPrio() != b->freqPrio())
+                    return a->freqPrio() > b->freqPrio();
+                return a->seqNo < b->seqNo;
+            }
+        };
+        std::set<PairCand*, HighCmp> high;
+        U64 nextSeqNo = 0;
     };
-    struct Pair {};
-    struct Freq {};
-    struct Cache {};
-
-    using PairCandSet = multi_index_container<
-        PairCand, indexed_by<
-            hashed_unique< tag<Pair>,
-                composite_key<
-                    PairCand,
-                    member<PairCand,U16,&PairCand::p1>,
-                    member<PairCand,U16,&PairCand::p2>
-                >
-            >,
-            ordered_non_unique< tag<Freq>,
-                const_mem_fun<PairCand,U64,&PairCand::freqPrio>,
-                std::greater<U64>
-            >,
-            ordered_non_unique< tag<Cache>,
-                const_mem_fun<PairCand,U64,&PairCand::cachePrio>,
-                std::greater<U64>
-            >
-        >
-    >;
+
+    void
+    FreqQueue::insert(PairCand* pc) {
+        pc->seqNo = nextSeqNo++;
+        const U64 prio = pc->freqPrio();
+        if (prio >= nLowPrio) {
+            high.insert(pc);
+            return;
+        }
+        Bucket& b = buckets[prio];
+        pc->prev = b.last;
+        pc->next = nullptr;
+        if (b.last)
+            b.last->next = pc;
+        else
+            b.first = pc;
+        b.last = pc;
+        nLow++;
+        maxLow = std::max(maxLow, prio);
+        minLow = std::min(minLow, prio);
+    }
+
+    void
+    FreqQueue::remove(PairCand* pc) {
+        const U64 prio = pc->freqPrio();
+        if (prio >= nLowPrio) {
+            high.erase(pc);
+            return;
+        }
+        Bucket& b = buckets[prio];
+        (pc->prev ? pc->prev->next : b.first) = pc->next;
+        (pc->next ? pc->next->prev : b.last) = pc->prev;
+        pc->prev = pc->next = nullptr;
+        nLow--;
+    }
+
+    PairCand*
+    FreqQueue::top() {
+        if (!high.empty())
+            return *high.begin();
+        assert(nLow > 0);
+        while (!buckets[maxLow].first)
+            maxLow--;
+        return buckets[maxLow].first;
+    }
+
+    PairCand*
+    FreqQueue::bottom() {
+        if (nLow == 0)
+            return *high.rbegin();
+        while (!buckets[minLow].first)
+            minLow++;
+        return buckets[minLow].last;
+    }
+
+    template <typename Func>
+    void
+    FreqQueue::forEach(Func func) const {
+        for (PairCand* pc : high)
+            if (!func(pc))
+                return;
+        if (nLow == 0)
+            return;
+        for (U64 prio = maxLow + 1; prio-- > minLow; )
+            for (PairCand* pc = buckets[prio].first; pc; pc = pc->next)
+                if (!func(pc))
+                    return;
+    }
 
     struct CompressData {
         explicit CompressData(U64 minF) : minFreq(minF) {}
-        PairCandSet pairCands;
+
+        /** Return candidate for pair (p1,p2), or nullptr if there is no such candidate. */
+        PairCand* find(U16 p1, U16 p2);
+        /** Add a new candidate. */
+        void insert(PairCand&& pc);
+        /** Remove a candidate. */
+        void erase(PairCand* pc);
+        /** Add "delta" to the frequency of a candidate. */
+        void addFreq(PairCand* pc, S64 delta);
+        /** Set the cached indices of a candidate. */
+        void setIndices(PairCand* pc, std::vector<U64>&& indices);
+
+        std::unordered_map<U32,PairCand> pairCands;
+        FreqQueue freqQueue;
+        std::set<std::pair<U64,U32>> cached; // (freq, pairKey) for candidates with indices
         const U64 minFreq;
         S64 cacheSize = 0; // Sum of indices.size() for all PairCands
     };
 
+    PairCand*
+    CompressData::find(U16 p1, U16 p2) {
+        auto it = pairCands.find(pairKey(p1, p2));
+        return it == pairCands.end() ? nullptr : &it->second;
+    }
+
+    void
+    CompressData::insert(PairCand&& pc) {
+        const U32 key = pairKey(pc.p1, pc.p2);
+        std::vector<U64> indices = std::move(pc.indices);
+        pc.indices.clear();
+        auto res = pairCands.emplace(key, std::move(pc));
+        assert(res.second);
+        PairCand* p = &res.first->second;
+        freqQueue.insert(p);
+        setIndices(p, std::move(indices));
+    }
+
+    void
+    CompressData::erase(PairCand* pc) {
+        setIndices(pc, std::vector<U64>());
+        freqQueue.remove(pc);
+        pairCands.erase(pairKey(pc->p1, pc->p2));
+    }
+
+    void
+    CompressData::addFreq(PairCand* pc, S64 delta) {
+        const U32 key = pairKey(pc->p1, pc->p2);
+        const bool isCached = !pc->indices.empty();
+        if (isCached)
+            cached.erase(std::make_pair(pc->freq, key));
+        freqQueue.remove(pc);
+        pc->freq += delta;
+        freqQueue.insert(pc);
+        if (isCached)
+            cached.insert(std::make_pair(pc->freq, key));
+    }
+
+    void
+    CompressData::setIndices(PairCand* pc, std::vector<U64>&& indices) {
+        const U32 key = pairKey(pc->p1, pc->p2);
+        if (!pc->indices.empty())
+            cached.erase(std::make_pair(pc->freq, key));
+        cacheSize += (S64)indices.size() - (S64)pc->indices.size();
+        pc->indices = std::move(indices);
+        if (!pc->indices.empty())
+            cached.insert(std::make_pair(pc->freq, key));
+        else
+            pc->indices.shrink_to_fit();
+    }
+
+    /** Frequency changes when transforming AXYB -> AZB, indexed by symbol A
+     *  or B. The touched symbols are recorded, so only non-zero entries
+     *  need to be visited when the changes are applied or merged. */
     struct DeltaFreq {
-        std::vector<S64> deltaFreqAZ, deltaFreqZB;
-        std::vector<S64> deltaFreqAX, deltaFreqYB;
-        std::vector<std::vector<U64>> vecAZ, vecZB;
+        struct Delta {
+            S64 freqAZ = 0, freqZB = 0;
+            S64 freqAX = 0, freqYB = 0;
+        };
+        std::vector<Delta> deltas;
+        std::vector<U8> isTouched;
+        std::vector<int> touched;
+        std::vector<std::vector<U64>> vecAZ, vecZB; // Only used with index cache
 
         void resize(int nSym) {
-            deltaFreqAZ.resize(nSym); vecAZ.resize(nSym);
-            deltaFreqZB.resize(nSym); vecZB.resize(nSym);
-            deltaFreqAX.resize(nSym);
-            deltaFreqYB.resize(nSym);
+            deltas.resize(nSym);
+            isTouched.resize(nSym);
+        }
+        Delta& get(int sym) {
+            if (!isTouched[sym]) {
+                isTouched[sym] = 1;
+                touched.push_back(sym);
+            }
+            return deltas[sym];
+        }
+        /** Add all changes in "other" to this object, and clear "other". */
+        void merge(DeltaFreq& other) {
+            for (int sym : other.touched) {
+                Delta& d = get(sym);
+                Delta& o = other.deltas[sym];
+                d.freqAZ += o.freqAZ; d.freqZB += o.freqZB;
+                d.freqAX += o.freqAX; d.freqYB += o.freqYB;
+            }
+            other.clear();
+        }
+        void clear() {
+            for (int sym : touched) {
+                deltas[sym] = Delta();
+                isTouched[sym] = 0;
+            }
+            touched.clear();
         }
     };
 }
@@ -125,27 +410,30 @@ void
 RePairComp::compress(U64 minFreq, int maxSyms) {
     using namespace RePairImpl;
     CompressData cpData(minFreq);
-    PairCandSet& pairCands = cpData.pairCands;
+    FreqQueue& freqQueue = cpData.freqQueue;
     S64& cacheSize = cpData.cacheSize;
 
     const U64 maxCache = std::max(U64(64*1024*1024), sa.size() / 512);
 
-    // Delta frequencies when transforming AXYB -> AZB
+    // Delta frequencies when transforming AXYB -> AZB. Each worker thread
+    // accumulates its changes separately and they are merged when all chunks
+    // have been processed.
     DeltaFreq delta;
+    std::vector<DeltaFreq> workerDelta(nThreads);
 
     U64 comprSize = sa.size();
     initSymbols(cpData);
 
-    while (!pairCands.empty()) {
+    while (!freqQueue.empty()) {
         if ((int)symbols.size() >= maxSyms)
             break;
-        auto it = pairCands.get<Freq>().begin();
+        PairCand* pc = freqQueue.top();
         assert(cacheSize >= 0);
-        if (it->indices.empty() && it->freq * 8 <= maxCache && it->freq * 8 <= comprSize)
+        if (pc->indices.empty() && pc->freq * 8 <= maxCache && pc->freq * 8 <= comprSize)
             refillCache(cpData, maxCache);
 
-        const U16 X = it->p1;
-        const U16 Y = it->p2;
+        const U16 X = pc->p1;
+        const U16 Y = pc->p2;
         const U16 Z = (U16)symbols.size();
         RePairSymbol newSym;
         newSym.setPair(X, Y);
@@ -156,32 +444,38 @@ RePairComp::compress(U64 minFreq, int maxSyms) {
 
         std::cout << "XY->Z: " << X << ' ' << Y << ' ' << Z
                   << " len:" << newSym.getLength() << " depth:" << newSym.getDepth()
-                  << " freq:" << it->freq << std::endl;
+                  << " freq:" << pc->freq << std::endl;
 
         delta.resize(nSym);
+        delta.vecAZ.resize(nSym);
+        delta.vecZB.resize(nSym);
+
+        U64 nRepl = pc->indices.empty() ? replacePairs(X, Y, Z, delta, workerDelta) :
+                                          replacePairsIdxCache(pc->indices, X, Y, Z, delta);
+        if (delta.isTouched[Z]) {
+            DeltaFreq::Delta& dz = delta.deltas[Z];
+            dz.freqAZ += dz.freqZB;
+            dz.freqZB = 0;
+        }
 
-        U64 nRepl = it->indices.empty() ? replacePairs(X, Y, Z, delta) :
-                                          replacePairsIdxCache(it->indices, X, Y, Z, delta);
-        delta.deltaFreqAZ[Z] += delta.deltaFreqZB[Z];
-        delta.deltaFreqZB[Z] = 0;
+        // Process symbols in increasing order, so the result does not depend
+        // on thread scheduling
+        std::sort(delta.touched.begin(), delta.touched.end());
 
         int nAdded = 0, nRemoved = 0;
-        cacheSize -= it->indices.size();
-        pairCands.get<Freq>().erase(it);
-        for (int i = 0; i < nSym; i++) {
+        cpData.erase(pc);
+        for (int i : delta.touched) {
             for (int k = 0; k < 2; k++) {
                 U16 p1 = (k == 0) ? i : Z;
                 U16 p2 = (k == 0) ? Z : i;
-                U64 f  = (k == 0) ? delta.deltaFreqAZ[i] : delta.deltaFreqZB[i];
+                S64& f = (k == 0) ? delta.deltas[i].freqAZ : delta.deltas[i].freqZB;
                 if (f != 0) {
-                    ((k == 0) ? delta.deltaFreqAZ[i] : delta.deltaFreqZB[i]) = 0;
                     std::vector<U64>& vec = (k == 0) ? delta.vecAZ[i] : delta.vecZB[i];
-                    if (f >= minFreq) {
+                    if ((U64)f >= minFreq) {
                         int d = std::max(symbols[i].getDepth(), symbols[Z].getDepth()) + 1;
-                        PairCand pc { (U16)p1, (U16)p2, d, f };
-                        cacheSize += vec.size();
-                        pc.indices = std::move(vec);
-                        pairCands.insert(std::move(pc));
+                        PairCand newCand { (U16)p1, (U16)p2, d, (U64)f };
+                        newCand.indices = std::move(vec);
+                        cpData.insert(std::move(newCand));
                         nAdded++;
                     }
                     vec.clear();
@@ -189,37 +483,36 @@ RePairComp::compress(U64 minFreq, int maxSyms) {
             }
         }
         pruneCache(cpData, maxCache, comprSize);
-        for (int i = 0; i < nSym; i++) {
+        for (int i : delta.touched) {
             for (int k = 0; k < 2; k++) {
                 U16 p1 = (k == 0) ? i : Y;
                 U16 p2 = (k == 0) ? X : i;
-                S64 d  = (k == 0) ? delta.deltaFreqAX[i] : delta.deltaFreqYB[i];
+                S64 d  = (k == 0) ? delta.deltas[i].freqAX : delta.deltas[i].freqYB;
                 if (d != 0) {
-                    ((k == 0) ? delta.deltaFreqAX[i] : delta.deltaFreqYB[i]) = 0;
-                    auto it2 = pairCands.get<Pair>().find(std::make_tuple(p1,p2));
-                    if (it2 != pairCands.get<Pair>().end()) {
-                        pairCands.get<Pair>().modify(it2, [d](PairCand& pc) { pc.freq += d; });
-                        if (it2->freq < minFreq) {
-                            cacheSize -= it2->indices.size();
-                            pairCands.get<Pair>().erase(it2);
+                    PairCand* pc2 = cpData.find(p1, p2);
+                    if (pc2) {
+                        if ((S64)pc2->freq + d < (S64)minFreq) {
+                            cpData.erase(pc2);
                             nRemoved++;
+                        } else {
+                            cpData.addFreq(pc2, d);
                         }
                     }
                 }
             }
         }
+        delta.clear();
         comprSize -= nRepl;
         std::cout << "repl:" << nRepl << " add:" << nAdded << " remove:" << nRemoved
-                  << " cand:" << pairCands.size() << " cache:" << cacheSize
+                  << " cand:" << freqQueue.size() << " cache:" << cacheSize
                   << " compr:" << comprSize << std::endl;
 
         size_t maxCands = std::max(128*1024, 8*(maxSyms-(int)symbols.size())); // Heuristic limit
         int pruneFreq = -1;
-        while (pairCands.size() > maxCands) {
-            auto it2 = --pairCands.get<Freq>().end();
-            cacheSize -= it2->indices.size();
-            pruneFreq = (int)it2->freq;
-            pairCands.get<Freq>().erase(it2);
+        while (freqQueue.size() > maxCands) {
+            PairCand* pc2 = freqQueue.bottom();
+            pruneFreq = (int)pc2->freq;
+            cpData.erase(pc2);
         }
         if (pruneFreq != -1)
             std::cout << "candidate prune, freq:" << pruneFreq << std::endl;
@@ -229,8 +522,6 @@ RePairComp::compress(U64 minFreq, int maxSyms) {
 void
 RePairComp::initSymbols(RePairImpl::CompressData& cpData) {
     using namespace RePairImpl;
-    PairCandSet& pairCands = cpData.pairCands;
-
     const U64 minFreq = cpData.minFreq;
     const int nChunks = sa.getChunks().size();
 
@@ -319,7 +610,7 @@ RePairComp::initSymbols(RePairImpl::CompressData& cpData) {
         for (int j = 0; j < 256; j++) {
             U64 f = initialFreq.freq[i*256+j];
             if (f >= minFreq)
-                pairCands.insert(PairCand{(U16)i,(U16)j,2,f});
+                cpData.insert(PairCand{(U16)i,(U16)j,2,f});
         }
     }
 }
@@ -327,24 +618,23 @@ RePairComp::initSymbols(RePairImpl::CompressData& cpData) {
 void
 RePairComp::refillCache(RePairImpl::CompressData& cpData, U64 maxCache) {
     using namespace RePairImpl;
-    PairCandSet& pairCands = cpData.pairCands;
-    S64& cacheSize = cpData.cacheSize;
+    const S64& cacheSize = cpData.cacheSize;
 
     // Decide what to cache
     std::unordered_map<U32, std::vector<U64>> cache;
     S64 newCacheSize = 0;
     U64 minCacheFreq = maxCache;
-    for (const auto& ce : pairCands.get<Cache>()) {
-        if (!ce.indices.empty())
-            break;
-        pruneCache(cpData, maxCache - newCacheSize - ce.freq, ce.freq);
-        if (cacheSize + newCacheSize + ce.freq > maxCache)
-            break;
-        U32 xy = (ce.p1 << 16) | ce.p2;
-        cache.insert(std::make_pair(xy, std::vector<U64>()));
-        newCacheSize += ce.freq;
-        minCacheFreq = std::min(minCacheFreq, ce.freq);
-    }
+    cpData.freqQueue.forEach([&](const PairCand* pc) {
+        if (!pc->indices.empty())
+            return true;
+        pruneCache(cpData, maxCache - newCacheSize - pc->freq, pc->freq);
+        if (cacheSize + newCacheSize + (S64)pc->freq > (S64)maxCache)
+            return false;
+        cache.insert(std::make_pair(pairKey(pc->p1, pc->p2), std::vector<U64>()));
+        newCacheSize += pc->freq;
+        minCacheFreq = std::min(minCacheFreq, pc->freq);
+        return true;
+    });
     std::cout << "refill cache: nElem:" << cache.size() << " minFreq:" << minCacheFreq << std::endl;
 
     // Process all chunks
@@ -405,10 +695,7 @@ RePairComp::refillCache(RePairImpl::CompressData& cpData, U64 maxCache) {
         U32 xy = e.first;
         U16 x = (U16)(xy >> 16);
         U16 y = (U16)(xy & 0xffff);
-        std::vector<U64>& vec = e.second;
-        auto it2 = pairCands.get<Pair>().find(std::make_tuple(x,y));
-        cacheSize += vec.size();
-        pairCands.get<Pair>().modify(it2, [&vec](PairCand& pc) { pc.indices = std::move(vec); });
+        cpData.setIndices(cpData.find(x, y), std::move(e.second));
     }
     std::cout << "refill cache: nElem:" << cache.size() << " cacheSize:" << cacheSize << std::endl;
 }
@@ -416,47 +703,32 @@ RePairComp::refillCache(RePairImpl::CompressData& cpData, U64 maxCache) {
 void
 RePairComp::pruneCache(RePairImpl::CompressData& cpData, S64 maxSize, U64 maxFreq) const {
     using namespace RePairImpl;
-    PairCandSet& pairCands = cpData.pairCands;
-    S64& cacheSize = cpData.cacheSize;
-
-    while (cacheSize > maxSize) {
-        auto it2 = --pairCands.get<Cache>().end();
-        if (it2->indices.empty() || it2->freq >= maxFreq)
+    while (cpData.cacheSize > maxSize && !cpData.cached.empty()) {
+        auto it = cpData.cached.begin(); // Lowest frequency
+        if (it->first >= maxFreq)
             break;
-        cacheSize -= it2->indices.size();
-        pairCands.get<Cache>().modify(it2, [](PairCand& pc){ pc.indices.clear();
-                                                             pc.indices.shrink_to_fit(); });
+        U32 xy = it->second;
+        cpData.setIndices(cpData.find(xy >> 16, xy & 0xffff), std::vector<U64>());
     }
 }
 
 U64
-RePairComp::replacePairs(int X, int Y, int Z, RePairImpl::DeltaFreq& delta) {
-    std::vector<S64>& deltaFreqAZ = delta.deltaFreqAZ;
-    std::vector<S64>& deltaFreqZB = delta.deltaFreqZB;
-    std::vector<S64>& deltaFreqAX = delta.deltaFreqAX;
-    std::vector<S64>& deltaFreqYB = delta.deltaFreqYB;
-    const int nSym = deltaFreqAZ.size();
+RePairComp::replacePairs(int X, int Y, int Z, RePairImpl::DeltaFreq& delta,
+                         std::vector<RePairImpl::DeltaFreq>& workerDelta) {
+    using namespace RePairImpl;
+    const int nSym = delta.deltas.size();
+    for (DeltaFreq& wd : workerDelta)
+        wd.resize(nSym);
 
     std::vector<bool> skipFirst = computeSkipFirst(X, Y);
 
-    struct Result {
-        Result(int nSym)
-            : nRepl(0), deltaFreqAZ(nSym), deltaFreqZB(nSym),
-              deltaFreqAX(nSym), deltaFreqYB(nSym) {
-        }
-        U64 nRepl;
-        std::vector<S64> deltaFreqAZ;
-        std::vector<S64> deltaFreqZB;
-        std::vector<S64> deltaFreqAX;
-        std::vector<S64> deltaFreqYB;
-    };
-
     std::mutex mutex;
-    ThreadPool<Result> pool(nThreads);
+    ThreadPool<U64> pool(nThreads);
     const int nChunks = sa.getChunks().size();
     for (int ch = 0; ch < nChunks; ch++) {
-        auto task = [this,X,Y,Z,nSym,nChunks,&skipFirst,&mutex,ch](int workerNo) {
-            Result res(nSym);
+        auto task = [this,X,Y,Z,nChunks,&skipFirst,&workerDelta,&mutex,ch](int workerNo) {
+            DeltaFreq& wd = workerDelta[workerNo];
+            U64 nRepl = 0;
 
             SymbolArray::iterator inIt = sa.iterAtChunk(ch);
             SymbolArray::iterator outIt(inIt);
@@ -464,7 +736,7 @@ RePairComp::replacePairs(int X, int Y, int Z, RePairImpl::DeltaFreq& delta) {
             U64 end = sa.getChunks()[ch].endUsed;
 
             if (beg >= end)
-                return res;
+                return nRepl;
 
             mutex.lock();
             bool locked = true;
@@ -473,7 +745,7 @@ RePairComp::replacePairs(int X, int Y, int Z, RePairImpl::DeltaFreq& delta) {
                 inIt.moveToNext();
                 if (inIt.getIndex() >= end) {
                     mutex.unlock();
-                    return res;
+                    return nRepl;
                 }
                 U64 idx = outIt.getIndex();
                 if (idx > 0 && sa.getUsedIdx(idx-1))
@@ -524,12 +796,14 @@ RePairComp::replacePairs(int X, int Y, int Z, RePairImpl::DeltaFreq& delta) {
                 }
                 if (x == X && y == Y) { // Transform AXYB -> AZB
                     if (a != -1) {
-                        res.deltaFreqAZ[a]++;
-                        res.deltaFreqAX[a]--;
+                        DeltaFreq::Delta& d = wd.get(a);
+                        d.freqAZ++;
+                        d.freqAX--;
                     }
                     if (b != -1) {
-                        res.deltaFreqZB[b]++;
-                        res.deltaFreqYB[b]--;
+                        DeltaFreq::Delta& d = wd.get(b);
+                        d.freqZB++;
+                        d.freqYB--;
                     }
                     sa.setUsedIdx(idxY, false);
                     outIt.putSymbol(Z);
@@ -538,7 +812,7 @@ RePairComp::replacePairs(int X, int Y, int Z, RePairImpl::DeltaFreq& delta) {
                     x = b; idxX = idxB;
                     y = inIt.getSymbol(); idxY = inIt.getIndex(); inIt.moveToNext();
                     b = inIt.getSymbol(); idxB = inIt.getIndex(); inIt.moveToNext();
-                    res.nRepl++;
+                    nRepl++;
                 } else {
                     outIt.putSymbol(x);
                     a = x;
@@ -556,21 +830,16 @@ RePairComp::replacePairs(int X, int Y, int Z, RePairImpl::DeltaFreq& delta) {
             if (locked)
                 mutex.unlock();
 
-            return res;
+            return nRepl;
         };
         pool.addTask(task);
     }
     U64 nRepl = 0;
-    Result res(0);
-    while (pool.getResult(res)) {
-        nRepl += res.nRepl;
-        for (int i = 0; i < nSym; i++) {
-            deltaFreqAZ[i] += res.deltaFreqAZ[i];
-            deltaFreqZB[i] += res.deltaFreqZB[i];
-            deltaFreqAX[i] += res.deltaFreqAX[i];
-            deltaFreqYB[i] += res.deltaFreqYB[i];
-        }
-    }
+    U64 res;
+    while (pool.getResult(res))
+        nRepl += res;
+    for (DeltaFreq& wd : workerDelta)
+        delta.merge(wd);
 
     return nRepl;
 }
@@ -632,10 +901,7 @@ RePairComp::computeSkipFirst(int X, int Y) {
 U64
 RePairComp::replacePairsIdxCache(const std::vector<U64>& indices, int X, int Y, int Z,
                                  RePairImpl::DeltaFreq& delta) {
-    std::vector<S64>& deltaFreqAZ = delta.deltaFreqAZ;
-    std::vector<S64>& deltaFreqZB = delta.deltaFreqZB;
-    std::vector<S64>& deltaFreqAX = delta.deltaFreqAX;
-    std::vector<S64>& deltaFreqYB = delta.deltaFreqYB;
+    using namespace RePairImpl;
     std::vector<std::vector<U64>>& vecAZ = delta.vecAZ;
     std::vector<std::vector<U64>>& vecZB = delta.vecZB;
 
@@ -648,12 +914,14 @@ RePairComp::replacePairsIdxCache(const std::vector<U64>& indices, int X, int Y,
         int b = it.getSymbol();
         int a = itA.moveToPrev() ? itA.getSymbol() : -1;
         if (a != -1) {
-            deltaFreqAZ[a]++; vecAZ[a].push_back(itA.getIndex());
-            deltaFreqAX[a]--;
+            DeltaFreq::Delta& d = delta.get(a);
+            d.freqAZ++; vecAZ[a].push_back(itA.getIndex());
+            d.freqAX--;
         }
         if (b != -1) {
-            deltaFreqZB[b]++; vecZB[b].push_back(idxX);
-            deltaFreqYB[b]--;
+            DeltaFreq::Delta& d = delta.get(b);
+            d.freqZB++; vecZB[b].push_back(idxX);
+            d.freqYB--;
         }
         sa.combineSymbol(idxX, idxY, Z);
         nRepl++;
@@ -661,11 +929,11 @@ RePairComp::replacePairsIdxCache(const std::vector<U64>& indices, int X, int Y,
     return nRepl;
 }
 
-void
-RePairDeComp::deCompressAll(std::function<void(const std::vector<U8>&)> consumer) {
+RePairDeComp::RePairDeComp(const U8* inData)
+    : data(inData) {
     BitBufferReader br(data);
     const int symTableSize = br.readBits(16);
-    std::vector<RePairSymbol> symbols(symTableSize);
+    symbols.resize(symTableSize);
     for (int i = 0; i < symTableSize; i++) {
         U16 left = br.readBits(16);
         U16 right = br.readBits(16);
@@ -681,13 +949,30 @@ RePairDeComp::deCompressAll(std::function<void(const std::vector<U8>&)> consumer
         symbols[i].setLengthDepth(len, d);
     }
 
+    code.fromBitBuf(br);
+    nSyms = br.readU64();
+
+    blockSize = br.readU64();
+    dataLen = 0;
+    offsBits = skipBits = 0;
+    U64 nBlocks = 0;
+    if (blockSize > 0) {
+        dataLen = br.readU64();
+        nBlocks = (dataLen + blockSize - 1) / blockSize;
+        offsBits = br.readBits(6);
+        skipBits = br.readBits(6);
+    }
+    indexPos = br.getBitPos();
+    symPos = indexPos + nBlocks * (offsBits + skipBits);
+}
+
+void
+RePairDeComp::deCompressAll(std::function<void(const std::vector<U8>&)> consumer) {
+    BitBufferReader br(data, symPos);
     const int bufSize = 1024*1024;
     std::vector<U8> outData;
     outData.reserve(bufSize);
 
-    HuffCode code;
-    code.fromBitBuf(br);
-    const U64 nSyms = br.readU64();
     std::vector<int> stack;
     for (U64 i = 0; i < nSyms; i++) {
         int sym = code.decodeSymbol(br);
@@ -712,6 +997,69 @@ RePairDeComp::deCompressAll(std::function<void(const std::vector<U8>&)> consumer
     consumer(outData);
 }
 
+U64
+RePairDeComp::deCompressBlock(U64 idx, std::vector<U8>& out) const {
+    U64 bitPos;
+    const U64 first = findBlock(idx, bitPos);
+    const U64 end = std::min((idx / blockSize + 1) * blockSize, dataLen) - first;
+
+    out.clear();
+    BitBufferReader br(data, bitPos);
+    while (out.size() < end)
+        expandSymbol(code.decodeSymbol(br), out);
+    return first;
+}
+
+int
+RePairDeComp::operator[](U64 idx) const {
+    U64 bitPos;
+    U64 symStart = findBlock(idx, bitPos);
+    BitBufferReader br(data, bitPos);
+    int sym;
+    while (true) {
+        sym = code.decodeSymbol(br);
+        U64 len = symbols[sym].getLength();
+        if (idx < symStart + len)
+            break;
+        symStart += len;
+    }
+    while (!symbols[sym].isPrimitive()) {
+        const RePairSymbol& s = symbols[sym];
+        U64 leftLen = symbols[s.getLeft()].getLength();
+        if (idx < symStart + leftLen) {
+            sym = s.getLeft();
+        } else {
+            symStart += leftLen;
+            sym = s.getRight();
+        }
+    }
+    return symbols[sym].getValue();
+}
+
+U64
+RePairDeComp::findBlock(U64 idx, U64& bitPos) const {
+    assert(blockSize > 0);
+    assert(idx < dataLen);
+    const U64 block = idx / blockSize;
+    BitBufferReader br(data, indexPos + block * (offsBits + skipBits));
+    bitPos = symPos + br.readBits(offsBits);
+    const U64 skip = br.readBits(skipBits);
+    return block * blockSize - skip;
+}
+
+void
+RePairDeComp::expandSymbol(int sym, std::vector<U8>& out) const {
+    while (true) {
+        const RePairSymbol& s = symbols[sym];
+        if (s.isPrimitive()) {
+            out.push_back(s.getValue());
+            return;
+        }
+        expandSymbol(s.getLeft(), out);
+        sym = s.getRight();
+    }
+}
+
 // ------------------------------------------------------------
 
 LookupTable::LookupTable(std::unordered_map<U32,std::vector<U64>>& data) {
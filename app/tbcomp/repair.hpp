@@ -2,6 +2,7 @@
 #define REPAIR_HPP_
 
 #include "bitbuffer.hpp"
+#include "huffman.hpp"
 #include "symbolarray.hpp"
 #include <unordered_map>
 #include <functional>
@@ -50,16 +51,46 @@ public:
      * Uses inData.size()/8+O(1) extra memory. */
     RePairComp(std::vector<U8>& inData, int minFreq, int maxSyms);
 
-    /** Create compressed representation of the data. */
-    void toBitBuf(BitBufferWriter& out);
+    /** As above, but use "nThreads" threads. If nThreads <= 0, the number of
+     *  hardware threads is used. */
+    RePairComp(std::vector<U8>& inData, int minFreq, int maxSyms, int nThreads);
+
+    /** As above, but compress the "size" bytes stored in "inData", for
+     *  example a private memory mapping of the input file. */
+    RePairComp(U8* inData, U64 size, int minFreq, int maxSyms, int nThreads);
+
+    /** Default number of data entries per block in the block index. */
+    static const U64 defaultBlockSize = 16384;
+
+    /** Compress "size" data entries as independent segments of "segmentSize"
+     *  entries. Up to "nThreads" segments are compressed in parallel, each by
+     *  its own RePairComp object. If there are fewer segments than threads,
+     *  the remaining threads are shared by the RePairComp objects.
+     *  getData(beg, end, vec) must store data entries [beg,end) in vec. It is
+     *  called concurrently from different threads, for disjoint ranges.
+     *  writeSegment(buf) is called with the toBitBuf() output of each segment,
+     *  in segment order, so the result does not depend on nThreads. */
+    static void compressSegments(U64 size, U64 segmentSize, int minFreq, int maxSyms,
+                                 U64 blockSize, int nThreads,
+                                 const std::function<void(U64,U64,std::vector<U8>&)>& getData,
+                                 const std::function<void(const std::vector<U8>&)>& writeSegment);
+
+    /** Create compressed representation of the data. If "blockSize" is
+     *  non-zero, a block index is also created, which makes it possible to
+     *  decompress individual data entries without decompressing everything.
+     *  A new block starts at the symbol containing data entry i * blockSize,
+     *  for all i. */
+    void toBitBuf(BitBufferWriter& out, U64 blockSize = defaultBlockSize);
 
 private:
-    RePairComp(std::vector<U8>& inData, int minFreq, int maxSyms, int chunkSize);
+    RePairComp(U8* inData, U64 size, int minFreq, int maxSyms, int chunkSize,
+               int nThreads);
     void compress(U64 minFreq, int maxSyms);
     void initSymbols(RePairImpl::CompressData& cpData);
     void refillCache(RePairImpl::CompressData& cpData, U64 maxCache);
     void pruneCache(RePairImpl::CompressData& cpData, S64 maxSize, U64 maxFreq) const;
-    U64 replacePairs(int X, int Y, int Z, RePairImpl::DeltaFreq& delta);
+    U64 replacePairs(int X, int Y, int Z, RePairImpl::DeltaFreq& delta,
+                     std::vector<RePairImpl::DeltaFreq>& workerDelta);
     std::vector<bool> computeSkipFirst(int X, int Y);
     U64 replacePairsIdxCache(const std::vector<U64>& indices, int X, int Y, int Z,
                              RePairImpl::DeltaFreq& delta);
@@ -78,11 +109,35 @@ public:
     /** Decompress all data. */
     void deCompressAll(std::function<void(const std::vector<U8>&)> consumer);
 
-    /** Decompress one data entry. */
+    /** Decompress the block containing data entry "idx". The data must have
+     *  been compressed with a block index.
+     *  @return The index of the data entry stored in out[0]. */
+    U64 deCompressBlock(U64 idx, std::vector<U8>& out) const;
+
+    /** Decompress one data entry. The data must have been compressed with a
+     *  block index. Symbols not containing "idx" are skipped using their
+     *  lengths, so only the Huffman codes in one block need to be decoded. */
     int operator[](U64 idx) const;
 
 private:
+    /** Find the block containing data entry "idx". Return the index of the first
+     *  data entry in the block and set "bitPos" to the position of its first symbol. */
+    U64 findBlock(U64 idx, U64& bitPos) const;
+
+    /** Append the primitive symbols "sym" consists of to "out". */
+    void expandSymbol(int sym, std::vector<U8>& out) const;
+
     const U8* data;
+    std::vector<RePairSymbol> symbols;
+    HuffCode code;
+    U64 nSyms;
+
+    U64 blockSize;    // Number of data entries per block, or 0 if no block index
+    U64 dataLen;      // Total number of data entries, if there is a block index
+    int offsBits;     // Number of bits used to store a bit offset in the block index
+    int skipBits;     // Number of bits used to store a block start adjustment
+    U64 indexPos;     // Bit position of block index
+    U64 symPos;       // Bit position of first encoded symbol
 };
 
 /** Fast mapping from integer to cache data. */
@@ -161,10 +216,4 @@ RePairSymbol::getDepth() const {
 }
 
 
-inline
-RePairDeComp::RePairDeComp(const U8* inData)
-    : data(inData) {
-}
-
-
 #endif /* REPAIR_HPP_ */
@@ -0,0 +1,213 @@
+#include "scratcharray.hpp"
+#include "chessParseError.hpp"
+#include <atomic>
+#include <vector>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <algorithm>
+#include <fstream>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+
+ScratchMemory::ScratchMemory(U64 size, const std::string& filePrefix)
+    : memSize(size) {
+    if (size == 0)
+        return;
+    if (filePrefix.empty()) {
+        mem = new U8[size]();
+        return;
+    }
+
+#ifdef _WIN32
+    std::string fileName;
+    HANDLE file = INVALID_HANDLE_VALUE;
+    for (int i = 0; i < 100 && file == INVALID_HANDLE_VALUE; i++) {
+        fileName = filePrefix + uniqueSuffix() + ".tmp";
+        file = CreateFileA(fileName.c_str(), GENERIC_READ | GENERIC_WRITE, 0, NULL, CREATE_NEW,
+                           FILE_ATTRIBUTE_TEMPORARY | FILE_FLAG_DELETE_ON_CLOSE, NULL);
+        if (file == INVALID_HANDLE_VALUE && GetLastError() != ERROR_FILE_EXISTS)
+            break;
+    }
+    if (file == INVALID_HANDLE_VALUE)
+        throw ChessParseError("Failed to create scratch file " + fileName +
+                              ": error " + num2Str((U64)GetLastError()));
+    // Creating the mapping extends the file to "size" zero bytes
+    HANDLE map = CreateFileMapping(file, NULL, PAGE_READWRITE,
+                                   (DWORD)(size >> 32), (DWORD)size, NULL);
+    void* ptr = map ? MapViewOfFile(map, FILE_MAP_ALL_ACCESS, 0, 0, size) : NULL;
+    if (!ptr) {
+        DWORD err = GetLastError();
+        if (map)
+            CloseHandle(map);
+        CloseHandle(file);
+        throw ChessParseError("Failed to map scratch file " + fileName +
+                              ": error " + num2Str((U64)err));
+    }
+    fileHandle = file;
+    mapHandle = map;
+#else
+    std::string tmpl = filePrefix + "XXXXXX";
+    std::vector<char> fileName(tmpl.begin(), tmpl.end());
+    fileName.push_back(0);
+    int fd = ::mkstemp(fileName.data());
+    if (fd < 0)
+        throw ChessParseError("Failed to create scratch file " + tmpl +
+                              ": " + std::strerror(errno));
+    ::unlink(fileName.data());
+    if (::ftruncate(fd, size) != 0) {
+        int err = errno;
+        ::close(fd);
+        throw ChessParseError("Failed to resize scratch file " + tmpl +
+                              ": " + std::strerror(err));
+    }
+    void* ptr = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    int err = errno;
+    ::close(fd);
+    if (ptr == MAP_FAILED)
+        throw ChessParseError("Failed to map scratch file " + tmpl +
+                              ": " + std::strerror(err));
+    ::madvise(ptr, size, MADV_SEQUENTIAL);
+#endif
+    mem = (U8*)ptr;
+    mapped = true;
+}
+
+ScratchMemory::ScratchMemory(U64 size, const std::string& fileName, U64 offset)
+    : memSize(size) {
+    if (size == 0)
+        return;
+#ifdef _WIN32
+    // A copy-on-write view can not extend past the end of the file, so read
+    // the file into zero initialized heap memory instead
+    std::ifstream inF(fileName, std::ios::binary | std::ios::ate);
+    if (!inF)
+        throw ChessParseError("Failed to open file " + fileName);
+    const U64 fileSize = inF.tellg();
+    const U64 fileBytes = fileSize > offset ? std::min(size, fileSize - offset) : 0;
+    std::unique_ptr<U8[]> buf(new U8[size]());
+    inF.seekg(offset);
+    inF.read((char*)buf.get(), fileBytes);
+    if (!inF)
+        throw ChessParseError("Failed to read file " + fileName);
+    mem = buf.release();
+#else
+    int fd = ::open(fileName.c_str(), O_RDONLY);
+    if (fd < 0)
+        throw ChessParseError("Failed to open file " + fileName +
+                              ": " + std::strerror(errno));
+    struct stat st;
+    if (::fstat(fd, &st) != 0) {
+        int err = errno;
+        ::close(fd);
+        throw ChessParseError("Failed to get size of file " + fileName +
+                              ": " + std::strerror(err));
+    }
+    const U64 fileSize = st.st_size;
+    const U64 fileBytes = fileSize > offset ? std::min(size, fileSize - offset) : 0;
+    const U64 pageSize = ::sysconf(_SC_PAGESIZE);
+    const U64 fileEnd = (fileBytes + pageSize - 1) / pageSize * pageSize;
+
+    // Reserve the whole address range without committing memory. The file
+    // data is then mapped at the start of the reservation and the rest is
+    // committed as zero pages, so MAP_FIXED only replaces pages owned by
+    // this object.
+    void* ptr = ::mmap(nullptr, size, PROT_NONE,
+                       MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    bool ok = ptr != MAP_FAILED;
+    if (ok && fileBytes > 0)
+        ok = ::mmap(ptr, fileBytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED,
+                    fd, offset) == ptr;
+    if (ok && fileEnd < size)
+        ok = ::mprotect((U8*)ptr + fileEnd, size - fileEnd, PROT_READ | PROT_WRITE) == 0;
+    int err = errno;
+    ::close(fd);
+    if (!ok) {
+        if (ptr != MAP_FAILED)
+            ::munmap(ptr, size);
+        throw ChessParseError("Failed to map file " + fileName +
+                              ": " + std::strerror(err));
+    }
+    ::madvise(ptr, size, MADV_SEQUENTIAL);
+    mem = (U8*)ptr;
+    mapped = true;
+#endif
+}
+
+ScratchMemory::~ScratchMemory() {
+    if (!mapped) {
+        delete[] mem;
+        return;
+    }
+#ifdef _WIN32
+    UnmapViewOfFile(mem);
+    if (mapHandle)
+        CloseHandle(mapHandle);
+    if (fileHandle)
+        CloseHandle(fileHandle);
+#else
+    ::munmap(mem, memSize);
+#endif
+}
+
+void
+ScratchMemory::release(U64 beg, U64 end) {
+    if (!mapped)
+        return;
+#ifdef _WIN32
+    SYSTEM_INFO si;
+    GetSystemInfo(&si);
+    const U64 pageSize = si.dwPageSize;
+#else
+    const U64 pageSize = ::sysconf(_SC_PAGESIZE);
+#endif
+    beg = (beg + pageSize - 1) / pageSize * pageSize;
+    end = end / pageSize * pageSize;
+    if (beg < end) {
+#ifdef _WIN32
+        FlushViewOfFile(mem + beg, end - beg);
+        VirtualUnlock(mem + beg, end - beg); // Removes unlocked pages from the working set
+#else
+        ::msync(mem + beg, end - beg, MS_ASYNC);
+        ::madvise(mem + beg, end - beg, MADV_DONTNEED);
+#endif
+    }
+}
+
+std::string
+ScratchMemory::tempFileName(const std::string& name) {
+    std::string dir;
+    for (const char* var : { "TMPDIR", "TMP", "TEMP" }) {
+        const char* val = std::getenv(var);
+        if (val && *val) {
+            dir = val;
+            break;
+        }
+    }
+    if (dir.empty()) {
+#ifdef _WIN32
+        dir = ".";
+#else
+        dir = "/tmp";
+#endif
+    }
+    return dir + "/tbcomp_" + name + "_" + uniqueSuffix() + ".tmp";
+}
+
+std::string
+ScratchMemory::uniqueSuffix() {
+    static std::atomic<U64> counter(0);
+#ifdef _WIN32
+    U64 pid = GetCurrentProcessId();
+#else
+    U64 pid = ::getpid();
+#endif
+    return num2Str(pid) + "_" + num2Str(counter++);
+}
@@ -0,0 +1,84 @@
+#ifndef SCRATCHARRAY_HPP_
+#define SCRATCHARRAY_HPP_
+
+#include "util/util.hpp"
+#include <string>
+#include <memory>
+#include <type_traits>
+
+
+/** A block of zero initialized memory, either allocated on the heap or
+ *  backed by a memory mapped scratch file. A scratch file makes it possible
+ *  to use more memory than is physically available, as long as the memory
+ *  is mostly accessed sequentially. */
+class ScratchMemory {
+public:
+    /** Allocate "size" bytes. If "filePrefix" is empty, heap memory is used.
+     *  Otherwise a new file with a unique name starting with "filePrefix" is
+     *  created and memory mapped. The file is removed from the file system
+     *  immediately (on WIN32 when it is closed), so it does not outlive the
+     *  process even if the process crashes. */
+    ScratchMemory(U64 size, const std::string& filePrefix);
+    /** Map "size" bytes of the existing file "fileName", starting at byte
+     *  "offset", which must be a multiple of the page size. The mapping is
+     *  private, so modifications are not written back to the file. Pages are
+     *  read from the file when first accessed. Bytes after the end of the
+     *  file are zero. On WIN32 the data is instead read into heap memory. */
+    ScratchMemory(U64 size, const std::string& fileName, U64 offset);
+    ~ScratchMemory();
+    ScratchMemory(const ScratchMemory&) = delete;
+    ScratchMemory& operator=(const ScratchMemory&) = delete;
+
+    U8* data() const { return mem; }
+    U64 size() const { return memSize; }
+
+    /** Tell the operating system that bytes [beg,end) will not be accessed
+     *  again soon. Dirty pages in a scratch file are written back to disk
+     *  and the corresponding physical memory can be reused. */
+    void release(U64 beg, U64 end);
+
+    /** Return a file name in the temporary directory of the system, based
+     *  on "name" and made unique to this process and call. */
+    static std::string tempFileName(const std::string& name);
+
+private:
+    /** Return a string that is unique for this process and call. */
+    static std::string uniqueSuffix();
+
+    U8* mem = nullptr;
+    U64 memSize;
+    bool mapped = false;
+#ifdef _WIN32
+    void* fileHandle = nullptr;
+    void* mapHandle = nullptr;
+#endif
+};
+
+/** A fixed size array of trivially copyable elements, stored in ScratchMemory.
+ *  All bits in all elements are initially zero. */
+template <typename T>
+class ScratchArray {
+    static_assert(std::is_trivially_copyable<T>::value, "");
+public:
+    ScratchArray(U64 size, const std::string& filePrefix)
+        : mem(size * sizeof(T), filePrefix), len(size) {}
+    /** Initialize from the contents of an existing file. See ScratchMemory. */
+    ScratchArray(U64 size, const std::string& fileName, U64 offset)
+        : mem(size * sizeof(T), fileName, offset), len(size) {}
+
+    T& operator[](U64 idx) { return data()[idx]; }
+    const T& operator[](U64 idx) const { return data()[idx]; }
+
+    T* data() const { return reinterpret_cast<T*>(mem.data()); }
+    U64 size() const { return len; }
+
+    /** Release elements [beg,end). See ScratchMemory::release(). */
+    void release(U64 beg, U64 end) { mem.release(beg * sizeof(T), end * sizeof(T)); }
+
+private:
+    ScratchMemory mem;
+    U64 len;
+};
+
+
+#endif /* SCRATCHARRAY_HPP_ */
@@ -0,0 +1,391 @@
+#ifndef STATSCOLLECTOR_HPP_
+#define STATSCOLLECTOR_HPP_
+
+#include "dtnode.hpp"
+#include "predicates.hpp"
+#include <cfloat>
+#include <cmath>
+#include <type_traits>
+
+
+/** A StatsCollectorNode that collects statistics for all predicates in one
+ *  contiguous count table.
+ *  - Stats: Statistics for a set of positions, e.g. WDLStats. Must provide
+ *    nVals, valueIndex(), construction from nVals counts, addStats(),
+ *    subStats(), splitCost() and makeNode().
+ *  - StatsNode: The DT::StatsNode type created by Stats::makeNode().
+ *  - EvalCtx: The DT::EvalContext type.
+ *  - CtxPred: A multi-valued predicate that depends on EvalCtx data. */
+template <typename Stats, typename StatsNode, typename EvalCtx, typename CtxPred>
+class PredStatsCollectorNode : public DT::StatsCollectorNode {
+public:
+    PredStatsCollectorNode(const DT::EvalContext& ctx, int nChunks, double priorCost);
+
+    bool applyData(const Position& pos, int value, DT::EvalContext& ctx) override;
+
+    void addStats(const DT::StatsCollectorNode& other) override;
+
+    std::unique_ptr<DT::Node> getBest(const DT::EvalContext& ctx) const override;
+
+    std::unique_ptr<DT::Node> getBestReplacement(const DT::EvalContext& ctx) const override;
+
+private:
+    /** Call func(pred) for each predicate, in the order used by the count table. */
+    template <typename Func> void iteratePreds(Func func) const;
+
+    /** Call func(predNo, split, cost) for each candidate split, in count table order. */
+    template <typename Func> void iterateCandidates(bool useGini, Func func) const;
+
+    /** Create node for split "split" of predicate number "predNo". */
+    std::unique_ptr<DT::Node> makeNode(int predNo, int split) const;
+
+    /** Adjust counts based on fraction of positions sampled. */
+    void reScale(std::unique_ptr<DT::Node>& node) const;
+
+    WTMPredicate wtm;
+    InCheckPredicate inCheck;
+    BishopPairPredicate<true> bPairW;
+    BishopPairPredicate<false> bPairB;
+    BishopColorPredicate<true> sameB;
+    BishopColorPredicate<false> oppoB;
+    std::vector<KingInPawnSquarePredicate> kPawnSq;
+    PawnRacePredicate pRace;
+    CtxPred ctxPred;
+    std::vector<DarkSquarePredicate> darkSquare;
+    std::vector<FileRankPredicate<true>> fileRankF;
+    std::vector<FileRankPredicate<false>> fileRankR;
+    std::vector<FileRankDeltaPredicate<true,false>> fileDelta;
+    std::vector<FileRankDeltaPredicate<false,false>> rankDelta;
+    std::vector<FileRankDeltaPredicate<true,true>> fileDist;
+    std::vector<FileRankDeltaPredicate<false,true>> rankDist;
+    std::vector<DistancePredicate<false>> kingDist;
+    std::vector<DistancePredicate<true>> taxiDist;
+    std::vector<SameDiagPredicate> diag;
+    std::vector<AttackPredicate> attacks;
+    std::vector<ForkPredicate> forks;
+
+    /** Statistics for all predicates in one table, indexed by
+     *  [predicate][predicate value][Stats::valueIndex(value)], where predicate
+     *  value is 0/1 for boolean predicates and val - minVal for multi-valued
+     *  predicates. */
+    std::vector<U64> counts;
+};
+
+/** Mapping from predicate values to rows in the PredStatsCollectorNode count
+ *  table, and node creation for a split of the rows. */
+template <typename Stats, typename Pred,
+          bool multi = std::is_base_of<MultiPredicate, Pred>::value>
+struct PredCountTraits {
+    constexpr static int nVals = 2;
+
+    static int row(const Pred& pred, const Position& pos, DT::EvalContext& ctx) {
+        return pred.Pred::eval(pos, ctx);
+    }
+
+    template <typename Func>
+    static void scan(const U64* rows, bool useGini, int predNo, Func func) {
+        const int N = Stats::nVals;
+        func(predNo, 0, Stats::splitCost(Stats(rows), Stats(rows + N), useGini));
+    }
+
+    static std::unique_ptr<DT::Node> makeNode(const Pred& pred, int split, const U64* rows) {
+        const int N = Stats::nVals;
+        return Stats::makeNode(pred, Stats(rows), Stats(rows + N));
+    }
+};
+
+template <typename Stats, typename Pred>
+struct PredCountTraits<Stats, Pred, true> {
+    constexpr static int nVals = Pred::maxVal - Pred::minVal + 1;
+
+    static int row(const Pred& pred, const Position& pos, DT::EvalContext& ctx) {
+        return pred.Pred::eval(pos, ctx) - Pred::minVal;
+    }
+
+    /** Split "i" corresponds to the predicate "value <= minVal + i". */
+    template <typename Func>
+    static void scan(const U64* rows, bool useGini, int predNo, Func func) {
+        const int N = Stats::nVals;
+        Stats statsTrue, statsFalse;
+        for (int i = 0; i < nVals; i++)
+            statsFalse.addStats(Stats(rows + i * N));
+        for (int i = 0; i < nVals-1; i++) {
+            Stats s(rows + i * N);
+            statsTrue.addStats(s);
+            statsFalse.subStats(s);
+            func(predNo, i, Stats::splitCost(statsFalse, statsTrue, useGini));
+        }
+    }
+
+    static std::unique_ptr<DT::Node> makeNode(const Pred& pred, int split, const U64* rows) {
+        const int N = Stats::nVals;
+        Stats statsTrue, statsFalse;
+        for (int i = 0; i < nVals; i++)
+            (i <= split ? statsTrue : statsFalse).addStats(Stats(rows + i * N));
+        return Stats::makeNode(MultiPredBound<Pred>(pred, Pred::minVal + split),
+                                  statsFalse, statsTrue);
+    }
+};
+
+template <typename Stats, typename Pred>
+using PredCountTraitsT = PredCountTraits<Stats, typename std::decay<Pred>::type>;
+
+template <typename Stats, typename StatsNode, typename EvalCtx, typename CtxPred>
+PredStatsCollectorNode<Stats,StatsNode,EvalCtx,CtxPred>::PredStatsCollectorNode(
+        const DT::EvalContext& ctx, int nChunks, double priorCost)
+    : StatsCollectorNode(nChunks, priorCost) {
+    int nPieces = ctx.numPieces();
+    for (int i = 0; i < nPieces; i++)
+        if (Piece::makeWhite(ctx.getPieceType(i)) == Piece::WPAWN)
+            kPawnSq.emplace_back(i);
+    for (int i = 0; i < nPieces; i++)
+        darkSquare.emplace_back(i);
+    for (int i = 0; i < nPieces; i++)
+        fileRankF.emplace_back(i);
+    for (int i = 0; i < nPieces; i++)
+        fileRankR.emplace_back(i);
+    for (int p1 = 0; p1 < nPieces; p1++) {
+        for (int p2 = p1+1; p2 < nPieces; p2++) {
+            fileDelta.emplace_back(p1, p2);
+            rankDelta.emplace_back(p1, p2);
+            fileDist.emplace_back(p1, p2);
+            rankDist.emplace_back(p1, p2);
+            kingDist.emplace_back(p1, p2);
+            taxiDist.emplace_back(p1, p2);
+            diag.emplace_back(p1, p2);
+
+            bool white1 = Piece::isWhite(ctx.getPieceType(p1));
+            bool white2 = Piece::isWhite(ctx.getPieceType(p2));
+            if (white1 == white2) {
+                for (int p3 = 0; p3 < nPieces; p3++) {
+                    Piece::Type pt = ctx.getPieceType(p3);
+                    if ((Piece::isWhite(pt) != white1) &&
+                        (Piece::makeWhite(pt) == Piece::WKNIGHT)) {
+                        forks.emplace_back(p1, p2, ctx);
+                        break;
+                    }
+                }
+            }
+        }
+    }
+    for (int p1 = 0; p1 < nPieces; p1++)
+        for (int p2 = 0; p2 < nPieces; p2++)
+            if (p1 != p2)
+                attacks.emplace_back(p1, p2);
+
+    size_t nRows = 0;
+    iteratePreds([&nRows](const auto& pred) {
+        nRows += PredCountTraitsT<Stats, decltype(pred)>::nVals;
+    });
+    counts.assign(nRows * Stats::nVals, 0);
+}
+
+template <typename Stats, typename StatsNode, typename EvalCtx, typename CtxPred>
+template <typename Func>
+void
+PredStatsCollectorNode<Stats,StatsNode,EvalCtx,CtxPred>::iteratePreds(Func func) const {
+    func(wtm);
+    func(inCheck);
+    func(bPairW);
+    func(bPairB);
+    func(sameB);
+    func(oppoB);
+    for (const auto& p : kPawnSq)
+        func(p);
+    func(pRace);
+    func(ctxPred);
+    for (const auto& p : darkSquare)
+        func(p);
+    for (const auto& p : fileRankF)
+        func(p);
+    for (const auto& p : fileRankR)
+        func(p);
+    for (const auto& p : fileDelta)
+        func(p);
+    for (const auto& p : rankDelta)
+        func(p);
+    for (const auto& p : fileDist)
+        func(p);
+    for (const auto& p : rankDist)
+        func(p);
+    for (const auto& p : kingDist)
+        func(p);
+    for (const auto& p : taxiDist)
+        func(p);
+    for (const auto& p : diag)
+        func(p);
+    for (const auto& p : forks)
+        func(p);
+    for (const auto& p : attacks)
+        func(p);
+}
+
+template <typename Stats, typename StatsNode, typename EvalCtx, typename CtxPred>
+template <typename Func>
+void
+PredStatsCollectorNode<Stats,StatsNode,EvalCtx,CtxPred>::iterateCandidates(bool useGini,
+                                                                         Func func) const {
+    const U64* rows = counts.data();
+    int predNo = 0;
+    iteratePreds([&](const auto& pred) {
+        using Traits = PredCountTraitsT<Stats, decltype(pred)>;
+        Traits::scan(rows, useGini, predNo, func);
+        rows += Traits::nVals * Stats::nVals;
+        predNo++;
+    });
+}
+
+template <typename Stats, typename StatsNode, typename EvalCtx, typename CtxPred>
+std::unique_ptr<DT::Node>
+PredStatsCollectorNode<Stats,StatsNode,EvalCtx,CtxPred>::makeNode(int predNo, int split) const {
+    std::unique_ptr<DT::Node> ret;
+    const U64* rows = counts.data();
+    int no = 0;
+    iteratePreds([&](const auto& pred) {
+        using Traits = PredCountTraitsT<Stats, decltype(pred)>;
+        if (no++ == predNo)
+            ret = Traits::makeNode(pred, split, rows);
+        rows += Traits::nVals * Stats::nVals;
+    });
+    return ret;
+}
+
+template <typename Stats, typename StatsNode, typename EvalCtx, typename CtxPred>
+bool
+PredStatsCollectorNode<Stats,StatsNode,EvalCtx,CtxPred>::applyData(const Position& pos, int value,
+                                                                 DT::EvalContext& ctx) {
+    const int N = Stats::nVals;
+    U64* cnt = counts.data() + Stats::valueIndex(value);
+    iteratePreds([&](const auto& pred) {
+        using Traits = PredCountTraitsT<Stats, decltype(pred)>;
+        cnt[Traits::row(pred, pos, ctx) * N]++;
+        cnt += Traits::nVals * N;
+    });
+    return true;
+}
+
+template <typename Stats, typename StatsNode, typename EvalCtx, typename CtxPred>
+void
+PredStatsCollectorNode<Stats,StatsNode,EvalCtx,CtxPred>::addStats(
+        const DT::StatsCollectorNode& other) {
+    const auto& pOther = static_cast<const PredStatsCollectorNode&>(other);
+    const size_t n = counts.size();
+    U64* dst = counts.data();
+    const U64* src = pOther.counts.data();
+    for (size_t i = 0; i < n; i++)
+        dst[i] += src[i];
+}
+
+template <typename Stats, typename StatsNode, typename EvalCtx, typename CtxPred>
+std::unique_ptr<DT::Node>
+PredStatsCollectorNode<Stats,StatsNode,EvalCtx,CtxPred>::getBest(const DT::EvalContext& ctx) const {
+    const bool useGini = static_cast<const EvalCtx&>(ctx).useGini();
+    int bestPred = -1;
+    int bestSplit = 0;
+    double bestCost = DBL_MAX;
+    iterateCandidates(useGini, [&](int predNo, int split, double cost) {
+        if (cost < bestCost || bestPred < 0) {
+            bestCost = std::min(bestCost, cost);
+            bestPred = predNo;
+            bestSplit = split;
+        }
+    });
+
+    std::unique_ptr<DT::Node> best = makeNode(bestPred, bestSplit);
+    reScale(best);
+    return best;
+}
+
+template <typename Stats, typename StatsNode, typename EvalCtx, typename CtxPred>
+void
+PredStatsCollectorNode<Stats,StatsNode,EvalCtx,CtxPred>::reScale(
+        std::unique_ptr<DT::Node>& node) const {
+    struct Visitor : public DT::Visitor {
+        Visitor(int nChunks, int appliedChunks) : nChunks(nChunks), appliedChunks(appliedChunks) {}
+        using DT::Visitor::visit;
+        void visit(DT::PredicateNode& node) {
+            node.left->accept(*this);
+            node.right->accept(*this);
+        }
+        void visit(DT::StatsNode& node) {
+            StatsNode& sNode = static_cast<StatsNode&>(node);
+            sNode.scaleStats(nChunks, appliedChunks);
+        }
+    private:
+        const int nChunks;
+        const int appliedChunks;
+    };
+    Visitor visitor(nChunks, appliedChunks);
+    node->accept(visitor);
+}
+
+template <typename Stats, typename StatsNode, typename EvalCtx, typename CtxPred>
+std::unique_ptr<DT::Node>
+PredStatsCollectorNode<Stats,StatsNode,EvalCtx,CtxPred>::getBestReplacement(
+        const DT::EvalContext& ctx) const {
+    const bool useGini = static_cast<const EvalCtx&>(ctx).useGini();
+    struct Cand {
+        int predNo = -1;
+        int split = 0;
+    };
+    Cand bestCand, secondBestCand;
+    double bestCost = DBL_MAX, secondBestCost = DBL_MAX;
+    auto better = [](const Cand& c, double& cCost, double cost) -> bool {
+        if (cost < cCost) {
+            cCost = cost;
+            return true;
+        }
+        return c.predNo < 0;
+    };
+    iterateCandidates(useGini, [&](int predNo, int split, double cost) {
+        double oldBestCost = bestCost;
+        if (better(bestCand, bestCost, cost)) {
+            secondBestCand = bestCand;
+            secondBestCost = oldBestCost;
+            bestCand = Cand{predNo, split};
+        } else if (better(secondBestCand, secondBestCost, cost)) {
+            secondBestCand = Cand{predNo, split};
+        }
+    });
+    std::unique_ptr<DT::Node> best = makeNode(bestCand.predNo, bestCand.split);
+    std::unique_ptr<DT::Node> secondBest = makeNode(secondBestCand.predNo, secondBestCand.split);
+
+    auto getErr = [this,&ctx](DT::Node& node) -> double {
+        struct Visitor : public DT::Visitor {
+            Visitor(const DT::EvalContext& ctx) : ctx(ctx) {}
+            using DT::Visitor::visit;
+            void visit(DT::PredicateNode& node) {
+                node.left->accept(*this);
+                node.right->accept(*this);
+            }
+            void visit(DT::StatsNode& node) {
+                StatsNode& sNode = static_cast<StatsNode&>(node);
+                double err = sNode.costError(ctx);
+                err2 += err * err;
+            }
+            const DT::EvalContext& ctx;
+            double err2 = 0;
+        };
+        Visitor visitor(ctx);
+        node.accept(visitor);
+
+        double N = nChunks;
+        double n = appliedChunks;
+        return sqrt(visitor.err2 * (N - n) / N);
+    };
+
+    double bestErr = getErr(*best.get());
+    double secondBestErr = getErr(*secondBest.get());
+
+    double sumErr = sqrt(bestErr * bestErr + secondBestErr * secondBestErr);
+    double margin = bestCost * 2e-2;
+
+    if (secondBestCost - sumErr * 2.0 < bestCost - margin)
+        return nullptr;
+
+    reScale(best);
+    return best;
+}
+
+
+#endif /* STATSCOLLECTOR_HPP_ */
@@ -1,8 +1,11 @@
 #include "symbolarray.hpp"
 
 SymbolArray::SymbolArray(std::vector<U8>& data, int chSize)
-    : data(data), usedIdx(data.size(), true) {
-    U64 size = data.size();
+    : SymbolArray(data.data(), data.size(), chSize) {
+}
+
+SymbolArray::SymbolArray(U8* data, U64 size, int chSize)
+    : data(data), dataSize(size), usedIdx(size + 1, true) {
     if (chSize == -1) {
         chunkSize = 1ULL << 20;
         while ((size + chunkSize - 1) / chunkSize > 1024)
@@ -11,6 +11,8 @@ class SymbolArray {
 public:
     /** Construct symbol array from 1 byte symbols. */
     SymbolArray(std::vector<U8>& data, int chunkSize = -1);
+    /** Construct symbol array from "size" 1 byte symbols stored in "data". */
+    SymbolArray(U8* data, U64 size, int chunkSize = -1);
 
     /** Size in bytes of the underlying data array. */
     U64 size() const;
@@ -71,14 +73,15 @@ public:
     void combineSymbol(U64 idxX, U64 idxY, int val);
 
 private:
-    std::vector<U8>& data;
+    U8* data;
+    U64 dataSize;
     /**
      * Each bit in usedIdx corresponds to one entry in data.
      * If the bit is 0, data[i] does not represent a symbol.
      * If the bit is 1 and the next bit is 1, the symbol is data[i]
      * If the bit is 1 and the next bit is 0, the symbol is data[i]+256*data[i+1]
      */
-    BitArray usedIdx;     // 1 bit per element in data[]
+    BitArray usedIdx;     // 1 bit per element in data[], plus a 1 bit after the end
     U64 chunkSize;        // Common (end-beg) value (except for last chunk)
 
     std::vector<Chunk> chunks;
@@ -154,7 +157,7 @@ SymbolArray::iterator::putSymbol(int val) {
 
 inline U64
 SymbolArray::size() const {
-    return data.size();
+    return dataSize;
 }
 
 inline SymbolArray::iterator
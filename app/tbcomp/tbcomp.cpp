@@ -10,6 +10,7 @@
 #include "huffman.hpp"
 #include "repair.hpp"
 #include "test.hpp"
+#include "bench.hpp"
 #include "wdlcomp.hpp"
 #include "position.hpp"
 #include "moveGen.hpp"
@@ -17,17 +18,29 @@
 #include "parameters.hpp"
 #include "textio.hpp"
 #include "posindex.hpp"
+#include "scratcharray.hpp"
+#include "chessParseError.hpp"
 #include <cstdlib>
 #include <fstream>
+#include <sstream>
+#include <climits>
 
 static void idx2Pos(int argc, char* argv[]);
 static void idxTest(const std::string& fen);
+static void wdlSweep(int argc, char* argv[]);
 
 static void
 usage() {
     std::cerr << "Usage: tbcomp cmd params\n";
     std::cerr << "cmd is one of:\n";
     std::cerr << " test : Run automatic tests\n";
+    std::cerr << " bench [-n threads] [-e bits] [-l len] [-o file] [tbType] : Benchmark\n";
+    std::cerr << "     Time all compression phases for a generated tablebase, default krkn,\n";
+    std::cerr << "     and a random symbol stream. No tablebase files are needed\n";
+    std::cerr << "     -n  : Number of threads, default 1\n";
+    std::cerr << "     -e  : Entropy in bits per symbol of the symbol stream, default 2\n";
+    std::cerr << "     -l  : Number of symbols in the symbol stream, default 8000000\n";
+    std::cerr << "     -o  : Write results to file instead of standard output\n";
     std::cerr << " freq : Huffman code from frequencies \n";
     std::cerr << " freqdata f1 ... fn : d1 ... dn : Frequencies and data\n";
     std::cerr << " fromfile : Frequencies and data from file\n";
@@ -35,30 +48,53 @@ usage() {
     std::cerr << " huffcomp infile outfile : Huffman compress\n";
     std::cerr << " huffdecomp infile outfile : Huffman decompress\n";
 
-    std::cerr << " repaircomp infile outfile [minFreq [maxSyms]]: Re-pair compress\n";
+    std::cerr << " repaircomp infile outfile [minFreq [maxSyms [blockSize]]]: Re-pair compress\n";
     std::cerr << " repairdecomp infile outfile : Re-pair decompress\n";
 
     std::cerr << " idx2pos nwq nwr nwb nwn nwp  nbq nbr nbb nbn nbp  idx\n";
     std::cerr << " idxtest fen\n";
 
-    std::cerr << " wdldump [-g] [-d] [-c val] [-th val] [-s val] tbType\n";
+    std::cerr << " wdldump [-g] [-d] [-c val] [-th val] [-s val] [-t dir] [-i] [-f file] tbType\n";
     std::cerr << "     -g  : Use Gini impurity instead of entropy\n";
     std::cerr << "     -d  : Maximum depth of decision tree, default 10\n";
     std::cerr << "     -c  : Maximum number of collector nodes, default 100000\n";
     std::cerr << "     -th : Tree node merge threshold, default 4.1\n";
-    std::cerr << "     -s  : Sample only 1 in 2^val positions\n";
+    std::cerr << "     -s  : Sample only 1 in 2^val positions. Default is adaptive sampling,\n";
+    std::cerr << "           where large tree nodes use a smaller fraction of their positions\n";
+    std::cerr << "     -t  : Store large temporary arrays in memory mapped files in dir\n";
+    std::cerr << "     -i  : Compute WDL values in memory instead of probing Syzygy tablebases.\n";
+    std::cerr << "           Pawnless, at most 5 pieces. The 50 move rule is ignored, so the\n";
+    std::cerr << "           output is flagged as not equivalent to the Syzygy tables\n";
+    std::cerr << "     -f  : Cache file for WDL data. Created if it does not exist\n";
+    std::cerr << " wdlcomp [-g] [-d] [-c val] [-th val] [-s val] [-t dir] [-i] [-f file] [-b val] [-r val] tbType outfile\n";
+    std::cerr << "     Options as for wdldump, and:\n";
+    std::cerr << "     -b  : Number of positions per block, default 16384\n";
+    std::cerr << "     -r  : Number of positions per re-pair segment, default all.\n";
+    std::cerr << "           Segments are compressed independently, in parallel\n";
+    std::cerr << " dtzdump [-g] [-d] [-c val] [-th val] [-s val] [-t dir] [-i] [-b val] tbType\n";
+    std::cerr << "     Like wdldump, but for DTZ values. -i uses distance to mate instead of DTZ\n";
+    std::cerr << "     -b  : Number of positions per block for compressed size, default 16384\n";
+    std::cerr << " wdlsweep [-g list] [-d list] [-c list] [-th list] [-s list] [-t dir] [-i] [-f file] [-b val] tbType\n";
+    std::cerr << "     Compute decision trees for all combinations of parameter values and report\n";
+    std::cerr << "     tree size and compressed size. A list is comma separated, e.g. -d 8,10,12.\n";
+    std::cerr << "     -g takes values 0 and 1. -s takes -1 for adaptive sampling. Other\n";
+    std::cerr << "     options as for wdlcomp\n";
+    std::cerr << " wdlprobe infile [nPos] : Compare random probes with Syzygy tablebases\n";
 
     std::cerr << std::flush;
     ::exit(2);
 }
 
-static void
-readFile(std::ifstream& inF, std::vector<U8>& data) {
-    inF.seekg(0, std::ios::end);
-    U64 len = inF.tellg();
-    inF.seekg(0, std::ios::beg);
-    data.resize(len);
-    inF.read((char*)&data[0], len);
+/** Memory map the file "fileName" and store its size in "size". The mapping
+ *  is private, so the data can be modified without changing the file. It is
+ *  followed by 8 zero bytes, since BitBufferReader reads 8 bytes at a time. */
+static std::unique_ptr<ScratchMemory>
+mapFile(const std::string& fileName, U64& size) {
+    std::ifstream inF(fileName, std::ios::binary | std::ios::ate);
+    if (!inF)
+        throw ChessParseError("Failed to open file " + fileName);
+    size = inF.tellg();
+    return ::make_unique<ScratchMemory>(size + 8, fileName, 0);
 }
 
 int
@@ -72,6 +108,46 @@ main(int argc, char* argv[]) {
         if (cmd == "test") {
             Test().runTests();
 
+        } else if (cmd == "bench") {
+            int nThreads = 1;
+            double entropyBits = 2;
+            U64 nSymbols = 8000000;
+            std::string outFile;
+            int idx = 2;
+            while (idx < argc && argv[idx][0] == '-') {
+                std::string opt = argv[idx++];
+                if (idx >= argc)
+                    usage();
+                const char* val = argv[idx++];
+                if (opt == "-n") {
+                    if (!str2Num(val, nThreads) || nThreads < 1)
+                        usage();
+                } else if (opt == "-e") {
+                    if (!str2Num(val, entropyBits) || entropyBits < 0 || entropyBits > 8)
+                        usage();
+                } else if (opt == "-l") {
+                    if (!str2Num(val, nSymbols) || nSymbols < 1)
+                        usage();
+                } else if (opt == "-o") {
+                    outFile = val;
+                } else {
+                    usage();
+                }
+            }
+            std::string tbType = "krkn";
+            if (idx < argc)
+                tbType = argv[idx++];
+            if (idx != argc)
+                usage();
+
+            Bench bench(tbType, nThreads, entropyBits, nSymbols);
+            if (outFile.empty()) {
+                bench.run(std::cout);
+            } else {
+                std::ofstream outF(outFile);
+                bench.run(outF);
+            }
+
         } else if (cmd == "freq") {
             Huffman huff;
             HuffCode code;
@@ -146,64 +222,52 @@ main(int argc, char* argv[]) {
         } else if (cmd == "huffcomp") {
             if (argc != 4)
                 usage();
-            std::ifstream inF(argv[2]);
-            std::ofstream outF(argv[3]);
-
-            std::cout << "Reading..." << std::endl;
-            std::vector<U64> freq(256);
-            std::vector<int> data;
-            char c;
-            while (inF.get(c)) {
-                freq[(U8)c]++;
-                data.push_back((U8)c);
-            }
+            U64 len;
+            auto inMem = mapFile(argv[2], len);
+            const U8* data = inMem->data();
+            std::ofstream outF(argv[3], std::ios::binary);
 
             std::cout << "Computing prefix code..." << std::endl;
+            std::vector<U64> freq(256);
+            for (U64 i = 0; i < len; i++)
+                freq[data[i]]++;
             Huffman huff;
             HuffCode code;
             huff.computePrefixCode(freq, code);
 
-            std::cout << "Encoding..." << std::endl;
-            BitBufferWriter bw;
+            std::cout << "Encoding/writing..." << std::endl;
+            BitBufferWriter bw(outF);
             code.toBitBuf(bw, false);
-            bw.writeU64(data.size());
-            huff.encode(data, code, bw);
-
-            std::cout << "Writing..." << std::endl;
-            const std::vector<U8>& buf = bw.getBuf();
-            outF.write((const char*)&buf[0], buf.size());
+            bw.writeU64(len);
+            for (U64 i = 0; i < len; i++)
+                code.encodeSymbol(data[i], bw);
+            bw.finish();
 
         } else if (cmd == "huffdecomp") {
             if (argc != 4)
                 usage();
-            std::ifstream inF(argv[2]);
-            std::ofstream outF(argv[3]);
+            U64 inLen;
+            auto inMem = mapFile(argv[2], inLen);
+            std::ofstream outF(argv[3], std::ios::binary);
 
-            std::cout << "Reading..." << std::endl;
-            std::vector<U8> inData;
-            readFile(inF, inData);
-
-            std::cout << "Decoding..." << std::endl;
-            BitBufferReader br(&inData[0]);
-            std::vector<int> data;
-            Huffman huff;
+            std::cout << "Decoding/writing..." << std::endl;
+            BitBufferReader br(inMem->data());
             HuffCode code;
             code.fromBitBuf(br, 256);
             U64 len = br.readU64();
-            huff.decode(br, len, code, data);
-
-            std::cout << "Writing..." << std::endl;
             std::vector<char> cVec;
-            cVec.reserve(data.size());
-            for (int d : data)
-                cVec.push_back((char)d);
-            outF.write(&cVec[0], cVec.size());
+            while (len > 0) {
+                U64 n = std::min(len, BitBufferWriter::flushSize);
+                cVec.resize(n);
+                for (U64 i = 0; i < n; i++)
+                    cVec[i] = (char)code.decodeSymbol(br);
+                outF.write(cVec.data(), n);
+                len -= n;
+            }
 
         } else if (cmd == "repaircomp") {
-            if (argc < 4 || argc > 6)
+            if (argc < 4 || argc > 7)
                 usage();
-            std::ifstream inF(argv[2]);
-            std::ofstream outF(argv[3]);
             int minFreq = 8;
             if (argc > 4)
                 minFreq = std::atoi(argv[4]);
@@ -214,34 +278,30 @@ main(int argc, char* argv[]) {
                 maxSyms = std::atoi(argv[5]);
             if (maxSyms < 256 || maxSyms > 65535)
                 usage();
-
-            std::cout << "Reading..." << std::endl;
-            std::vector<U8> data;
-            readFile(inF, data);
+            U64 blockSize = RePairComp::defaultBlockSize;
+            if (argc > 6 && !str2Num(argv[6], blockSize))
+                usage();
+            U64 len;
+            auto inMem = mapFile(argv[2], len);
+            std::ofstream outF(argv[3], std::ios::binary);
 
             std::cout << "Compressing..." << std::endl;
-            RePairComp comp(data, minFreq, maxSyms);
-
-            std::cout << "Encoding..." << std::endl;
-            BitBufferWriter bw;
-            comp.toBitBuf(bw);
+            RePairComp comp(inMem->data(), len, minFreq, maxSyms, 0);
 
-            std::cout << "Writing..." << std::endl;
-            const std::vector<U8>& buf = bw.getBuf();
-            outF.write((const char*)&buf[0], buf.size());
+            std::cout << "Encoding/writing..." << std::endl;
+            BitBufferWriter bw(outF);
+            comp.toBitBuf(bw, blockSize);
+            bw.finish();
 
         } else if (cmd == "repairdecomp") {
             if (argc != 4)
                 usage();
-            std::ifstream inF(argv[2]);
-            std::ofstream outF(argv[3]);
-
-            std::cout << "Reading..." << std::endl;
-            std::vector<U8> inData;
-            readFile(inF, inData);
+            U64 inLen;
+            auto inMem = mapFile(argv[2], inLen);
+            std::ofstream outF(argv[3], std::ios::binary);
 
             std::cout << "Decoding/writing..." << std::endl;
-            RePairDeComp deComp(&inData[0]);
+            RePairDeComp deComp(inMem->data());
             auto writer = [&outF](const std::vector<U8>& outData) {
                 outF.write((const char*)&outData[0], outData.size());
             };
@@ -258,13 +318,20 @@ main(int argc, char* argv[]) {
             std::string fen = argv[2];
             idxTest(fen);
 
-        } else if (cmd == "wdldump") {
+        } else if (cmd == "wdldump" || cmd == "wdlcomp" || cmd == "dtzdump") {
+            const bool comp = cmd == "wdlcomp";
+            const bool dtz = cmd == "dtzdump";
             int idx = 2;
             bool useGini = false;
             int maxTreeDepth = 10;
             int maxCollectorNodes = 100000;
             double mergeThreshold = 4.1;
-            int samplingLogFactor = 0;
+            int samplingLogFactor = -1;
+            U64 blockSize = RePairComp::defaultBlockSize;
+            U64 segmentSize = 0;
+            std::string scratchDir;
+            std::string cacheFile;
+            bool generate = false;
             while (true) {
                 if (idx >= argc)
                     usage();
@@ -290,17 +357,64 @@ main(int argc, char* argv[]) {
                     if (idx >= argc || !str2Num(argv[idx++], samplingLogFactor) ||
                             (samplingLogFactor < 0))
                         usage();
+                } else if (argv[idx] == std::string("-t")) {
+                    idx++;
+                    if (idx >= argc)
+                        usage();
+                    scratchDir = argv[idx++];
+                } else if (argv[idx] == std::string("-i")) {
+                    generate = true;
+                    idx++;
+                } else if (!dtz && argv[idx] == std::string("-f")) {
+                    idx++;
+                    if (idx >= argc)
+                        usage();
+                    cacheFile = argv[idx++];
+                } else if ((comp || dtz) && argv[idx] == std::string("-b")) {
+                    idx++;
+                    if (idx >= argc || !str2Num(argv[idx++], blockSize) ||
+                            (blockSize < 1))
+                        usage();
+                } else if (comp && argv[idx] == std::string("-r")) {
+                    idx++;
+                    if (idx >= argc || !str2Num(argv[idx++], segmentSize) ||
+                            (segmentSize < 1))
+                        usage();
                 } else {
                     break;
                 }
             }
             std::string tbType(argv[idx++]);
+            std::string outFile = "out.bin";
+            if (comp) {
+                if (idx >= argc)
+                    usage();
+                outFile = argv[idx++];
+            }
 
             if (idx != argc)
                 usage();
 
-            WdlCompress wdlComp(tbType, useGini, mergeThreshold, samplingLogFactor);
-            wdlComp.wdlDump("out.bin", maxTreeDepth, maxCollectorNodes);
+            WdlCompress wdlComp(tbType, useGini, mergeThreshold, samplingLogFactor,
+                                scratchDir, generate, 0, cacheFile);
+            if (comp)
+                wdlComp.wdlComp(outFile, maxTreeDepth, maxCollectorNodes, blockSize,
+                                segmentSize);
+            else if (dtz)
+                wdlComp.dtzDump(outFile, maxTreeDepth, maxCollectorNodes, blockSize);
+            else
+                wdlComp.wdlDump(outFile, maxTreeDepth, maxCollectorNodes);
+
+        } else if (cmd == "wdlsweep") {
+            wdlSweep(argc, argv);
+
+        } else if (cmd == "wdlprobe") {
+            if (argc < 3 || argc > 4)
+                usage();
+            U64 nPos = 100000;
+            if (argc > 3 && (!str2Num(argv[3], nPos) || nPos < 1))
+                usage();
+            WdlCompress::wdlProbe(argv[2], nPos);
 
         } else {
             usage();
@@ -310,6 +424,89 @@ main(int argc, char* argv[]) {
     }
 }
 
+/** Parse a comma separated list of numbers. */
+template <typename T>
+static bool
+str2NumList(const std::string& str, std::vector<T>& result) {
+    result.clear();
+    std::stringstream ss(str);
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+        T val;
+        if (!str2Num(item, val))
+            return false;
+        result.push_back(val);
+    }
+    return !result.empty();
+}
+
+static void
+wdlSweep(int argc, char* argv[]) {
+    WdlCompress::SweepParams params;
+    params.maxTreeDepth = { 10 };
+    params.maxCollectorNodes = { 100000 };
+    params.mergeThreshold = { 4.1 };
+    params.useGini = { 0 };
+    params.samplingLogFactor = { -1 };
+    U64 blockSize = RePairComp::defaultBlockSize;
+    std::string scratchDir;
+    std::string cacheFile;
+    bool generate = false;
+
+    auto allOf = [](const std::vector<int>& vec, int minVal, int maxVal) {
+        for (int v : vec)
+            if (v < minVal || v > maxVal)
+                return false;
+        return true;
+    };
+
+    int idx = 2;
+    while (idx < argc - 1) {
+        std::string opt = argv[idx++];
+        if (opt == "-i") {
+            generate = true;
+            continue;
+        }
+        if (idx >= argc - 1)
+            usage();
+        std::string val = argv[idx++];
+        if (opt == "-g") {
+            if (!str2NumList(val, params.useGini) || !allOf(params.useGini, 0, 1))
+                usage();
+        } else if (opt == "-d") {
+            if (!str2NumList(val, params.maxTreeDepth) ||
+                    !allOf(params.maxTreeDepth, 1, INT_MAX))
+                usage();
+        } else if (opt == "-c") {
+            if (!str2NumList(val, params.maxCollectorNodes) ||
+                    !allOf(params.maxCollectorNodes, 1, INT_MAX))
+                usage();
+        } else if (opt == "-th") {
+            if (!str2NumList(val, params.mergeThreshold))
+                usage();
+        } else if (opt == "-s") {
+            if (!str2NumList(val, params.samplingLogFactor) ||
+                    !allOf(params.samplingLogFactor, -1, 30))
+                usage();
+        } else if (opt == "-t") {
+            scratchDir = val;
+        } else if (opt == "-f") {
+            cacheFile = val;
+        } else if (opt == "-b") {
+            if (!str2Num(val, blockSize) || blockSize < 1)
+                usage();
+        } else {
+            usage();
+        }
+    }
+    if (idx != argc - 1)
+        usage();
+    std::string tbType(argv[idx]);
+
+    WdlCompress wdlComp(tbType, false, 4.1, -1, scratchDir, generate, 0, cacheFile);
+    wdlComp.wdlSweep(params, blockSize);
+}
+
 static void
 idx2Pos(int argc, char* argv[]) {
     Position pos;
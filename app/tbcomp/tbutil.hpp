@@ -55,6 +55,32 @@ toBits(U64 val, int nBits) {
     return ss.str();
 }
 
+/** Append "val" to "out" using a variable length encoding. Each byte stores
+ *  7 bits, least significant bits first. The most significant bit is set
+ *  in all bytes except the last. */
+inline void
+writeVarUInt(U64 val, std::vector<U8>& out) {
+    while (val >= 0x80) {
+        out.push_back((U8)(val | 0x80));
+        val >>= 7;
+    }
+    out.push_back((U8)val);
+}
+
+/** Read a value stored by writeVarUInt() and advance "ptr". */
+inline U64
+readVarUInt(const U8*& ptr) {
+    U64 val = 0;
+    int shift = 0;
+    while (true) {
+        U8 b = *ptr++;
+        val |= (U64)(b & 0x7f) << shift;
+        if (!(b & 0x80))
+            return val;
+        shift += 7;
+    }
+}
+
 /** "Scrambles" a 64 bit number. The sequence hashU64(i) for i=1,2,3,...
  *   passes "dieharder -a -Y 1". */
 inline U64 hashU64(U64 v) {
@@ -6,16 +6,33 @@
 #include "textio.hpp"
 #include "posindex.hpp"
 #include "threadpool.hpp"
+#include "decisiontree.hpp"
+#include "indexlist.hpp"
+#include "treeinterp.hpp"
+#include "wdlfile.hpp"
+#include "wdlcomp.hpp"
+#include "chessParseError.hpp"
+#include "wdlnode.hpp"
+#include "dtxnode.hpp"
+#include "bitarray.hpp"
+#include "scratcharray.hpp"
+#include "bench.hpp"
+#include "moveGen.hpp"
 #include <utility>
 #include <algorithm>
 #include <iostream>
 #include <iomanip>
+#include <sstream>
+#include <fstream>
 #include <cassert>
+#include <cstdio>
+#include <cstring>
 
 void
 Test::runTests() {
     testReadWriteBits();
     testReadWriteU64();
+    testStreamWriter();
     testEncodeDecode();
     testFibFreq();
     testLookupTable();
@@ -23,8 +40,21 @@ Test::runTests() {
     testSymArrayStraddle();
     testSymArrayEmptyChunk();
     testRePair();
+    testRePairBlocks();
+    testRePairSegments();
     testSwapColors();
+    testPosIterator();
     testThreadPool();
+    testParallelStats();
+    testAdaptiveChunks();
+    testIndexList();
+    testTreeInterpreter();
+    testWdlFile();
+    testWdlGenerate();
+    testWdlCache();
+    testDtzTree();
+    testScratchArray();
+    testBenchSymbols();
     testEntropy();
 }
 
@@ -89,6 +119,27 @@ Test::testReadWriteU64() {
     assert(val2 == val);
 }
 
+void
+Test::testStreamWriter() {
+    auto writeData = [](BitBufferWriter& bw) {
+        for (U64 i = 0; i < 3 * BitBufferWriter::flushSize; i++)
+            bw.writeBits(hashU64(i) & 0x1fff, 1 + i % 13);
+    };
+    BitBufferWriter bw1;
+    writeData(bw1);
+    const U64 nBits = bw1.getNumBits();
+    const std::vector<U8>& buf1 = bw1.getBuf();
+
+    std::stringstream ss;
+    BitBufferWriter bw2(ss);
+    writeData(bw2);
+    assert(bw2.getNumBits() == nBits);
+    bw2.finish();
+    const std::string buf2 = ss.str();
+    assert(buf2.size() == buf1.size());
+    assert(std::memcmp(buf1.data(), buf2.data(), buf1.size()) == 0);
+}
+
 void
 Test::encodeDecode(const std::vector<int>& in) {
     const size_t N = in.size();
@@ -123,6 +174,16 @@ Test::encodeDecode(const std::vector<int>& in) {
     assert(out.size() == N);
     for (size_t i = 0; i < N; i++)
         assert(in[i] == out[i]);
+
+    // Decode one symbol at a time
+    {
+        HuffCode code;
+        BitBufferReader br(&buf[0]);
+        code.fromBitBuf(br);
+        U64 len = br.readU64();
+        for (U64 i = 0; i < len; i++)
+            assert(code.decodeSymbol(br) == in[i]);
+    }
 }
 
 void
@@ -136,6 +197,19 @@ Test::testEncodeDecode() {
     for (int i = 0; i < 100; i++)
         data.push_back(i % 12);
     encodeDecode(data);
+
+    // Geometric distribution, code lengths longer than the decoding table size
+    data.clear();
+    for (int i = 0; i < 100000; i++) {
+        U64 h = hashU64(i);
+        int v = 0;
+        while (v < 30 && (h & 1)) {
+            v++;
+            h >>= 1;
+        }
+        data.push_back(v);
+    }
+    encodeDecode(data);
 }
 
 void
@@ -358,21 +432,21 @@ void
 Test::testRePair() {
     {
         std::vector<U8> data(32, 0);
-        RePairComp comp(data, 2, 65535, 4);
+        RePairComp comp(data.data(), data.size(), 2, 65535, 4, 0);
         SymbolArray& sa = comp.sa;
         std::vector<int> symVec = getSymVec(sa);
         assert(symVec.size() == 2);
     }
     {
         std::vector<U8> data(32, 0);
-        RePairComp comp(data, 1, 65535, 4);
+        RePairComp comp(data.data(), data.size(), 1, 65535, 4, 0);
         SymbolArray& sa = comp.sa;
         std::vector<int> symVec = getSymVec(sa);
         assert(symVec.size() == 1);
     }
     {
         std::vector<U8> data(32, 0);
-        RePairComp comp(data, 1, 3, 4);
+        RePairComp comp(data.data(), data.size(), 1, 3, 4, 0);
         SymbolArray& sa = comp.sa;
         std::vector<int> symVec = getSymVec(sa);
         assert(symVec.size() == 8);
@@ -385,7 +459,7 @@ Test::testRePair() {
             for (int j = 0; j < 128; j++)
                 data.push_back(1);
         }
-        RePairComp comp(data, 1, 65535, 128);
+        RePairComp comp(data.data(), data.size(), 1, 65535, 128, 0);
         SymbolArray& sa = comp.sa;
         std::vector<int> symVec = getSymVec(sa);
         assert(symVec.size() == 1);
@@ -393,6 +467,76 @@ Test::testRePair() {
     }
 }
 
+void
+Test::testRePairBlocks() {
+    std::vector<U8> data;
+    for (int i = 0; i < 20000; i++)
+        data.push_back((hashU64(i / 7) % 16 == 0) ? i % 3 : 0);
+    const std::vector<U8> orig(data);
+
+    for (U64 blockSize : { 0, 1, 100, 4096, 100000 }) {
+        data = orig;
+        RePairComp comp(data.data(), data.size(), 2, 1000, 1024, 0);
+        BitBufferWriter bw;
+        comp.toBitBuf(bw, blockSize);
+        const std::vector<U8>& buf = bw.getBuf();
+
+        RePairDeComp deComp(&buf[0]);
+        std::vector<U8> all;
+        deComp.deCompressAll([&all](const std::vector<U8>& d) {
+            all.insert(all.end(), d.begin(), d.end());
+        });
+        assert(all == orig);
+
+        if (blockSize == 0)
+            continue;
+        std::vector<U8> block;
+        for (U64 idx = 0; idx < orig.size(); idx++) {
+            U64 first = deComp.deCompressBlock(idx, block);
+            assert(first <= idx);
+            assert(first + block.size() > idx);
+            assert(first + block.size() <= orig.size());
+            for (U64 i = 0; i < block.size(); i++)
+                assert(block[i] == orig[first + i]);
+            assert(deComp[idx] == orig[idx]);
+        }
+    }
+}
+
+void
+Test::testRePairSegments() {
+    std::vector<U8> orig;
+    for (int i = 0; i < 50000; i++)
+        orig.push_back((hashU64(i / 5) % 8 == 0) ? i % 5 : 0);
+    const U64 segmentSize = 12000;
+
+    auto compress = [&orig,segmentSize](int nThreads, std::vector<std::vector<U8>>& segments) {
+        segments.clear();
+        RePairComp::compressSegments(orig.size(), segmentSize, 2, 1000, 1000, nThreads,
+                                     [&orig](U64 beg, U64 end, std::vector<U8>& vec) {
+            vec.assign(orig.begin() + beg, orig.begin() + end);
+        }, [&segments](const std::vector<U8>& buf) {
+            segments.push_back(buf);
+        });
+    };
+    std::vector<std::vector<U8>> segments1, segments4;
+    compress(1, segments1);
+    compress(4, segments4);
+    assert(segments1.size() == 5);
+    assert(segments1 == segments4);
+
+    for (size_t s = 0; s < segments1.size(); s++) {
+        RePairDeComp deComp(segments1[s].data());
+        std::vector<U8> all;
+        deComp.deCompressAll([&all](const std::vector<U8>& d) {
+            all.insert(all.end(), d.begin(), d.end());
+        });
+        U64 beg = s * segmentSize;
+        U64 end = std::min(beg + segmentSize, (U64)orig.size());
+        assert(all == std::vector<U8>(orig.begin() + beg, orig.begin() + end));
+    }
+}
+
 void
 Test::testSwapColors() {
     {
@@ -464,6 +608,527 @@ Test::testThreadPool() {
     assert(resultSum == 5050 - 970);
 }
 
+void
+Test::testPosIterator() {
+    const char* fens[] = {
+        "k7/8/8/8/8/8/P7/K7 w",
+        "kr6/8/8/8/8/8/8/KQ6 w",
+        "kq6/8/8/8/8/8/8/KQ6 w",
+        "k7/1p6/8/8/8/8/P7/KR6 w",
+        "k7/8/8/8/8/8/8/KNN5 w",
+        "kb6/p7/8/8/8/8/PP6/K7 w",
+    };
+    for (const char* fen : fens) {
+        Position posType = TextIO::readFEN(fen);
+        PosIndex posIdx(posType);
+        const U64 size = posIdx.tbSize();
+        Position pos1, pos2;
+        PosIterator iter(posIdx, pos2);
+        auto check = [&](U64 idx) {
+            bool valid1 = posIdx.index2Pos(idx, pos1);
+            bool valid2 = iter.setIndex(idx);
+            assert(valid1 == valid2);
+            if (valid1)
+                assert(pos1 == pos2);
+        };
+        U64 nChecked = 0;
+        for (U64 start : { (U64)0, size / 3, size - 100000 }) {
+            U64 idx = std::min(start, size - 1);
+            for (int i = 0; i < 100000 && idx < size; i++) {
+                check(idx);
+                U64 h = hashU64(idx);
+                idx += (h % 4 == 0) ? h % 97 : 1;
+                if (h % 1024 == 0)
+                    idx = start + h % (size - start); // Large jump, maybe backwards
+                nChecked++;
+            }
+        }
+        assert(nChecked > 100000);
+
+        // Temporary modifications are allowed
+        iter.setIndex(5);
+        Position tmp(pos2);
+        pos2.setPiece(pos2.getKingSq(true), Piece::EMPTY);
+        pos2 = tmp;
+        check(6);
+    }
+}
+
+/** Create synthetic WDL data for a tablebase class. The values depend on
+ *  simple position features, so that a decision tree can find structure. */
+static void
+makeWDLData(const PosIndex& posIdx, std::vector<WDLInfo>& data, BitArray& active) {
+    const U64 size = posIdx.tbSize();
+    data.assign(size, WDLInfo());
+    Position pos;
+    for (U64 idx = 0; idx < size; idx++) {
+        if (!posIdx.index2Pos(idx, pos) || MoveGen::canTakeKing(pos)) {
+            active.set(idx, false);
+            continue;
+        }
+        int wKing = pos.getKingSq(true);
+        int bKing = pos.getKingSq(false);
+        int wdl = pos.isWhiteMove() ? 2 : 0;
+        if (MoveGen::inCheck(pos))
+            wdl -= 2;
+        if (BitBoard::getKingDistance(wKing, bKing) > 4)
+            wdl = std::max(wdl - 1, -2);
+        if (Square::getX(bKing) == 0)
+            wdl = 2;
+        U64 h = hashU64(idx);
+        if (h % 16 == 0)
+            wdl = 1;
+        int captWdl = pos.isWhiteMove() ? -2 : 2;
+        if ((h >> 8) % 8 == 0)
+            captWdl = wdl;
+        data[idx].setWdl(wdl);
+        data[idx].setCaptureWdl(captWdl);
+    }
+}
+
+void
+Test::computeTree(DecisionTree& dt, DT::NodeFactory& factory, int nThreads, int maxIter) {
+    auto ctx = factory.makeEvalContext(dt.posIdx);
+    dt.initStats(*ctx);
+    double costThreshold = ctx->getMergeThreshold();
+    int chunkNo = 0;
+    for (int iter = 0; iter < maxIter; iter++) {
+        dt.updateStats(chunkNo, nThreads);
+        chunkNo = (chunkNo + 1) & (dt.nStatsChunks - 1);
+        if (!dt.selectBestPreds(8, 1000, costThreshold, nThreads))
+            break;
+    }
+}
+
+void
+Test::testParallelStats() {
+    Position posType = TextIO::readFEN("k7/8/8/8/8/8/8/KR6 w");
+    PosIndex posIdx(posType);
+    std::vector<WDLInfo> data0;
+    BitArray active(posIdx.tbSize(), true);
+    makeWDLData(posIdx, data0, active);
+
+    auto getTree = [&](int nThreads, int samplingLogFactor) -> std::string {
+        std::vector<WDLInfo> data(data0);
+        WDLNodeFactory factory(false, 4.1);
+        WDLUncompressedData uncompData(data);
+        DecisionTree dt(factory, posIdx, uncompData, active, samplingLogFactor);
+        computeTree(dt, factory, nThreads, 4);
+        auto ctx = factory.makeEvalContext(posIdx);
+        return dt.root->describe(0, *ctx);
+    };
+
+    for (int s = -1; s < 2; s++) {
+        std::string tree1 = getTree(1, s);
+        std::string tree4 = getTree(4, s);
+        assert(!tree1.empty());
+        assert(tree1 == tree4);
+    }
+}
+
+void
+Test::testAdaptiveChunks() {
+    Position posType = TextIO::readFEN("k7/8/8/8/8/8/8/KR6 w");
+    PosIndex posIdx(posType);
+    std::vector<WDLInfo> data;
+    BitArray active(posIdx.tbSize(), true);
+    WDLNodeFactory factory(false, 4.1);
+    WDLUncompressedData uncompData(data);
+    {
+        DecisionTree dt(factory, posIdx, uncompData, active, 3);
+        assert(dt.numChunks(0) == 8);
+        assert(dt.numChunks(1ULL << 40) == 8);
+    }
+    {
+        DecisionTree dt(factory, posIdx, uncompData, active, -1);
+        const U64 minPos = DecisionTree::minChunkPositions;
+        assert(dt.numChunks(0) == 1);
+        assert(dt.numChunks(2 * minPos - 1) == 1);
+        assert(dt.numChunks(2 * minPos) == 2);
+        assert(dt.numChunks(5 * minPos) == 4);
+        assert(dt.numChunks(1ULL << 40) == DecisionTree::maxAdaptiveChunks);
+    }
+}
+
+void
+Test::testIndexList() {
+    std::vector<U64> indices;
+    U64 idx = 3;
+    for (int i = 0; i < 100000; i++) {
+        indices.push_back(idx);
+        idx += 1 + (hashU64(i) % (i % 3 == 0 ? 2 : 100000));
+    }
+    auto getIndices = [](const IndexList& list) {
+        std::vector<U64> ret;
+        for (int b = 0; b < list.numBlocks(); b++) {
+            U32 n = ret.size();
+            list.forEach(b, [&ret](U64 idx) { ret.push_back(idx); });
+            assert(ret.size() - n == list.blockLength(b));
+        }
+        return ret;
+    };
+
+    IndexList list;
+    for (U64 idx : indices)
+        list.add(idx);
+    assert(list.size() == indices.size());
+    assert(list.numBlocks() == (int)((indices.size() + IndexList::blockSize - 1) /
+                                     IndexList::blockSize));
+    assert(getIndices(list) == indices);
+
+    IndexList list1, list2, list3;
+    for (size_t i = 0; i < indices.size(); i++)
+        (i < 40000 ? list1 : list2).add(indices[i]);
+    list3.append(std::move(list1));
+    list3.append(std::move(list2));
+    assert(list3.size() == indices.size());
+    assert(list1.size() == 0 && list2.size() == 0);
+    assert(getIndices(list3) == indices);
+
+    // Many small lists, merged into partially filled blocks
+    IndexList list4;
+    for (size_t i = 0; i < indices.size(); i += 1000) {
+        IndexList tmp;
+        for (size_t j = i; j < std::min(i + 1000, indices.size()); j++)
+            tmp.add(indices[j]);
+        list4.append(std::move(tmp));
+        list4.append(IndexList());
+    }
+    assert(list4.size() == indices.size());
+    const U32 listsPerBlock = IndexList::blockSize / 1000;
+    assert(list4.numBlocks() == (int)((indices.size() / 1000 + listsPerBlock - 1) / listsPerBlock));
+    assert(getIndices(list4) == indices);
+}
+
+void
+Test::testTreeInterpreter() {
+    for (const char* fen : { "k7/8/8/8/8/8/8/KR6 w", "k7/8/8/8/8/8/P7/K7 w" }) {
+        Position posType = TextIO::readFEN(fen);
+        PosIndex posIdx(posType);
+        std::vector<WDLInfo> data;
+        BitArray active(posIdx.tbSize(), true);
+        makeWDLData(posIdx, data, active);
+
+        WDLNodeFactory factory(false, 4.1);
+        WDLUncompressedData uncompData(data);
+        DecisionTree dt(factory, posIdx, uncompData, active, 0);
+        computeTree(dt, factory, 4, 100);
+        dt.simplifyTree();
+        dt.makeEncoderTree();
+        assert(dt.getNumLeafNodes() > 1);
+
+        std::vector<U8> code;
+        dt.serialize(code);
+        TreeInterpreter interp(posIdx, &code[0]);
+
+        auto ctx = factory.makeEvalContext(posIdx);
+        Position pos;
+        for (U64 idx = 0; idx < posIdx.tbSize(); idx++) {
+            if (!active.get(idx))
+                continue;
+            posIdx.index2Pos(idx, pos);
+            ctx->init(pos, uncompData, idx);
+            int wdl = uncompData.getValue(idx);
+            int treeVal = DecisionTree::encodeValue(*dt.root, pos, *ctx, wdl);
+
+            int captWdl = uncompData.getCaptureWdl(idx);
+            const U8* leaf = interp.findLeaf(pos, captWdl);
+            assert(leaf && (*leaf & 0x80));
+            int encVal = WDLEncoderNode::encodeLeafValue(leaf, pos.isWhiteMove(), captWdl, wdl);
+            assert(encVal == treeVal);
+            int decVal = WDLEncoderNode::decodeLeafValue(leaf, pos.isWhiteMove(), captWdl, encVal);
+            assert(decVal == wdl);
+        }
+    }
+}
+
+void
+Test::testWdlFile() {
+    Position posType = TextIO::readFEN("k7/8/8/8/8/8/P7/K7 w");
+    PosIndex posIdx(posType);
+    std::vector<WDLInfo> data;
+    BitArray active(posIdx.tbSize(), true);
+    makeWDLData(posIdx, data, active);
+    const std::vector<WDLInfo> orig(data);
+
+    WDLNodeFactory factory(false, 4.1);
+    WDLUncompressedData uncompData(data);
+    DecisionTree dt(factory, posIdx, uncompData, active, 0);
+    computeTree(dt, factory, 4, 100);
+    dt.simplifyTree();
+    dt.makeEncoderTree();
+    std::vector<U8> tree;
+    dt.serialize(tree);
+
+    TreeInterpreter interp(posIdx, &tree[0]);
+    std::vector<U8> residuals(posIdx.tbSize(), 0);
+    Position pos;
+    for (U64 idx = 0; idx < posIdx.tbSize(); idx++) {
+        if (!active.get(idx))
+            continue;
+        posIdx.index2Pos(idx, pos);
+        int captWdl = orig[idx].getCaptureWdl();
+        const U8* leaf = interp.findLeaf(pos, captWdl);
+        residuals[idx] = WDLEncoderNode::encodeLeafValue(leaf, pos.isWhiteMove(), captWdl,
+                                                         orig[idx].getWdl());
+    }
+
+    std::stringstream ss;
+    const U64 segmentSize = 5000;
+    WdlFile::write(ss, posIdx, 2, -2, false, tree, segmentSize, 1000, 2,
+                   [&residuals](U64 beg, U64 end, std::vector<U8>& vec) {
+        vec.assign(residuals.begin() + beg, residuals.begin() + end);
+    });
+    const std::string str = ss.str();
+    std::vector<U8> fileData(str.begin(), str.end());
+    std::vector<U8> badData(fileData.begin(), fileData.begin() + 3);
+    WdlFile wdlFile(std::move(fileData));
+    assert(wdlFile.getPosIndex().tbSize() == posIdx.tbSize());
+    assert(!wdlFile.ignores50MoveRule());
+
+    U64 nProbed = 0;
+    for (U64 idx = 0; idx < posIdx.tbSize(); idx++) {
+        if (!active.get(idx))
+            continue;
+        posIdx.index2Pos(idx, pos);
+        MoveList moves;
+        MoveGen::pseudoLegalMoves(pos, moves);
+        MoveGen::removeIllegal(pos, moves);
+        if (moves.size == 0)
+            continue;
+        bool wtm = pos.isWhiteMove();
+        int wdl = orig[idx].getWdl();
+        int captWdl = orig[idx].getCaptureWdl();
+        int val = wdlFile.probe(pos, wtm ? captWdl : -captWdl);
+        assert(val == (wtm ? wdl : -wdl));
+        nProbed++;
+    }
+    assert(nProbed > posIdx.tbSize() / 2);
+
+    {
+        bool thrown = false;
+        try {
+            WdlFile bad(std::move(badData));
+        } catch (const ChessParseError&) {
+            thrown = true;
+        }
+        assert(thrown);
+    }
+}
+
+void
+Test::testWdlGenerate() {
+    WdlCompress wc("krk", false, 4.1, 0, "", true);
+    assert(wc.ignore50);
+    const PosIndex& posIdx = *wc.posIndex;
+    ScratchArray<WDLInfo> data(posIdx.tbSize(), "");
+    wc.initializeData(data);
+    assert(wc.bestWtm == 2);
+    assert(wc.bestBtm == 0);
+
+    U64 nWtm = 0, nBtmDraw = 0, nBtmWin = 0;
+    Position pos;
+    for (U64 idx = 0; idx < posIdx.tbSize(); idx++) {
+        const int wdl = data[idx].getWdl();
+        const bool valid = posIdx.index2Pos(idx, pos) && !MoveGen::canTakeKing(pos);
+        assert((wdl == 3) == !valid);
+        if (!valid || wdl == 4)
+            continue;
+        if (pos.isWhiteMove()) {
+            assert(wdl == 2); // KRK is always won with white to move
+            nWtm++;
+        } else {
+            int captWdl = data[idx].getCaptureWdl();
+            bool rookAttacked = BitBoard::kingAttacks(pos.getKingSq(false)) &
+                                pos.pieceTypeBB(Piece::WROOK);
+            assert(captWdl == 0 || captWdl == 2); // White perspective, 2 if no capture
+            if (captWdl == 0)
+                assert(rookAttacked);
+            if (wdl == 0) {
+                assert(captWdl == 0);
+                nBtmDraw++;
+            } else {
+                assert(wdl == 2);
+                nBtmWin++;
+            }
+        }
+    }
+    assert(nWtm > 0 && nBtmDraw > 0 && nBtmWin > 0);
+}
+
+void
+Test::testWdlCache() {
+    const std::string cacheFile = ScratchMemory::tempFileName("test_cache");
+
+    WdlCompress wc1("krk", false, 4.1, 0, "", true, 0, cacheFile);
+    assert(wc1.genTable);
+    auto data1 = wc1.prepareData();
+    const U64 size = wc1.posIndex->tbSize();
+    std::vector<U8> orig(size);
+    std::memcpy(orig.data(), data1->data(), size);
+
+    WdlCompress wc2("krk", false, 4.1, 0, "", true, 0, cacheFile);
+    assert(!wc2.genTable);
+    auto data2 = wc2.prepareData();
+    assert(wc2.bestWtm == wc1.bestWtm);
+    assert(wc2.bestBtm == wc1.bestBtm);
+    assert(wc2.ignore50);
+    assert(std::memcmp(orig.data(), data2->data(), size) == 0);
+
+    // Modifications are not written back to the cache file
+    (*data2)[0].setData(0xff);
+    data2.reset();
+    data2 = wc2.prepareData();
+    assert(std::memcmp(orig.data(), data2->data(), size) == 0);
+
+    try {
+        WdlCompress wc3("kqk", false, 4.1, 0, "", false, 0, cacheFile);
+        wc3.prepareData();
+        assert(false);
+    } catch (ChessParseError&) {
+    }
+    std::remove(cacheFile.c_str());
+}
+
+/** Create synthetic DTZ data for a tablebase class. Draws are inactive. */
+static void
+makeDTZData(const PosIndex& posIdx, std::vector<DTZInfo>& data, BitArray& active) {
+    const U64 size = posIdx.tbSize();
+    data.assign(size, DTZInfo());
+    Position pos;
+    for (U64 idx = 0; idx < size; idx++) {
+        if (!posIdx.index2Pos(idx, pos) || MoveGen::canTakeKing(pos)) {
+            active.set(idx, false);
+            continue;
+        }
+        int wKing = pos.getKingSq(true);
+        int bKing = pos.getKingSq(false);
+        U64 h = hashU64(idx);
+        if (h % 8 == 0) {
+            active.set(idx, false);
+            continue;
+        }
+        int wdl = pos.isWhiteMove() ? 2 : -2;
+        int dtz = 1 + 3 * BitBoard::getKingDistance(wKing, bKing) + (h >> 8) % 3;
+        if (Square::getX(bKing) == 0)
+            dtz = 1;
+        if ((h >> 16) % 16 == 0) {
+            wdl /= 2;
+            dtz += 100;
+        }
+        if ((h >> 24) % 64 == 0)
+            dtz = 256 + (h >> 32) % 1000;
+        data[idx].setWdl(wdl);
+        data[idx].setDtx(dtz);
+    }
+}
+
+void
+Test::testDtzTree() {
+    int low = 1;
+    for (int b = 0; b < DTXStats::nVals; b++) {
+        assert(DTXStats::bucketLow(b) == low);
+        for (int i = 0; i < DTXStats::bucketSize(b); i++)
+            assert(DTXStats::valueIndex(low + i) == b);
+        low += DTXStats::bucketSize(b);
+    }
+    assert(low == DTXStats::maxVal + 1);
+    assert(DTXStats::valueIndex(1023) == DTXStats::nVals - 1);
+
+    Position posType = TextIO::readFEN("k7/8/8/8/8/8/8/KR6 w");
+    PosIndex posIdx(posType);
+    std::vector<DTZInfo> data;
+    BitArray active(posIdx.tbSize(), true);
+    makeDTZData(posIdx, data, active);
+    const std::vector<DTZInfo> orig(data);
+
+    DTXNodeFactory factory(false, 4.1);
+    DTXUncompressedData uncompData(data.data());
+    DecisionTree dt(factory, posIdx, uncompData, active, 0);
+    computeTree(dt, factory, 4, 100);
+    dt.simplifyTree();
+    dt.makeEncoderTree();
+    assert(dt.getNumLeafNodes() > 1);
+
+    std::vector<U8> code;
+    dt.serialize(code);
+    TreeInterpreter interp(posIdx, &code[0]);
+
+    auto ctx = factory.makeEvalContext(posIdx);
+    Position pos;
+    U64 nZero = 0, nActive = 0, nEscape = 0;
+    for (U64 idx = 0; idx < posIdx.tbSize(); idx++) {
+        if (!active.get(idx))
+            continue;
+        posIdx.index2Pos(idx, pos);
+        ctx->init(pos, uncompData, idx);
+        int dtz = uncompData.getValue(idx);
+        int encVal = DecisionTree::encodeValue(*dt.root, pos, *ctx, dtz);
+        assert(encVal >= 0 && encVal <= 255);
+
+        const U8* leaf = interp.findLeaf(pos, 0, orig[idx].getWdl());
+        assert(leaf && (*leaf == 0x80));
+        int decVal = DTXEncoderNode::decodeLeafValue(leaf, encVal);
+        if (dtz > DTXStats::maxVal) {
+            assert(encVal == DTXStats::escapeVal);
+            assert(decVal == -1);
+            nEscape++;
+        } else {
+            assert(decVal == dtz);
+        }
+        nActive++;
+        if (encVal == 0)
+            nZero++;
+    }
+    assert(nEscape > 0);
+    assert(nZero > nActive / 8);
+}
+
+void
+Test::testScratchArray() {
+    const std::string scratchPrefix = ScratchMemory::tempFileName("test_scratch");
+    for (int f = 0; f < 2; f++) {
+        const std::string filePrefix = f ? scratchPrefix : "";
+        const U64 size = 3 * 1000 * 1000 + 17;
+        ScratchArray<U32> arr(size, filePrefix);
+        assert(arr.size() == size);
+        for (U64 i = 0; i < size; i++)
+            assert(arr[i] == 0);
+        for (U64 i = 0; i < size; i++)
+            arr[i] = (U32)(i * 7 + 3);
+        arr.release(0, size / 2);
+        for (U64 i = 0; i < size; i++)
+            assert(arr[i] == (U32)(i * 7 + 3));
+
+        BitArray bits(size, true, filePrefix);
+        bits.set(17, false);
+        assert(bits.get(16) && !bits.get(17) && bits.get(size - 1));
+
+        // Arrays with the same file prefix use different files
+        ScratchArray<U32> arr2(size, filePrefix);
+        assert(arr2[5] == 0);
+        arr2[5] = 1;
+        assert(arr[5] == 5 * 7 + 3);
+    }
+
+    // Mapping of an existing file, extending past the end of the file
+    const std::string fileName = ScratchMemory::tempFileName("test_map");
+    for (U64 fileSize : { 0, 1, 4095, 4096, 10000 }) {
+        {
+            std::ofstream outF(fileName, std::ios::binary);
+            for (U64 i = 0; i < fileSize; i++)
+                outF.put((char)(i % 251 + 1));
+        }
+        ScratchMemory mem(fileSize + 8, fileName, 0);
+        for (U64 i = 0; i < fileSize; i++)
+            assert(mem.data()[i] == i % 251 + 1);
+        for (U64 i = fileSize; i < fileSize + 8; i++)
+            assert(mem.data()[i] == 0);
+        mem.data()[0] = 0;
+    }
+    std::remove(fileName.c_str());
+}
+
 static void checkEqual(double exp, double val, double tol = 1e-6) {
     double m = std::max(exp, val);
     double maxErr = m * tol;
@@ -471,6 +1136,23 @@ static void checkEqual(double exp, double val, double tol = 1e-6) {
     assert(val <= exp + maxErr);
 }
 
+void
+Test::testBenchSymbols() {
+    for (double bits : { 0.0, 0.5, 2.0, 5.0, 8.0 }) {
+        const U64 n = 200000;
+        std::vector<U8> syms, syms2;
+        Bench::makeSymbols(n, bits, 17, syms);
+        Bench::makeSymbols(n, bits, 17, syms2);
+        assert(syms.size() == n);
+        assert(syms == syms2);
+        std::vector<U64> freq(256);
+        for (U8 s : syms)
+            freq[s]++;
+        double entr = ::entropy(freq.begin(), freq.end()) * 8 / n;
+        assert(std::abs(entr - bits) < 0.02);
+    }
+}
+
 void
 Test::testEntropy() {
     {
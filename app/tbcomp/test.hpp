@@ -3,6 +3,10 @@
 
 #include <vector>
 
+class DecisionTree;
+namespace DT {
+    class NodeFactory;
+}
 
 class Test {
 public:
@@ -12,6 +16,7 @@ private:
     // BitBuffer
     void testReadWriteBits();
     void testReadWriteU64();
+    void testStreamWriter();
 
     // Huffman
     void encodeDecode(const std::vector<int>& in);
@@ -24,13 +29,31 @@ private:
     void testSymArrayStraddle();
     void testSymArrayEmptyChunk();
     void testRePair();
+    void testRePairBlocks();
+    void testRePairSegments();
 
     // PosIndex
     void testSwapColors();
+    void testPosIterator();
 
     // ThreadPool
     void testThreadPool();
 
+    // DecisionTree
+    void computeTree(DecisionTree& dt, DT::NodeFactory& factory, int nThreads, int maxIter);
+    void testParallelStats();
+    void testAdaptiveChunks();
+    void testIndexList();
+    void testTreeInterpreter();
+    void testWdlFile();
+    void testWdlGenerate();
+    void testWdlCache();
+    void testDtzTree();
+    void testScratchArray();
+
+    // Bench
+    void testBenchSymbols();
+
     void testEntropy();
 };
 
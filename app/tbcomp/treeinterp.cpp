@@ -0,0 +1,129 @@
+#include "treeinterp.hpp"
+#include "predicates.hpp"
+#include "tbutil.hpp"
+#include "position.hpp"
+#include "moveGen.hpp"
+#include <cassert>
+
+
+TreeInterpreter::TreeInterpreter(const PosIndex& posIdx, const U8* code)
+    : posIdx(posIdx), code(code) {
+    nPieces = posIdx.numPieces();
+    for (int i = 0; i < nPieces; i++)
+        pieceType[i] = posIdx.getPieceType(i);
+}
+
+const U8*
+TreeInterpreter::findLeaf(const Position& pos, int captWdl, int wdl) const {
+    // Pieces of the same type have consecutive piece numbers, ordered by square
+    std::array<int,8> sq;
+    for (int n = 0; n < nPieces; ) {
+        U64 m = pos.pieceTypeBB(pieceType[n]);
+        while (m)
+            sq[n++] = BitBoard::extractSquare(m);
+    }
+
+    const U8* p = code;
+    while (true) {
+        const U8 op = *p++;
+        if (op & 0x80)
+            return p - 1;
+
+        bool val;
+        auto getP1 = [&p]() -> int { return *p >> 4; };
+        auto getP2 = [&p]() -> int { return *p++ & 15; };
+        auto multi = [&p](int v) -> bool { return v <= (S8)*p++; };
+        switch ((PredOp)op) {
+        case PredOp::WTM:
+            val = pos.isWhiteMove();
+            break;
+        case PredOp::INCHECK:
+            val = MoveGen::inCheck(pos);
+            break;
+        case PredOp::BPAIR_W: case PredOp::BPAIR_B: {
+            U64 b = pos.pieceTypeBB(op == (U8)PredOp::BPAIR_W ? Piece::WBISHOP : Piece::BBISHOP);
+            val = (b & BitBoard::maskDarkSq) && (b & BitBoard::maskLightSq);
+            break;
+        }
+        case PredOp::SAME_B: case PredOp::OPPO_B: {
+            U64 wb = pos.pieceTypeBB(Piece::WBISHOP);
+            U64 bb = pos.pieceTypeBB(Piece::BBISHOP);
+            U64 d = BitBoard::maskDarkSq;
+            U64 l = BitBoard::maskLightSq;
+            if (op == (U8)PredOp::SAME_B)
+                val = ((wb & d) && (bb & d)) || ((wb & l) && (bb & l));
+            else
+                val = ((wb & d) && (bb & l)) || ((wb & l) && (bb & d));
+            break;
+        }
+        case PredOp::DARKSQ:
+            val = BitBoard::maskDarkSq & (1ULL << sq[*p++]);
+            break;
+        case PredOp::KPAWNSQ: {
+            int pNo = *p++;
+            val = KingInPawnSquarePredicate::compute(pos, pieceType[pNo], sq[pNo]);
+            break;
+        }
+        case PredOp::ATTACK: {
+            int p1 = getP1(), p2 = getP2();
+            val = AttackPredicate::compute(pieceType[p1], sq[p1], sq[p2], pos.occupiedBB());
+            break;
+        }
+        case PredOp::SAMEDIAG: {
+            int p1 = getP1(), p2 = getP2();
+            val = BitBoard::bishopAttacks(sq[p1], 0) & (1ULL << sq[p2]);
+            break;
+        }
+        case PredOp::FORK: {
+            int p1 = getP1(), p2 = getP2();
+            Piece::Type forker = Piece::isWhite(pieceType[p1]) ? Piece::BKNIGHT : Piece::WKNIGHT;
+            val = ForkPredicate::compute(pos, forker, sq[p1], sq[p2]);
+            break;
+        }
+        case PredOp::PRACE:
+            val = multi(PawnRacePredicate::compute(pos));
+            break;
+        case PredOp::CAPTWDL:
+            val = multi(captWdl);
+            break;
+        case PredOp::POSWDL:
+            val = multi(wdl);
+            break;
+        case PredOp::FILE:
+            val = multi(Square::getX(sq[*p++]));
+            break;
+        case PredOp::RANK:
+            val = multi(Square::getY(sq[*p++]));
+            break;
+        case PredOp::FILEDELTA: case PredOp::FILEDIST: {
+            int p1 = getP1(), p2 = getP2();
+            int d = Square::getX(sq[p2]) - Square::getX(sq[p1]);
+            val = multi(op == (U8)PredOp::FILEDIST ? std::abs(d) : d);
+            break;
+        }
+        case PredOp::RANKDELTA: case PredOp::RANKDIST: {
+            int p1 = getP1(), p2 = getP2();
+            int d = Square::getY(sq[p2]) - Square::getY(sq[p1]);
+            val = multi(op == (U8)PredOp::RANKDIST ? std::abs(d) : d);
+            break;
+        }
+        case PredOp::KINGDIST: {
+            int p1 = getP1(), p2 = getP2();
+            val = multi(BitBoard::getKingDistance(sq[p1], sq[p2]));
+            break;
+        }
+        case PredOp::TAXIDIST: {
+            int p1 = getP1(), p2 = getP2();
+            val = multi(BitBoard::getTaxiDistance(sq[p1], sq[p2]));
+            break;
+        }
+        default:
+            assert(false);
+            return nullptr;
+        }
+
+        U64 leftSize = readVarUInt(p);
+        if (val)
+            p += leftSize;
+    }
+}
@@ -0,0 +1,40 @@
+#ifndef TREEINTERP_HPP_
+#define TREEINTERP_HPP_
+
+#include "util/util.hpp"
+#include "posindex.hpp"
+#include <array>
+
+class Position;
+
+
+/** Evaluates a decision tree serialized by DecisionTree::serialize().
+ *  Only the bytecode and the PosIndex are used, so no Node objects are
+ *  needed and there is no virtual function call overhead.
+ *
+ *  The bytecode is a pre-order traversal of the tree:
+ *  - A leaf node is an EncoderNode-specific representation whose first
+ *    byte has the most significant bit set.
+ *  - A predicate node is a PredOp opcode byte, the opcode parameters, and
+ *    for multi-valued predicates a signed limit byte. Then follows the size
+ *    in bytes of the left subtree (writeVarUInt() format), the left subtree
+ *    (predicate false) and the right subtree (predicate true). */
+class TreeInterpreter {
+public:
+    /** Constructor. "code" must live longer than this object. */
+    TreeInterpreter(const PosIndex& posIdx, const U8* code);
+
+    /** Return pointer to the leaf node data corresponding to "pos".
+     *  "captWdl" is the value of CapturePredicate for "pos". "wdl" is the
+     *  value of PosWdlPredicate for "pos", only used by DTZ trees. */
+    const U8* findLeaf(const Position& pos, int captWdl, int wdl = 0) const;
+
+private:
+    const PosIndex& posIdx;
+    const U8* code;
+    int nPieces;
+    std::array<Piece::Type,8> pieceType;
+};
+
+
+#endif /* TREEINTERP_HPP_ */
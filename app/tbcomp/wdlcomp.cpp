@@ -1,4 +1,5 @@
 #include "wdlcomp.hpp"
+#include "wdlfile.hpp"
 #include "bitarray.hpp"
 #include "chessParseError.hpp"
 #include "syzygy/rtb-probe.hpp"
@@ -8,9 +9,17 @@
 #include "textio.hpp"
 #include "threadpool.hpp"
 #include "tbpath.hpp"
+#include "util/random.hpp"
+#include "util/timeUtil.hpp"
 
 #include <fstream>
+#include <cstring>
+#include <cstdio>
+#include <algorithm>
 
+static const char cacheMagic[4] = { 'T', 'B', 'C', 'C' };
+static const int cacheVersion = 2;
+static const U64 cacheHeaderSize = 65536; // Multiple of the page size
 
 static void
 getPieces(const std::string& tbType, std::vector<int>& pieces) {
@@ -47,11 +56,30 @@ getPieces(const std::string& tbType, std::vector<int>& pieces) {
         throw ChessParseError("Invalid tbType: " + tbType);
 }
 
+/** Return true if the side to move in "pos" has at least one legal move. */
+static bool
+hasLegalMoves(Position& pos) {
+    const bool inCheck = MoveGen::inCheck(pos);
+    MoveList moves;
+    if (inCheck)
+        MoveGen::checkEvasions(pos, moves);
+    else
+        MoveGen::pseudoLegalMoves(pos, moves);
+    for (int i = 0; i < moves.size; i++)
+        if (MoveGen::isLegal(pos, moves[i], inCheck))
+            return true;
+    return false;
+}
+
 WdlCompress::WdlCompress(const std::string& tbType, bool useGini,
-                         double mergeThreshold, int samplingLogFactor)
+                         double mergeThreshold, int samplingLogFactor,
+                         const std::string& scratchDir, bool generate, int nThreads,
+                         const std::string& cacheFile)
     : useGini(useGini), mergeThreshold(mergeThreshold),
-      samplingLogFactor(samplingLogFactor) {
-    nThreads = std::thread::hardware_concurrency();
+      samplingLogFactor(samplingLogFactor), scratchDir(scratchDir), nThreads(nThreads),
+      cacheFile(cacheFile) {
+    if (this->nThreads <= 0)
+        this->nThreads = std::thread::hardware_concurrency();
     ComputerPlayer::initEngine();
     TBPath::setDefaultTBPaths();
 
@@ -70,87 +98,491 @@ WdlCompress::WdlCompress(const std::string& tbType, bool useGini,
 
     posIndex = make_unique<PosIndex>(pos);
     std::cout << "size:" << posIndex->tbSize() << std::endl;
+
+    if (generate && !(!cacheFile.empty() && std::ifstream(cacheFile)))
+        generateTable(pieces);
+}
+
+void
+WdlCompress::generateTable(const std::vector<int>& pieces) {
+    PieceCount& pc = genPieceCount;
+    for (int p : pieces) {
+        switch (p) {
+        case Piece::WQUEEN:  pc.nwq++; break;
+        case Piece::WROOK:   pc.nwr++; break;
+        case Piece::WBISHOP: pc.nwb++; break;
+        case Piece::WKNIGHT: pc.nwn++; break;
+        case Piece::BQUEEN:  pc.nbq++; break;
+        case Piece::BROOK:   pc.nbr++; break;
+        case Piece::BBISHOP: pc.nbb++; break;
+        case Piece::BKNIGHT: pc.nbn++; break;
+        default:
+            throw ChessParseError("Table generation does not support pawns");
+        }
+    }
+    if (pc.nPieces() > 5)
+        throw ChessParseError("Table generation supports at most 5 pieces");
+
+    std::cout << "Warning: Generated table ignores the 50 move rule. Cursed wins and "
+                 "blessed losses are stored as wins and losses." << std::endl;
+    ignore50 = true;
+    std::cout << "Generating table..." << std::endl;
+    S64 t0 = currentTimeMillis();
+    genTable = make_unique<VectorStorage>();
+    TBGenerator<VectorStorage> tbGen(*genTable, pc);
+    RelaxedShared<S64> maxTimeMillis(-1);
+    if (!tbGen.generate(maxTimeMillis, false, nThreads)) {
+        genTable.reset();
+        throw ChessParseError("Table generation failed");
+    }
+    S64 t1 = currentTimeMillis();
+    std::cout << "genTime:" << (t1 - t0) * 1e-3 << std::endl;
+}
+
+int
+WdlCompress::probeWdl(Position& pos, TBPosition& tbPos) const {
+    if (genTable) {
+        if (!tbPos.setPosition(pos))
+            throw ChessParseError("Generated table lookup failed, pos:" + TextIO::toFEN(pos));
+        PositionValue pv = (*genTable)[tbPos.getIndex()];
+        int n;
+        if (pv.getMateInN(n))
+            return 2;
+        if (pv.getMatedInN(n))
+            return -2;
+        if (pv.isDraw())
+            return 0;
+        throw ChessParseError("Generated table lookup failed, pos:" + TextIO::toFEN(pos));
+    }
+    int success;
+    int wdl = Syzygy::probe_wdl(pos, &success);
+    if (!success)
+        throw ChessParseError("RTB probe failed, pos:" + TextIO::toFEN(pos));
+    return wdl;
+}
+
+void
+WdlCompress::probeWdlBatch(std::vector<Position>& positions, std::vector<int>& wdl,
+                           TBPosition& tbPos, Syzygy::BlockCache& cache) const {
+    const int n = positions.size();
+    wdl.resize(n);
+    if (genTable) {
+        for (int i = 0; i < n; i++)
+            wdl[i] = probeWdl(positions[i], tbPos);
+        return;
+    }
+    std::vector<int> success(n);
+    Syzygy::probe_wdl_batch(positions.data(), n, wdl.data(), success.data(), cache);
+    for (int i = 0; i < n; i++)
+        if (!success[i])
+            throw ChessParseError("RTB probe failed, pos:" + TextIO::toFEN(positions[i]));
+}
+
+int
+WdlCompress::probeDtz(Position& pos, TBPosition& tbPos, int& wdl) const {
+    if (genTable) {
+        if (!tbPos.setPosition(pos))
+            throw ChessParseError("Generated table lookup failed, pos:" + TextIO::toFEN(pos));
+        PositionValue pv = (*genTable)[tbPos.getIndex()];
+        int n;
+        if (pv.getMateInN(n)) {
+            wdl = 2;
+            return n;
+        }
+        if (pv.getMatedInN(n)) {
+            wdl = -2;
+            return -n;
+        }
+        if (pv.isDraw()) {
+            wdl = 0;
+            return 0;
+        }
+        throw ChessParseError("Generated table lookup failed, pos:" + TextIO::toFEN(pos));
+    }
+    int success;
+    wdl = Syzygy::probe_wdl(pos, &success);
+    if (!success)
+        throw ChessParseError("RTB probe failed, pos:" + TextIO::toFEN(pos));
+    int dtz = Syzygy::probe_dtz(pos, &success);
+    if (!success)
+        throw ChessParseError("RTB probe failed, pos:" + TextIO::toFEN(pos));
+    return dtz;
 }
 
 void
 WdlCompress::wdlDump(const std::string& outFile, int maxTreeDepth, int maxCollectorNodes) {
+    auto data = prepareData();
+    std::vector<U8> treeData;
+    computeEncoded(*data, treeData, TreeParams{useGini, mergeThreshold, samplingLogFactor,
+                                               maxTreeDepth, maxCollectorNodes});
+    writeFile(*data, outFile);
+}
+
+void
+WdlCompress::wdlComp(const std::string& outFile, int maxTreeDepth, int maxCollectorNodes,
+                     U64 blockSize, U64 segmentSize) {
+    auto dataPtr = prepareData();
+    ScratchArray<WDLInfo>& data = *dataPtr;
+    std::vector<U8> treeData;
+    computeEncoded(data, treeData, TreeParams{useGini, mergeThreshold, samplingLogFactor,
+                                              maxTreeDepth, maxCollectorNodes});
+
+    if (segmentSize == 0)
+        segmentSize = data.size();
+    auto getResiduals = [&data](U64 beg, U64 end, std::vector<U8>& residuals) {
+        static_assert(sizeof(WDLInfo) == 1, "");
+        residuals.resize(end - beg);
+        std::memcpy(residuals.data(), &data[beg], end - beg);
+        data.release(beg, end);
+    };
+    std::ofstream outF(outFile, std::ios::binary);
+    WdlFile::write(outF, *posIndex, bestWtm, bestBtm, ignore50, treeData, segmentSize,
+                   blockSize, nThreads, getResiduals);
+    std::cout << "fileSize:" << outF.tellp() << std::endl;
+}
+
+void
+WdlCompress::dtzDump(const std::string& outFile, int maxTreeDepth, int maxCollectorNodes,
+                     U64 blockSize) {
     PosIndex& posIdx = *posIndex;
+    ScratchArray<DTZInfo> data(posIdx.tbSize(), scratchFile("dtzdata"));
+    BitArray active(data.size(), true, scratchFile("active"));
+    initializeDtzData(data, active);
+
+    DTXNodeFactory factory(useGini, mergeThreshold);
+    DTXUncompressedData uncompData(data.data());
+    DecisionTree dt(factory, posIdx, uncompData, active, samplingLogFactor);
+    dt.computeTree(maxTreeDepth, maxCollectorNodes, nThreads);
+
+    std::vector<U8> treeData;
+    dt.serialize(treeData);
+    std::cout << "treeSize:" << treeData.size() << std::endl;
+
+    std::vector<U8> residuals(data.size());
+    U64 nEscapes = 0;
+    for (U64 idx = 0; idx < data.size(); idx++) {
+        int encVal = data[idx].getData();
+        if (encVal == DTXStats::escapeVal)
+            nEscapes++;
+        residuals[idx] = encVal;
+    }
+    data.release(0, data.size());
+    std::cout << "escapes:" << nEscapes << std::endl;
+
+    std::cout << "Writing..." << std::endl;
+    {
+        std::ofstream outF(outFile);
+        outF.write((const char*)residuals.data(), residuals.size());
+    }
+
+    BitBufferWriter bw;
+    {
+        RePairComp comp(residuals, 8, 65535);
+        comp.toBitBuf(bw, blockSize);
+    }
+    std::cout << "compSize:" << bw.getBuf().size() << std::endl;
+}
+
+void
+WdlCompress::wdlSweep(const SweepParams& params, U64 blockSize) {
+    const U64 size = posIndex->tbSize();
+
+    // Without a cache file, keep an unmodified copy of the prepared data
+    std::unique_ptr<ScratchArray<WDLInfo>> orig = prepareData();
+    if (!cacheFile.empty())
+        orig.reset();
+
+    struct Result {
+        TreeParams params;
+        U64 treeSize;
+        U64 compSize;
+        double time;
+    };
+    auto print = [](const Result& r) {
+        const TreeParams& p = r.params;
+        std::cout << "sweep d:" << p.maxTreeDepth << " c:" << p.maxCollectorNodes
+                  << " th:" << p.mergeThreshold << " g:" << (p.useGini ? 1 : 0)
+                  << " s:" << p.samplingLogFactor << " treeSize:" << r.treeSize
+                  << " compSize:" << r.compSize << " totSize:" << r.treeSize + r.compSize
+                  << " time:" << r.time << std::endl;
+    };
+
+    std::vector<TreeParams> configs;
+    for (int depth : params.maxTreeDepth)
+        for (int nColl : params.maxCollectorNodes)
+            for (double threshold : params.mergeThreshold)
+                for (int gini : params.useGini)
+                    for (int sampling : params.samplingLogFactor)
+                        configs.push_back(TreeParams{gini != 0, threshold, sampling,
+                                                     depth, nColl});
+
+    std::vector<Result> results;
+    for (const TreeParams& config : configs) {
+        Result r;
+        r.params = config;
+        double t0 = currentTime();
+        std::vector<U8> treeData;
+        std::vector<U8> residuals(size);
+        {
+            std::unique_ptr<ScratchArray<WDLInfo>> data;
+            if (orig) {
+                data = ::make_unique<ScratchArray<WDLInfo>>(size, scratchFile("wdlsweep"));
+                std::memcpy(data->data(), orig->data(), size * sizeof(WDLInfo));
+            } else {
+                data = readCache();
+            }
+            computeEncoded(*data, treeData, r.params);
+            static_assert(sizeof(WDLInfo) == 1, "");
+            std::memcpy(residuals.data(), data->data(), size);
+        }
+        BitBufferWriter bw;
+        {
+            RePairComp comp(residuals, 8, 65535);
+            comp.toBitBuf(bw, blockSize);
+        }
+        r.treeSize = treeData.size();
+        r.compSize = bw.getBuf().size();
+        r.time = currentTime() - t0;
+        print(r);
+        results.push_back(r);
+    }
+
+    std::stable_sort(results.begin(), results.end(), [](const Result& a, const Result& b) {
+        return a.treeSize + a.compSize < b.treeSize + b.compSize;
+    });
+    std::cout << "\nSorted by totSize:" << std::endl;
+    for (const Result& r : results)
+        print(r);
+}
+
+void
+WdlCompress::wdlProbe(const std::string& inFile, U64 nPos) {
+    ComputerPlayer::initEngine();
+    TBPath::setDefaultTBPaths();
+
+    std::vector<U8> fileData;
+    {
+        std::ifstream inF(inFile, std::ios::binary);
+        if (!inF)
+            throw ChessParseError("Failed to open file: " + inFile);
+        inF.seekg(0, std::ios::end);
+        fileData.resize(inF.tellg());
+        inF.seekg(0, std::ios::beg);
+        inF.read((char*)fileData.data(), fileData.size());
+    }
+    std::cout << "fileSize:" << fileData.size() << std::endl;
+    WdlFile wdlFile(std::move(fileData));
+    const PosIndex& posIdx = wdlFile.getPosIndex();
+    const bool ignore50 = wdlFile.ignores50MoveRule();
+    if (ignore50)
+        std::cout << "File ignores the 50 move rule, treating cursed RTB results as "
+                     "wins and losses" << std::endl;
+
+    // Select random valid positions
+    std::vector<Position> positions;
+    Random rnd(currentTimeMillis());
+    Position pos;
+    while (positions.size() < nPos) {
+        U64 idx = rnd.nextU64() % posIdx.tbSize();
+        if (!posIdx.index2Pos(idx, pos) || MoveGen::canTakeKing(pos))
+            continue;
+        positions.push_back(pos);
+    }
+
+    // The capture search is part of the probe cost, since the Syzygy probe
+    // also searches captures internally
+    std::vector<int> wdlVals(nPos);
+    S64 t0 = currentTimeMillis();
+    for (U64 i = 0; i < nPos; i++) {
+        pos = positions[i];
+        int captWdl = wdlBestCapture(pos);
+        if (!pos.isWhiteMove())
+            captWdl = -captWdl;
+        wdlVals[i] = wdlFile.probe(pos, captWdl);
+    }
+    S64 t1 = currentTimeMillis();
+    U64 nMismatch = 0;
+    for (U64 i = 0; i < nPos; i++) {
+        int success;
+        int wdl = Syzygy::probe_wdl(positions[i], &success);
+        if (!success)
+            throw ChessParseError("RTB probe failed, pos:" + TextIO::toFEN(positions[i]));
+        if (ignore50 && (wdl == 1 || wdl == -1))
+            wdl *= 2;
+        if (wdl != wdlVals[i]) {
+            if (nMismatch++ < 10)
+                std::cout << "mismatch: wdl:" << wdlVals[i] << " rtb:" << wdl
+                          << " fen:" << TextIO::toFEN(positions[i]) << std::endl;
+        }
+    }
+    S64 t2 = currentTimeMillis();
+    std::cout << "nPos:" << nPos << " mismatch:" << nMismatch << std::endl;
+    std::cout << "probeTime:" << (t1 - t0) * 1e3 / nPos << "us"
+              << " rtbTime:" << (t2 - t1) * 1e3 / nPos << "us" << std::endl;
+}
+
+std::unique_ptr<ScratchArray<WDLInfo>>
+WdlCompress::prepareData() {
+    if (!cacheFile.empty() && std::ifstream(cacheFile))
+        return readCache();
+
+    auto data = ::make_unique<ScratchArray<WDLInfo>>(posIndex->tbSize(), scratchFile("wdldata"));
+    initializeData(*data);
+    computeOptimalCaptures(*data);
+    if (!cacheFile.empty())
+        writeCache(*data);
+    return data;
+}
+
+void
+WdlCompress::writeCache(const ScratchArray<WDLInfo>& data) const {
+    std::cout << "Writing cache file..." << std::endl;
+    const PosIndex& posIdx = *posIndex;
+    std::vector<U8> header;
+    header.insert(header.end(), cacheMagic, cacheMagic + sizeof(cacheMagic));
+    header.push_back(cacheVersion);
+    const int nPieces = posIdx.numPieces();
+    header.push_back(nPieces);
+    for (int i = 0; i < nPieces; i++)
+        header.push_back(posIdx.getPieceType(i));
+    header.push_back(bestWtm + 2);
+    header.push_back(bestBtm + 2);
+    header.push_back(ignore50 ? 1 : 0);
+    header.resize(cacheHeaderSize, 0);
+
+    // Write to a temporary file first, so an interrupted write does not
+    // leave an incomplete cache file
+    const std::string tmpFile = cacheFile + ".tmp";
+    {
+        std::ofstream outF(tmpFile, std::ios::binary);
+        outF.write((const char*)header.data(), header.size());
+        static_assert(sizeof(WDLInfo) == 1, "");
+        const U64 size = data.size();
+        const U64 chunkSize = 64*1024*1024;
+        for (U64 b = 0; b < size; b += chunkSize) {
+            U64 end = std::min(b + chunkSize, size);
+            outF.write((const char*)&data[b], end - b);
+        }
+        if (!outF)
+            throw ChessParseError("Failed to write cache file " + tmpFile);
+    }
+    if (std::rename(tmpFile.c_str(), cacheFile.c_str()) != 0)
+        throw ChessParseError("Failed to rename cache file " + tmpFile);
+}
+
+std::unique_ptr<ScratchArray<WDLInfo>>
+WdlCompress::readCache() {
+    const PosIndex& posIdx = *posIndex;
     const U64 size = posIdx.tbSize();
-    std::vector<WDLInfo> data(size);
+    std::ifstream inF(cacheFile, std::ios::binary);
+    std::vector<U8> header(cacheHeaderSize);
+    inF.read((char*)header.data(), header.size());
+    if (!inF || !std::equal(cacheMagic, cacheMagic + sizeof(cacheMagic), header.begin()) ||
+            header[4] != cacheVersion)
+        throw ChessParseError("Not a WDL cache file: " + cacheFile);
+    const int nPieces = posIdx.numPieces();
+    bool match = header[5] == nPieces;
+    for (int i = 0; i < nPieces && match; i++)
+        if (header[6 + i] != posIdx.getPieceType(i))
+            match = false;
+    inF.seekg(0, std::ios::end);
+    if (!match || (U64)inF.tellg() != cacheHeaderSize + size * sizeof(WDLInfo))
+        throw ChessParseError("Cache file is for a different tablebase: " + cacheFile);
+    bestWtm = header[6 + nPieces] - 2;
+    bestBtm = header[7 + nPieces] - 2;
+    ignore50 = header[8 + nPieces] != 0;
+    std::cout << "Using cache file " << cacheFile << std::endl;
+    std::cout << "bestWtm:" << bestWtm << " bestBtm:" << bestBtm
+              << " ignore50:" << ignore50 << std::endl;
+    return ::make_unique<ScratchArray<WDLInfo>>(size, cacheFile, cacheHeaderSize);
+}
 
-    initializeData(data);
-    computeOptimalCaptures(data);
+void
+WdlCompress::computeEncoded(ScratchArray<WDLInfo>& data, std::vector<U8>& treeData,
+                            const TreeParams& params) {
+    PosIndex& posIdx = *posIndex;
 
     std::array<U64,8> cnt{};
     computeStatistics(data, cnt);
-    BitArray active(data.size(), true);
+    BitArray active(data.size(), true, scratchFile("active"));
     replaceDontCares(data, active);
 
-    WDLNodeFactory factory(useGini, mergeThreshold);
-    WDLUncompressedData uncompData(data);
-    DecisionTree dt(factory, posIdx, uncompData, active, samplingLogFactor);
-    dt.computeTree(maxTreeDepth, maxCollectorNodes, nThreads);
+    WDLNodeFactory factory(params.useGini, params.mergeThreshold);
+    WDLUncompressedData uncompData(data.data());
+    DecisionTree dt(factory, posIdx, uncompData, active, params.samplingLogFactor);
+    dt.computeTree(params.maxTreeDepth, params.maxCollectorNodes, nThreads);
 
-    writeFile(data, outFile);
+    treeData.clear();
+    dt.serialize(treeData);
+    std::cout << "treeSize:" << treeData.size() << std::endl;
 }
 
 void
-WdlCompress::initializeData(std::vector<WDLInfo>& data) {
+WdlCompress::initializeData(ScratchArray<WDLInfo>& data) {
     PosIndex& posIdx = *posIndex;
     const U64 size = posIdx.tbSize();
     const U64 batchSize = std::max((U64)128*1024, (size + 1023) / 1024);
     ThreadPool<std::pair<int,int>> pool(nThreads);
     int nTasks = 0;
     for (U64 b = 0; b < size; b += batchSize) {
-        auto task = [&posIdx,&data,size,batchSize,b](int workerNo) {
+        auto task = [this,&posIdx,&data,size,batchSize,b](int workerNo) {
             int bestWtm = -2;
             int bestBtm = 2;
             U64 end = std::min(b + batchSize, size);
+            TBPosition tbPos(genPieceCount);
+            auto probe = [this,&tbPos](Position& pos) { return probeWdl(pos, tbPos); };
+
+            // Positions whose value must be probed, probed in batches
+            const size_t maxPending = 4096;
+            std::vector<Position> pending;
+            std::vector<U64> pendingIdx;
+            std::vector<int> pendingWdl;
+            Syzygy::BlockCache cache;
+            auto probePending = [&]() {
+                probeWdlBatch(pending, pendingWdl, tbPos, cache);
+                for (size_t i = 0; i < pending.size(); i++) {
+                    int wdl = pendingWdl[i];
+                    if (pending[i].isWhiteMove()) {
+                        bestWtm = std::max(bestWtm, wdl);
+                    } else {
+                        wdl = -wdl;
+                        bestBtm = std::min(bestBtm, wdl);
+                    }
+                    data[pendingIdx[i]].setWdl(wdl);
+                }
+                pending.clear();
+                pendingIdx.clear();
+            };
+
             Position pos;
+            PosIterator posIter(posIdx, pos);
             for (U64 idx = b; idx < end; idx++) {
-                bool valid = posIdx.index2Pos(idx, pos);
+                bool valid = posIter.setIndex(idx);
                 if (valid && MoveGen::canTakeKing(pos))
                     valid = false;
                 int wdl;
                 if (!valid) {
                     wdl = 3; // Invalid
                 } else {
-                    const bool inCheck = MoveGen::inCheck(pos);
-                    MoveList moves;
-                    if (inCheck)
-                        MoveGen::checkEvasions(pos, moves);
-                    else
-                        MoveGen::pseudoLegalMoves(pos, moves);
-                    bool hasLegalMoves = false;
-                    for (int i = 0; i < moves.size; i++) {
-                        if (MoveGen::isLegal(pos, moves[i], inCheck)) {
-                            hasLegalMoves = true;
-                            break;
-                        }
-                    }
-                    if (!hasLegalMoves) {
+                    if (!hasLegalMoves(pos)) {
                         wdl = 4; // Game end
                     } else {
-                        int captWdl = wdlBestCapture(pos);
+                        int captWdl = bestCapture(pos, probe);
                         data[idx].setCaptureWdl(captWdl);
                         if (captWdl == (pos.isWhiteMove() ? 2 : -2)) {
                             wdl = captWdl;
                         } else {
-                            int success;
-                            wdl = Syzygy::probe_wdl(pos, &success);
-                            if (!success)
-                                throw ChessParseError("RTB probe failed, pos:" + TextIO::toFEN(pos));
-                            if (pos.isWhiteMove()) {
-                                bestWtm = std::max(bestWtm, wdl);
-                            } else {
-                                wdl = -wdl;
-                                bestBtm = std::min(bestBtm, wdl);
-                            }
+                            pending.push_back(pos);
+                            pendingIdx.push_back(idx);
+                            if (pending.size() >= maxPending)
+                                probePending();
+                            continue;
                         }
                     }
                 }
                 data[idx].setWdl(wdl);
             }
+            probePending();
             return std::make_pair(bestWtm, bestBtm);
         };
         pool.addTask(task);
@@ -171,8 +603,72 @@ WdlCompress::initializeData(std::vector<WDLInfo>& data) {
     std::cout << "bestWtm:" << bestWtm << " bestBtm:" << bestBtm << std::endl;
 }
 
+void
+WdlCompress::initializeDtzData(ScratchArray<DTZInfo>& data, BitArray& active) {
+    PosIndex& posIdx = *posIndex;
+    const U64 size = posIdx.tbSize();
+    const U64 batchSize = std::max((U64)128*1024, ((size + 1023) / 1024) & ~63);
+    ThreadPool<std::array<U64,2>> pool(nThreads);
+    int nTasks = 0;
+    for (U64 b = 0; b < size; b += batchSize) {
+        auto task = [this,&posIdx,&data,&active,size,batchSize,b](int workerNo) {
+            std::array<U64,2> cnt{}; // Number of active positions, max dtz
+            U64 end = std::min(b + batchSize, size);
+            TBPosition tbPos(genPieceCount);
+            Position pos;
+            PosIterator posIter(posIdx, pos);
+            for (U64 idx = b; idx < end; idx++) {
+                bool valid = posIter.setIndex(idx);
+                if (valid && MoveGen::canTakeKing(pos))
+                    valid = false;
+                int wdl = 0;
+                int dtz = 0;
+                if (valid && hasLegalMoves(pos))
+                    dtz = std::abs(probeDtz(pos, tbPos, wdl));
+                if (wdl == 0) {
+                    active.set(idx, false);
+                    continue;
+                }
+                assert(dtz > 0);
+                data[idx].setWdl(pos.isWhiteMove() ? wdl : -wdl);
+                data[idx].setDtx(dtz);
+                cnt[0]++;
+                cnt[1] = std::max(cnt[1], (U64)dtz);
+            }
+            return cnt;
+        };
+        pool.addTask(task);
+        nTasks++;
+    }
+    std::cout << "nTasks:" << nTasks << std::endl;
+    U64 nActive = 0;
+    U64 maxDtz = 0;
+    for (int i = 0; i < nTasks; i++) {
+        std::array<U64,2> res{};
+        pool.getResult(res);
+        nActive += res[0];
+        maxDtz = std::max(maxDtz, res[1]);
+        if ((i+1) * 80 / nTasks > i * 80 / nTasks)
+            std::cout << "." << std::flush;
+    }
+    std::cout << std::endl;
+    std::cout << "active:" << nActive << " maxDtz:" << maxDtz << std::endl;
+}
+
 int
 WdlCompress::wdlBestCapture(Position& pos) {
+    return bestCapture(pos, [](Position& pos) {
+        int success;
+        int wdl = Syzygy::probe_wdl(pos, &success);
+        if (!success)
+            throw ChessParseError("RTB probe failed, pos:" + TextIO::toFEN(pos));
+        return wdl;
+    });
+}
+
+template <typename Probe>
+int
+WdlCompress::bestCapture(Position& pos, Probe probe) {
     const bool inCheck = MoveGen::inCheck(pos);
     MoveList moves;
     if (inCheck)
@@ -187,10 +683,7 @@ WdlCompress::wdlBestCapture(Position& pos) {
             continue;
         UndoInfo ui;
         pos.makeMove(m, ui);
-        int success;
-        int wdl = -Syzygy::probe_wdl(pos, &success);
-        if (!success)
-            throw ChessParseError("RTB probe failed, pos:" + TextIO::toFEN(pos));
+        int wdl = -probe(pos);
         pos.unMakeMove(m, ui);
         if (wdl > best) {
             best = wdl;
@@ -202,7 +695,7 @@ WdlCompress::wdlBestCapture(Position& pos) {
 }
 
 void
-WdlCompress::computeOptimalCaptures(std::vector<WDLInfo>& data) const {
+WdlCompress::computeOptimalCaptures(ScratchArray<WDLInfo>& data) const {
     PosIndex& posIdx = *posIndex;
     const U64 size = posIdx.tbSize();
     const U64 batchSize = std::max((U64)128*1024, (size + 1023) / 1024);
@@ -212,10 +705,11 @@ WdlCompress::computeOptimalCaptures(std::vector<WDLInfo>& data) const {
         auto task = [this,&posIdx,&data,size,batchSize,b](int workerNo) {
             U64 end = std::min(b + batchSize, size);
             Position pos;
+            PosIterator posIter(posIdx, pos);
             for (U64 idx = b; idx < end; idx++) {
                 if (data[idx].getWdl() == 3 || data[idx].getWdl() == 4)
                     continue;
-                posIdx.index2Pos(idx, pos);
+                posIter.setIndex(idx);
                 int captWdl = data[idx].getCaptureWdl();
                 if (captWdl == (pos.isWhiteMove() ? bestWtm : bestBtm))
                     data[idx].setWdl(5); // Optimal capture
@@ -235,7 +729,7 @@ WdlCompress::computeOptimalCaptures(std::vector<WDLInfo>& data) const {
 }
 
 void
-WdlCompress::computeStatistics(const std::vector<WDLInfo>& data,
+WdlCompress::computeStatistics(const ScratchArray<WDLInfo>& data,
                                std::array<U64,8>& cnt) const {
     const U64 size = data.size();
     const U64 batchSize = std::max((U64)128*1024, (size + 1023) / 1024);
@@ -275,7 +769,7 @@ WdlCompress::computeStatistics(const std::vector<WDLInfo>& data,
 }
 
 void
-WdlCompress::replaceDontCares(std::vector<WDLInfo>& data, BitArray& active) {
+WdlCompress::replaceDontCares(ScratchArray<WDLInfo>& data, BitArray& active) {
     const U64 size = data.size();
     const U64 batchSize = std::max((U64)128*1024, ((size + 1023) / 1024) & ~63);
     ThreadPool<int> pool(nThreads);
@@ -298,10 +792,23 @@ WdlCompress::replaceDontCares(std::vector<WDLInfo>& data, BitArray& active) {
 }
 
 void
-WdlCompress::writeFile(const std::vector<WDLInfo>& data,
+WdlCompress::writeFile(ScratchArray<WDLInfo>& data,
                        const std::string& outFile) const {
     std::cout << "Writing..." << std::endl;
     std::ofstream outF(outFile);
     static_assert(sizeof(WDLInfo) == 1, "");
-    outF.write((const char*)data.data(), data.size());
+    const U64 size = data.size();
+    const U64 chunkSize = 64*1024*1024;
+    for (U64 b = 0; b < size; b += chunkSize) {
+        U64 end = std::min(b + chunkSize, size);
+        outF.write((const char*)&data[b], end - b);
+        data.release(b, end);
+    }
+}
+
+std::string
+WdlCompress::scratchFile(const std::string& name) const {
+    if (scratchDir.empty())
+        return "";
+    return scratchDir + "/tbcomp_" + name + "_";
 }
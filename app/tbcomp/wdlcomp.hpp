@@ -4,6 +4,10 @@
 #include "posindex.hpp"
 #include "decisiontree.hpp"
 #include "wdlnode.hpp"
+#include "dtxnode.hpp"
+#include "scratcharray.hpp"
+#include "tbgen.hpp"
+#include "syzygy/rtb-probe.hpp"
 #include <string>
 #include <memory>
 
@@ -12,29 +16,144 @@ class BitArray;
 
 /** Compress a WDL tablebase file. */
 class WdlCompress {
+    friend class Test;
+    friend class Bench;
 public:
+    /** Constructor. If "scratchDir" is not empty, large temporary arrays are
+     *  stored in memory mapped files in that directory. If "generate" is true,
+     *  WDL values are computed by an in-memory retrograde analysis instead of
+     *  probing Syzygy tablebases. This is only possible for pawnless classes
+     *  with at most 5 pieces, and the 50 move rule is ignored, so cursed wins
+     *  and blessed losses become wins and losses. Files written from such
+     *  data are flagged, see WdlFile. "nThreads" is
+     *  the number of threads to use, or 0 to use all hardware threads.
+     *  If "cacheFile" is not empty, the prepared WDL data is read from that
+     *  file if it exists, otherwise it is computed and written to the file.
+     *  If the cache file exists, no table is generated. */
     WdlCompress(const std::string& tbType, bool useGini, double mergeThreshold,
-                int samplingLogFactor);
+                int samplingLogFactor, const std::string& scratchDir,
+                bool generate = false, int nThreads = 0,
+                const std::string& cacheFile = "");
 
+    /** Compute decision tree and write the encoded values to "outFile",
+     *  one byte per position. */
     void wdlDump(const std::string& outFile, int maxTreeDepth, int maxCollectorNodes);
 
-private:
-    void initializeData(std::vector<WDLInfo>& data);
+    /** Compute decision tree and write a WdlFile to "outFile". The residuals
+     *  are compressed in segments of "segmentSize" positions, or as one
+     *  segment if segmentSize is 0. */
+    void wdlComp(const std::string& outFile, int maxTreeDepth, int maxCollectorNodes,
+                 U64 blockSize, U64 segmentSize);
+
+    /** Compute decision tree for DTZ values and write the encoded values to
+     *  "outFile", one byte per position. Values larger than DTXStats::maxVal
+     *  are encoded as DTXStats::escapeVal. Also reports the size of the
+     *  re-pair compressed encoded values. If the table is generated in
+     *  memory, distance to mate is used instead of DTZ. */
+    void dtzDump(const std::string& outFile, int maxTreeDepth, int maxCollectorNodes,
+                 U64 blockSize);
+
+    /** Parameter values to try in wdlSweep(). */
+    struct SweepParams {
+        std::vector<int> maxTreeDepth;
+        std::vector<int> maxCollectorNodes;
+        std::vector<double> mergeThreshold;
+        std::vector<int> useGini;           // 0 or 1
+        std::vector<int> samplingLogFactor; // Negative for adaptive sampling
+    };
+
+    /** Compute a decision tree for each combination of parameter values in
+     *  "params", ignoring the parameters given to the constructor. The WDL
+     *  data is prepared only once. For each combination the tree size and the
+     *  re-pair compressed size of the residuals, using "blockSize", is
+     *  reported. */
+    void wdlSweep(const SweepParams& params, U64 blockSize);
+
+    /** Probe "nPos" random positions in WdlFile "inFile" and compare the
+     *  results and probe times with Syzygy tablebases. The WdlFile probe time
+     *  includes computing the best capture score using Syzygy tablebases. */
+    static void wdlProbe(const std::string& inFile, U64 nPos);
+
     /** Return WDL score (white perspective) for best capture. */
     static int wdlBestCapture(Position& pos);
-    void computeOptimalCaptures(std::vector<WDLInfo>& data) const;
-    void computeStatistics(const std::vector<WDLInfo>& data, std::array<U64,8>& cnt) const;
-    void replaceDontCares(std::vector<WDLInfo>& data, BitArray& active);
-    void writeFile(const std::vector<WDLInfo>& data, const std::string& outFile) const;
+
+private:
+    /** Return WDL score (white perspective) for best capture in "pos".
+     *  probe(pos) must return the WDL score from the side to move perspective. */
+    template <typename Probe>
+    static int bestCapture(Position& pos, Probe probe);
+
+    /** Return WDL score for "pos" from the side to move perspective, using
+     *  the generated table if available, otherwise Syzygy tablebases.
+     *  "tbPos" is used as scratch space for generated table lookups. */
+    int probeWdl(Position& pos, TBPosition& tbPos) const;
+
+    /** Set wdl[i] to probeWdl(positions[i], tbPos) for all i. Syzygy probes
+     *  are done by Syzygy::probe_wdl_batch(), using "cache". */
+    void probeWdlBatch(std::vector<Position>& positions, std::vector<int>& wdl,
+                       TBPosition& tbPos, Syzygy::BlockCache& cache) const;
+
+    /** Return DTZ value for "pos" from the side to move perspective and set
+     *  "wdl" to the WDL score. If the generated table is used, the distance
+     *  to mate is returned instead. */
+    int probeDtz(Position& pos, TBPosition& tbPos, int& wdl) const;
+
+    /** Compute the WDL table for the current tablebase class using TBGenerator. */
+    void generateTable(const std::vector<int>& pieces);
+
+    /** Decision tree parameters. */
+    struct TreeParams {
+        bool useGini;
+        double mergeThreshold;
+        int samplingLogFactor;
+        int maxTreeDepth;
+        int maxCollectorNodes;
+    };
+
+    /** Return WDL data for all positions, as computed by initializeData() and
+     *  computeOptimalCaptures(). If a cache file is used, the data is mapped
+     *  from the cache file, and modifications are not written back. */
+    std::unique_ptr<ScratchArray<WDLInfo>> prepareData();
+
+    /** Write "data", bestWtm/bestBtm and ignore50 to the cache file. */
+    void writeCache(const ScratchArray<WDLInfo>& data) const;
+    /** Map data from the cache file and set bestWtm/bestBtm/ignore50. Throws
+     *  ChessParseError if the file is not a cache file for this tablebase class. */
+    std::unique_ptr<ScratchArray<WDLInfo>> readCache();
+
+    /** Compute decision tree and encode all positions. "data" must contain
+     *  prepared data, see prepareData(). On return, "data" contains the
+     *  encoded values and "treeData" the serialized tree. */
+    void computeEncoded(ScratchArray<WDLInfo>& data, std::vector<U8>& treeData,
+                        const TreeParams& params);
+    void initializeData(ScratchArray<WDLInfo>& data);
+    /** Set DTZ values and WDL scores (white perspective) for all positions.
+     *  Invalid positions, positions without legal moves and draws are set
+     *  to inactive. */
+    void initializeDtzData(ScratchArray<DTZInfo>& data, BitArray& active);
+    void computeOptimalCaptures(ScratchArray<WDLInfo>& data) const;
+    void computeStatistics(const ScratchArray<WDLInfo>& data, std::array<U64,8>& cnt) const;
+    void replaceDontCares(ScratchArray<WDLInfo>& data, BitArray& active);
+    void writeFile(ScratchArray<WDLInfo>& data, const std::string& outFile) const;
+
+    /** Return scratch file name prefix for a temporary array, or an empty
+     *  string if the array shall be stored in memory. */
+    std::string scratchFile(const std::string& name) const;
 
     const bool useGini;
     const double mergeThreshold;
     const int samplingLogFactor;
+    const std::string scratchDir;
     int nThreads;
+    const std::string cacheFile;
     std::unique_ptr<PosIndex> posIndex;
 
+    PieceCount genPieceCount{};           // Piece counts for generated table
+    std::unique_ptr<VectorStorage> genTable; // Generated table, or null to use Syzygy
+
     int bestWtm = -2;     // Score of best position for white when white's turn to move
     int bestBtm = 2;      // Score of best position for black when blacks' turn to move
+    bool ignore50 = false; // True if WDL values ignore the 50 move rule
 };
 
 
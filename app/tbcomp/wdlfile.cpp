@@ -0,0 +1,145 @@
+#include "wdlfile.hpp"
+#include "wdlnode.hpp"
+#include "tbutil.hpp"
+#include "chessParseError.hpp"
+#include "position.hpp"
+#include "moveGen.hpp"
+#include <cstring>
+#include <iostream>
+
+
+static const char magic[4] = { 'T', 'B', 'C', 'W' };
+static const int version = 3;
+static const int flagIgnore50 = 1;
+
+
+void
+WdlFile::write(std::ostream& os, const PosIndex& posIdx, int bestWtm, int bestBtm,
+               bool ignore50, const std::vector<U8>& tree, U64 segmentSize, U64 blockSize, int nThreads,
+               const std::function<void(U64,U64,std::vector<U8>&)>& getResiduals) {
+    std::vector<U8> out;
+    out.insert(out.end(), magic, magic + sizeof(magic));
+    out.push_back(version);
+    out.push_back(ignore50 ? flagIgnore50 : 0);
+
+    const int nPieces = posIdx.numPieces();
+    out.push_back(nPieces);
+    for (int i = 0; i < nPieces; i++)
+        out.push_back(posIdx.getPieceType(i));
+    out.push_back(bestWtm + 2);
+    out.push_back(bestBtm + 2);
+
+    writeVarUInt(tree.size(), out);
+    out.insert(out.end(), tree.begin(), tree.end());
+
+    writeVarUInt(segmentSize, out);
+    os.write((const char*)out.data(), out.size());
+
+    const U64 size = posIdx.tbSize();
+    RePairComp::compressSegments(size, segmentSize, 8, 65535, blockSize, nThreads, getResiduals,
+                                 [&os](const std::vector<U8>& buf) {
+        std::vector<U8> sizeBuf;
+        writeVarUInt(buf.size(), sizeBuf);
+        os.write((const char*)sizeBuf.data(), sizeBuf.size());
+        os.write((const char*)buf.data(), buf.size());
+    });
+    if (!os)
+        throw ChessParseError("Failed to write WDL file");
+}
+
+WdlFile::WdlFile(std::vector<U8>&& data)
+    : fileData(std::move(data)) {
+    const U8* ptr = fileData.data();
+    const U8* end = ptr + fileData.size();
+    auto check = [&ptr,end](U64 size) {
+        if ((U64)(end - ptr) < size)
+            throw ChessParseError("Truncated WDL file");
+    };
+
+    check(sizeof(magic) + 3);
+    if (std::memcmp(ptr, magic, sizeof(magic)) != 0)
+        throw ChessParseError("Not a WDL file");
+    ptr += sizeof(magic);
+    if (*ptr++ != version)
+        throw ChessParseError("Unsupported WDL file version");
+    const int flags = *ptr++;
+    if (flags & ~flagIgnore50)
+        throw ChessParseError("Unsupported WDL file flags");
+    ignore50 = (flags & flagIgnore50) != 0;
+
+    const int nPieces = *ptr++;
+    const int squares[] = { A2, B2, C2, A3, B3, C3, A4, B4 };
+    if (nPieces < 2 || nPieces > (int)COUNT_OF(squares))
+        throw ChessParseError("Invalid number of pieces");
+    check(nPieces + 2);
+    Position pos;
+    for (int i = 0; i < nPieces; i++) {
+        int p = *ptr++;
+        if (p <= Piece::EMPTY || p > Piece::BPAWN)
+            throw ChessParseError("Invalid piece type");
+        pos.setPiece(squares[i], p);
+    }
+    posIdx = make_unique<PosIndex>(pos);
+    bestWtm = *ptr++ - 2;
+    bestBtm = *ptr++ - 2;
+
+    check(1);
+    U64 treeSize = readVarUInt(ptr);
+    check(treeSize);
+    interp = make_unique<TreeInterpreter>(*posIdx, ptr);
+    ptr += treeSize;
+
+    check(1);
+    segmentSize = readVarUInt(ptr);
+    if (segmentSize == 0)
+        throw ChessParseError("Invalid segment size");
+    const U64 nSegments = (posIdx->tbSize() + segmentSize - 1) / segmentSize;
+    for (U64 i = 0; i < nSegments; i++) {
+        check(1);
+        U64 residualSize = readVarUInt(ptr);
+        check(residualSize);
+        residuals.push_back(make_unique<RePairDeComp>(ptr));
+        ptr += residualSize;
+    }
+}
+
+int
+WdlFile::probe(const Position& pos, int captWdl) const {
+    Position p(pos);
+    {
+        const bool inCheck = MoveGen::inCheck(p);
+        MoveList moves;
+        if (inCheck)
+            MoveGen::checkEvasions(p, moves);
+        else
+            MoveGen::pseudoLegalMoves(p, moves);
+        bool hasLegalMoves = false;
+        for (int i = 0; i < moves.size; i++) {
+            if (MoveGen::isLegal(p, moves[i], inCheck)) {
+                hasLegalMoves = true;
+                break;
+            }
+        }
+        if (!hasLegalMoves)
+            return inCheck ? -2 : 0;
+    }
+    if (captWdl >= 2)
+        return captWdl;
+
+    // Use the position the decision tree was computed for
+    U64 idx = posIdx->pos2Index(p);
+    posIdx->index2Pos(idx, p);
+    const bool wtm = p.isWhiteMove();
+    if (!wtm)
+        captWdl = -captWdl;
+
+    int wdl;
+    if (captWdl == (wtm ? bestWtm : bestBtm)) {
+        wdl = captWdl;
+    } else {
+        const U8* leaf = interp->findLeaf(p, captWdl);
+        int encVal = (*residuals[idx / segmentSize])[idx % segmentSize];
+        wdl = WDLEncoderNode::decodeLeafValue(leaf, wtm, captWdl, encVal);
+    }
+    return wtm ? wdl : -wdl;
+}
@@ -0,0 +1,69 @@
+#ifndef WDLFILE_HPP_
+#define WDLFILE_HPP_
+
+#include "util/util.hpp"
+#include "posindex.hpp"
+#include "treeinterp.hpp"
+#include "repair.hpp"
+#include <vector>
+#include <memory>
+#include <functional>
+#include <ostream>
+
+class Position;
+
+
+/** A compressed WDL tablebase file for one material configuration. The file
+ *  only stores what is needed in addition to the best capture score, so
+ *  probing requires the WDL scores of the tables reachable by captures, for
+ *  example from Syzygy tablebases. The file contains:
+ *  - A header: magic number, format version, flags, piece types, bestWtm,
+ *    bestBtm. Flag bit 0 is set if the WDL values ignore the 50 move rule,
+ *    in which case the file is not equivalent to a Syzygy WDL table.
+ *  - The decision tree, serialized by DecisionTree::serialize().
+ *  - The decision tree residuals (WDLEncoderNode encoded values) for all
+ *    positions. The residuals are divided in segments, each compressed
+ *    independently by RePairComp using a block index.
+ *  Sizes and small integers are stored in writeVarUInt() format. */
+class WdlFile {
+public:
+    /** Write file contents to "os". "bestWtm" and "bestBtm" are the best
+     *  possible non-capture scores, see WdlCompress. "ignore50" is true if
+     *  the WDL values were computed without the 50 move rule, so that cursed
+     *  wins and blessed losses are stored as wins and losses. The residuals are
+     *  compressed in segments of "segmentSize" positions, and "nThreads"
+     *  segments are compressed in parallel, see RePairComp::compressSegments().
+     *  getResiduals(beg, end, vec) must store the encoded values for positions
+     *  [beg,end) in vec. It is called concurrently for disjoint ranges. */
+    static void write(std::ostream& os, const PosIndex& posIdx, int bestWtm, int bestBtm,
+                      bool ignore50, const std::vector<U8>& tree, U64 segmentSize, U64 blockSize,
+                      int nThreads,
+                      const std::function<void(U64,U64,std::vector<U8>&)>& getResiduals);
+
+    /** Create object from file contents created by write(). Throws
+     *  ChessParseError if the data is not a valid WDL file. */
+    explicit WdlFile(std::vector<U8>&& fileData);
+
+    /** Return the WDL score for "pos", from the side to move point of view.
+     *  "captWdl" is the score of the best capture in "pos" from the side to
+     *  move point of view, or -2 if there is no capture. */
+    int probe(const Position& pos, int captWdl) const;
+
+    const PosIndex& getPosIndex() const { return *posIdx; }
+
+    /** Return true if the WDL values ignore the 50 move rule. */
+    bool ignores50MoveRule() const { return ignore50; }
+
+private:
+    std::vector<U8> fileData;
+    std::unique_ptr<PosIndex> posIdx;
+    int bestWtm;
+    int bestBtm;
+    bool ignore50;
+    std::unique_ptr<TreeInterpreter> interp;
+    U64 segmentSize;
+    std::vector<std::unique_ptr<RePairDeComp>> residuals; // One element per segment
+};
+
+
+#endif /* WDLFILE_HPP_ */
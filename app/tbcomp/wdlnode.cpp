@@ -2,22 +2,13 @@
 #include "tbutil.hpp"
 #include "textio.hpp"
 #include <numeric>
+#include <algorithm>
 #include <cfloat>
 
 
-bool
-WDLStats::better(const DT::Node* best, double& bestCost,
-                 const WDLStats& statsFalse,
-                 const WDLStats& statsTrue,
-                 const DT::EvalContext& ctx) {
-    bool useGini = static_cast<const WDLEvalContext&>(ctx).useGini();
-    double newCost = statsFalse.adjustedCost(useGini) +
-                     statsTrue.adjustedCost(useGini);
-    if (newCost < bestCost) {
-        bestCost = newCost;
-        return true;
-    }
-    return best == nullptr;
+double
+WDLStats::splitCost(const WDLStats& statsFalse, const WDLStats& statsTrue, bool useGini) {
+    return statsFalse.adjustedCost(useGini) + statsTrue.adjustedCost(useGini);
 }
 
 double
@@ -47,7 +38,7 @@ WDLStats::adjustedCost(bool useGini) const {
 
 std::string
 WDLStats::describe(const DT::EvalContext& ctx) const {
-    constexpr int N = nWdlVals;
+    constexpr int N = nVals;
     std::array<double,N> cnt;
     double tot = 0.0;
     for (int i = 0; i < N; i++) {
@@ -165,186 +156,8 @@ WDLStatsNode::getEncoder(bool approximate) const {
 
 // ------------------------------------------------------------
 
-WDLStatsCollectorNode::WDLStatsCollectorNode(const DT::EvalContext& ctx, int nChunks,
-                                             double priorCost)
-    : StatsCollectorNode(nChunks, priorCost) {
-    int nPieces = ctx.numPieces();
-    for (int i = 0; i < nPieces; i++)
-        if (Piece::makeWhite(ctx.getPieceType(i)) == Piece::WPAWN)
-            kPawnSq.emplace_back(i);
-    for (int i = 0; i < nPieces; i++)
-        darkSquare.emplace_back(i);
-    for (int i = 0; i < nPieces; i++)
-        fileRankF.emplace_back(i);
-    for (int i = 0; i < nPieces; i++)
-        fileRankR.emplace_back(i);
-    for (int p1 = 0; p1 < nPieces; p1++) {
-        for (int p2 = p1+1; p2 < nPieces; p2++) {
-            fileDelta.emplace_back(p1, p2);
-            rankDelta.emplace_back(p1, p2);
-            fileDist.emplace_back(p1, p2);
-            rankDist.emplace_back(p1, p2);
-            kingDist.emplace_back(p1, p2);
-            taxiDist.emplace_back(p1, p2);
-            diag.emplace_back(p1, p2);
-
-            bool white1 = Piece::isWhite(ctx.getPieceType(p1));
-            bool white2 = Piece::isWhite(ctx.getPieceType(p2));
-            if (white1 == white2) {
-                for (int p3 = 0; p3 < nPieces; p3++) {
-                    Piece::Type pt = ctx.getPieceType(p3);
-                    if ((Piece::isWhite(pt) != white1) &&
-                        (Piece::makeWhite(pt) == Piece::WKNIGHT)) {
-                        forks.emplace_back(p1, p2, ctx);
-                        break;
-                    }
-                }
-            }
-        }
-    }
-    for (int p1 = 0; p1 < nPieces; p1++)
-        for (int p2 = 0; p2 < nPieces; p2++)
-            if (p1 != p2)
-                attacks.emplace_back(p1, p2);
-}
-
-template <typename Func>
-void
-WDLStatsCollectorNode::iterateMembers(Func func) {
-    func(wtm);
-    func(inCheck);
-    func(bPairW);
-    func(bPairB);
-    func(sameB);
-    func(oppoB);
-    for (auto& p : kPawnSq)
-        func(p);
-    func(pRace);
-    func(captWdl);
-    for (auto& p : darkSquare)
-        func(p);
-    for (auto& p : fileRankF)
-        func(p);
-    for (auto& p : fileRankR)
-        func(p);
-    for (auto& p : fileDelta)
-        func(p);
-    for (auto& p : rankDelta)
-        func(p);
-    for (auto& p : fileDist)
-        func(p);
-    for (auto& p : rankDist)
-        func(p);
-    for (auto& p : kingDist)
-        func(p);
-    for (auto& p : taxiDist)
-        func(p);
-    for (auto& p : diag)
-        func(p);
-    for (auto& p : forks)
-        func(p);
-    for (auto& p : attacks)
-        func(p);
-}
-
-template <typename Func>
-void
-WDLStatsCollectorNode::iterateMembers(Func func) const {
-    decltype(func(wtm))* dummy1; (void)dummy1; // Check const
-    decltype(func(fileRankF[0]))* dummy2; (void)dummy2;
-    (const_cast<WDLStatsCollectorNode&>(*this)).iterateMembers(func);
-}
-
-bool
-WDLStatsCollectorNode::applyData(const Position& pos, int value, DT::EvalContext& ctx) {
-    iterateMembers([&pos,value,&ctx](auto& collector) {
-        collector.applyData(pos, ctx, value);
-    });
-    return true;
-}
-
-std::unique_ptr<DT::Node>
-WDLStatsCollectorNode::getBest(const DT::EvalContext& ctx) const {
-    std::unique_ptr<DT::Node> best;
-    double bestCost = DBL_MAX;
-    iterateMembers([&](const auto& collector) {
-        collector.updateBest(best, bestCost, ctx);
-    });
-
-    reScale(best);
-    return best;
-}
-
-void
-WDLStatsCollectorNode::reScale(std::unique_ptr<DT::Node>& node) const {
-    struct Visitor : public DT::Visitor {
-        Visitor(int nChunks, int appliedChunks) : nChunks(nChunks), appliedChunks(appliedChunks) {}
-        using DT::Visitor::visit;
-        void visit(DT::PredicateNode& node) {
-            node.left->accept(*this);
-            node.right->accept(*this);
-        }
-        void visit(DT::StatsNode& node) {
-            WDLStatsNode& wdlNode = static_cast<WDLStatsNode&>(node);
-            wdlNode.scaleStats(nChunks, appliedChunks);
-        }
-    private:
-        const int nChunks;
-        const int appliedChunks;
-    };
-    Visitor visitor(nChunks, appliedChunks);
-    node->accept(visitor);
-}
-
-std::unique_ptr<DT::Node>
-WDLStatsCollectorNode::getBestReplacement(const DT::EvalContext& ctx) const {
-    std::unique_ptr<DT::Node> best, secondBest;
-    double bestCost = DBL_MAX, secondBestCost = DBL_MAX;
-    iterateMembers([&](const auto& collector) {
-        collector.updateBest2(best, bestCost, secondBest, secondBestCost, ctx);
-    });
-
-    auto getErr = [this,&ctx](DT::Node& node) -> double {
-        struct Visitor : public DT::Visitor {
-            Visitor(const DT::EvalContext& ctx) : ctx(ctx) {}
-            using DT::Visitor::visit;
-            void visit(DT::PredicateNode& node) {
-                node.left->accept(*this);
-                node.right->accept(*this);
-            }
-            void visit(DT::StatsNode& node) {
-                WDLStatsNode& wdlNode = static_cast<WDLStatsNode&>(node);
-                double err = wdlNode.costError(ctx);
-                err2 += err * err;
-            }
-            const DT::EvalContext& ctx;
-            double err2 = 0;
-        };
-        Visitor visitor(ctx);
-        node.accept(visitor);
-
-        double N = nChunks;
-        double n = appliedChunks;
-        return sqrt(visitor.err2 * (N - n) / N);
-    };
-
-    double bestErr = getErr(*best.get());
-    double secondBestErr = getErr(*secondBest.get());
-
-    double sumErr = sqrt(bestErr * bestErr + secondBestErr * secondBestErr);
-    double margin = bestCost * 2e-2;
-
-    if (secondBestCost - sumErr * 2.0 < bestCost - margin)
-        return nullptr;
-
-    reScale(best);
-    return best;
-}
-
-// ------------------------------------------------------------
-
 WDLEncoderNode::WDLEncoderNode(const WDLStats& stats, bool approximate) {
-    constexpr int N = WDLStats::nWdlVals;
+    constexpr int N = WDLStats::nVals;
     std::array<std::pair<U64,int>,N> srt;
     const U64 maxVal = ~0ULL;
     for (int i = 0; i < N; i++) {
@@ -359,13 +172,13 @@ WDLEncoderNode::WDLEncoderNode(const WDLStats& stats, bool approximate) {
 int
 WDLEncoderNode::encodeValue(const Position& pos, int value, DT::EvalContext& ctx) const {
     const auto& wdlCtx = static_cast<const WDLEvalContext&>(ctx);
-    constexpr int N = WDLStats::nWdlVals;
+    constexpr int N = WDLStats::nVals;
     int ret = 0;
     for (int i = 0; i < N; i++) {
         int enc = encTable[i] - 2;
         if (enc == value) {
             return ret;
-        } else if (enc != -1) {
+        } else if (encTable[i] != -1) {
             int captWdl = wdlCtx.getCaptureWdl();
             if (pos.isWhiteMove() ? (enc >= captWdl) : (enc <= captWdl))
                 ret++;
@@ -394,9 +207,63 @@ WDLEncoderNode::describe(int indentLevel, const DT::EvalContext& ctx) const {
     return ss.str();
 }
 
+/** All permutations of 0..N-1, in lexicographical order. */
+static const std::vector<std::array<int,WDLStats::nVals>>&
+getPermutations() {
+    static std::vector<std::array<int,WDLStats::nVals>> perms = []() {
+        std::vector<std::array<int,WDLStats::nVals>> ret;
+        std::array<int,WDLStats::nVals> p;
+        std::iota(p.begin(), p.end(), 0);
+        do {
+            ret.push_back(p);
+        } while (std::next_permutation(p.begin(), p.end()));
+        return ret;
+    }();
+    return perms;
+}
+
+void
+WDLEncoderNode::serialize(std::vector<U8>& out) const {
+    const auto& perms = getPermutations();
+    auto it = std::lower_bound(perms.begin(), perms.end(), encTable);
+    assert(it != perms.end() && *it == encTable); // Only approximate encoders supported
+    out.push_back(0x80 | (U8)(it - perms.begin()));
+}
+
+int
+WDLEncoderNode::decodeLeafValue(const U8* leaf, bool wtm, int captWdl, int encVal) {
+    const auto& encTable = getPermutations()[*leaf & 0x7f];
+    int ret = 0;
+    for (int i = 0; i < WDLStats::nVals; i++) {
+        int enc = encTable[i] - 2;
+        if (wtm ? (enc >= captWdl) : (enc <= captWdl)) {
+            if (ret == encVal)
+                return enc;
+            ret++;
+        }
+    }
+    assert(false);
+    return 0;
+}
+
+int
+WDLEncoderNode::encodeLeafValue(const U8* leaf, bool wtm, int captWdl, int value) {
+    const auto& encTable = getPermutations()[*leaf & 0x7f];
+    int ret = 0;
+    for (int i = 0; i < WDLStats::nVals; i++) {
+        int enc = encTable[i] - 2;
+        if (enc == value)
+            return ret;
+        if (wtm ? (enc >= captWdl) : (enc <= captWdl))
+            ret++;
+    }
+    assert(false);
+    return ret;
+}
+
 bool
 WDLEncoderNode::subSetOf(const WDLEncoderNode& other) const {
-    for (int i = 0; i < WDLStats::nWdlVals && (encTable[i] != -1); i++)
+    for (int i = 0; i < WDLStats::nVals && (encTable[i] != -1); i++)
         if (encTable[i] != other.encTable[i])
             return false;
     return true;
@@ -420,6 +287,7 @@ WDLNodeFactory::makeEvalContext(const PosIndex& posIdx) {
 void
 WDLEvalContext::init(const Position& pos,
                      const DT::UncompressedData& data, U64 idx) {
+    computeFeatures(pos);
     const WDLUncompressedData& wdlData = static_cast<const WDLUncompressedData&>(data);
     captWdl = wdlData.getCaptureWdl(idx);
 }
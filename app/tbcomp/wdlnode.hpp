@@ -3,6 +3,7 @@
 
 #include "dtnode.hpp"
 #include "predicates.hpp"
+#include "statscollector.hpp"
 #include <cmath>
 
 
@@ -12,38 +13,35 @@ class WDLEvalContext;
 
 class WDLStats {
 public:
-    constexpr static int nWdlVals = 5;
+    constexpr static int nVals = 5;
 
     WDLStats() : count{} {}
 
-    /** Return true if making a new predicate node from statsFalse/True would
-     *  be better (lower cost) than keeping the current best node. */
-    static bool better(const DT::Node* best, double& bestCost,
-                       const WDLStats& statsFalse,
-                       const WDLStats& statsTrue,
-                       const DT::EvalContext& ctx);
-
     template <typename Pred>
     static std::unique_ptr<DT::Node> makeNode(const Pred& pred,
                                               const WDLStats& statsFalse,
                                               const WDLStats& statsTrue);
 
-    /** Increment counter corresponding to wdlScore. */
-    void incCount(int wdlScore) {
-        count[wdlScore+2]++;
+    /** Create from nVals counts. */
+    explicit WDLStats(const U64* cnt) {
+        for (int i = 0; i < nVals; i++)
+            count[i] = cnt[i];
     }
 
-    void applyData(int value) {
-        incCount(value);
-    }
+    /** Cost of a split into statsFalse/statsTrue. Lower is better. */
+    static double splitCost(const WDLStats& statsFalse, const WDLStats& statsTrue,
+                            bool useGini);
+
+    /** Return the count index corresponding to a WDL value. */
+    static int valueIndex(int wdlScore) { return wdlScore + 2; }
 
     void addStats(const WDLStats& other) {
-        for (int i = 0; i < nWdlVals; i++)
+        for (int i = 0; i < nVals; i++)
             count[i] += other.count[i];
     }
 
     void subStats(const WDLStats& other) {
-        for (int i = 0; i < nWdlVals; i++)
+        for (int i = 0; i < nVals; i++)
             count[i] -= other.count[i];
     }
 
@@ -64,9 +62,17 @@ public:
     /** Get the i:th count. */
     U64 getCount(int i) const { return count[i]; }
 
+    /** Get the sum of all counts. */
+    U64 getTotalCount() const {
+        U64 sum = 0;
+        for (U64 cnt : count)
+            sum += cnt;
+        return sum;
+    }
+
     void scaleCounts(int nChunks, int appliedChunks) {
         if (nChunks != appliedChunks)
-            for (int i = 0; i < nWdlVals; i++)
+            for (int i = 0; i < nVals; i++)
                 count[i] = (U64)std::round((double)count[i] * nChunks / appliedChunks);
     }
 
@@ -74,7 +80,7 @@ private:
     /** Cost adjusted to prefer an even split when the real cost is the same. */
     double adjustedCost(bool useGini) const;
 
-    std::array<U64,nWdlVals> count; // loss, blessed loss, draw, cursed win, win
+    std::array<U64,nVals> count; // loss, blessed loss, draw, cursed win, win
 };
 
 class WDLStatsNode : public DT::StatsNode {
@@ -94,6 +100,8 @@ public:
     std::unique_ptr<DT::EncoderNode> getEncoder() const override;
     std::unique_ptr<DT::EncoderNode> getEncoder(bool approximate) const;
 
+    U64 getNumPositions() const override { return stats.getTotalCount(); }
+
     void scaleStats(int nChunks, int appliedChunks) {
         stats.scaleCounts(nChunks, appliedChunks);
     }
@@ -109,6 +117,9 @@ public:
     constexpr static int minVal = -2;
     constexpr static int maxVal = 2;
     int eval(const Position& pos, DT::EvalContext& ctx) const override;
+    void serialize(std::vector<U8>& out) const override {
+        out.push_back((U8)PredOp::CAPTWDL);
+    }
     std::string name() const override {
         return "captWdl";
     }
@@ -116,44 +127,11 @@ public:
 
 // ------------------------------------------------------------
 
-class WDLStatsCollectorNode : public DT::StatsCollectorNode {
+/** Statistics collector for WDL values. */
+class WDLStatsCollectorNode : public PredStatsCollectorNode<WDLStats, WDLStatsNode,
+                                                            WDLEvalContext, CapturePredicate> {
 public:
-    WDLStatsCollectorNode(const DT::EvalContext& ctx, int nChunks, double priorCost);
-
-    bool applyData(const Position& pos, int value, DT::EvalContext& ctx) override;
-
-    std::unique_ptr<DT::Node> getBest(const DT::EvalContext& ctx) const override;
-
-    std::unique_ptr<DT::Node> getBestReplacement(const DT::EvalContext& ctx) const override;
-
-private:
-    template <typename Func> void iterateMembers(Func func);
-    template <typename Func> void iterateMembers(Func func) const;
-
-    /** Adjust counts based on fraction of positions sampled. */
-    void reScale(std::unique_ptr<DT::Node>& node) const;
-
-    StatsCollector<WTMPredicate, WDLStats> wtm;
-    StatsCollector<InCheckPredicate, WDLStats> inCheck;
-    StatsCollector<BishopPairPredicate<true>, WDLStats> bPairW;
-    StatsCollector<BishopPairPredicate<false>, WDLStats> bPairB;
-    StatsCollector<BishopColorPredicate<true>, WDLStats> sameB;
-    StatsCollector<BishopColorPredicate<false>, WDLStats> oppoB;
-    std::vector<StatsCollector<KingInPawnSquarePredicate, WDLStats>> kPawnSq;
-    MultiPredStatsCollector<PawnRacePredicate, WDLStats> pRace;
-    MultiPredStatsCollector<CapturePredicate, WDLStats> captWdl;
-    std::vector<StatsCollector<DarkSquarePredicate, WDLStats>> darkSquare;
-    std::vector<MultiPredStatsCollector<FileRankPredicate<true>, WDLStats>> fileRankF;
-    std::vector<MultiPredStatsCollector<FileRankPredicate<false>, WDLStats>> fileRankR;
-    std::vector<MultiPredStatsCollector<FileRankDeltaPredicate<true,false>, WDLStats>> fileDelta;
-    std::vector<MultiPredStatsCollector<FileRankDeltaPredicate<false,false>, WDLStats>> rankDelta;
-    std::vector<MultiPredStatsCollector<FileRankDeltaPredicate<true,true>, WDLStats>> fileDist;
-    std::vector<MultiPredStatsCollector<FileRankDeltaPredicate<false,true>, WDLStats>> rankDist;
-    std::vector<MultiPredStatsCollector<DistancePredicate<false>, WDLStats>> kingDist;
-    std::vector<MultiPredStatsCollector<DistancePredicate<true>, WDLStats>> taxiDist;
-    std::vector<StatsCollector<SameDiagPredicate, WDLStats>> diag;
-    std::vector<StatsCollector<AttackPredicate, WDLStats>> attacks;
-    std::vector<StatsCollector<ForkPredicate, WDLStats>> forks;
+    using PredStatsCollectorNode::PredStatsCollectorNode;
 };
 
 class WDLEncoderNode : public DT::EncoderNode {
@@ -164,6 +142,15 @@ public:
     std::unique_ptr<DT::StatsNode> getStats(const DT::EvalContext& ctx) const override;
     std::string describe(int indentLevel, const DT::EvalContext& ctx) const override;
 
+    /** Store encTable as one leaf byte, 0x80 + permutation index. */
+    void serialize(std::vector<U8>& out) const override;
+
+    /** Inverse of encodeValue(), for a leaf created by serialize(). */
+    static int decodeLeafValue(const U8* leaf, bool wtm, int captWdl, int encVal);
+
+    /** Like encodeValue(), for a leaf created by serialize(). */
+    static int encodeLeafValue(const U8* leaf, bool wtm, int captWdl, int value);
+
     /** Return true if "other" can encode all values "this" can encode,
      *  with the same encoding result. */
     bool subSetOf(const WDLEncoderNode& other) const;
@@ -173,7 +160,7 @@ public:
     }
 
 private:
-    std::array<int, WDLStats::nWdlVals> encTable;
+    std::array<int, WDLStats::nVals> encTable;
 };
 
 /** Class to compactly store WDL related information for a position. */
@@ -181,12 +168,10 @@ class WDLInfo {
 public:
     int getWdl() const { return getBits(0, 3) - 2; }
     int getCaptureWdl() const { return getBits(3, 3) - 2; }
-    bool getHandled() const { return getBits(7, 1); }
     U8 getData() const { return data; }
 
     void setWdl(int wdl) & { setBits(0, 3, wdl + 2); }
     void setCaptureWdl(int wdl) & { setBits(3, 3, wdl + 2); }
-    void setHandled(bool handled) & { setBits(7, 1, handled); }
     void setData(U8 val) & { data = val; }
 
 private:
@@ -202,26 +187,23 @@ private:
 
     U8 data = 0; // Bit 0-2 : wdl + 2
                  // Bit 3-5 : (best capture wdl) + 2
-                 // Bit 6   : Not used
-                 // Bit 7   : handled
+                 // Bit 6-7 : Not used
 };
 
 class WDLUncompressedData : public DT::UncompressedData {
 public:
-    WDLUncompressedData(std::vector<WDLInfo>& data) : data(data) {}
+    WDLUncompressedData(WDLInfo* data) : data(data) {}
+    WDLUncompressedData(std::vector<WDLInfo>& data) : data(data.data()) {}
 
     int getValue(U64 idx) const override { return data[idx].getWdl(); }
     void setEncoded(U64 idx, int value) override { data[idx].setData(value); }
     int getEncoded(U64 idx) const override { return data[idx].getData(); }
 
-    bool isHandled(U64 idx) const override { return data[idx].getHandled(); }
-    void setHandled(U64 idx, bool handled) override { data[idx].setHandled(handled); }
-
     int getCaptureWdl(U64 idx) const { return data[idx].getCaptureWdl(); }
     void setCaptureWdl(U64 idx, int wdl) { data[idx].setCaptureWdl(wdl); }
 
 private:
-    std::vector<WDLInfo>& data;
+    WDLInfo* data;
 };
 
 class WDLNodeFactory : public DT::NodeFactory {
@@ -38,6 +38,7 @@
 #include "numa.hpp"
 #include "cluster.hpp"
 #include "clustertt.hpp"
+#include "tbprobe.hpp"
 
 #include <iostream>
 #include <memory>
@@ -64,6 +65,9 @@ EngineMainThread::mainLoop() {
         UciParams::hash->addListener([this]() {
             setupTT();
         });
+        UciParams::compactHash->addListener([this]() {
+            setupTT();
+        }, false);
         UciParams::clearHash->addListener([this]() {
             tt.clear();
         }, false);
@@ -127,7 +131,7 @@ EngineMainThread::setupTT() {
         try {
             if (nEntries < 1)
                 break;
-            tt.reSize(nEntries);
+            tt.reSize(nEntries, UciParams::compactHash->getBoolPar());
             break;
         } catch (const std::bad_alloc&) {
             nEntries /= 2;
@@ -152,6 +156,7 @@ EngineMainThread::startSearch(EngineControl* engineControl,
     Cluster::instance().assignThreads(nThreads, nThreadsThisNode, nThreadsChildren);
     comm->sendAssignThreads(nThreadsThisNode, nThreadsChildren);
     WorkerThread::createWorkers(1, comm.get(), nThreadsThisNode - 1, tt, children);
+    sc->setNumThreads(nThreadsThisNode);
 
     {
         std::lock_guard<std::mutex> L(mutex);
@@ -281,6 +286,9 @@ EngineControl::EngineControl(std::ostream& o, EngineMainThread& engineThread0,
     hashParListenerId = UciParams::hash->addListener([this]() {
         engineThread.setupTT();
     });
+    compactHashParListenerId = UciParams::compactHash->addListener([this]() {
+        engineThread.setupTT();
+    }, false);
     clearHashParListenerId = UciParams::clearHash->addListener([this]() {
         engineThread.getTT().clear();
         ht.init();
@@ -298,6 +306,7 @@ EngineControl::EngineControl(std::ostream& o, EngineMainThread& engineThread0,
 
 EngineControl::~EngineControl() {
     UciParams::hash->removeListener(hashParListenerId);
+    UciParams::compactHash->removeListener(compactHashParListenerId);
     UciParams::clearHash->removeListener(clearHashParListenerId);
     UciParams::opponent->removeListener(opponentParListenerId);
     UciParams::contemptFile->removeListener(contemptFileParListenerId);
@@ -606,6 +615,8 @@ EngineControl::waitReady() {
 
 void
 EngineControl::finishSearch(Position& pos, const Move& bestMove) {
+    if (UciParams::rtbBlockCache->getIntPar() > 0 || UciParams::rtbPrefetch->getIntPar() > 0)
+        TBProbe::printStats(os, "info string ");
     Move ponderMove = getPonderMove(pos, bestMove);
     listener.notifyPlayedMove(bestMove, ponderMove);
 }
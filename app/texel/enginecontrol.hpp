@@ -177,6 +177,7 @@ private:
     std::ostream& os;
 
     int hashParListenerId;
+    int compactHashParListenerId;
     int clearHashParListenerId;
     int opponentParListenerId;
     int contemptFileParListenerId;
@@ -39,6 +39,7 @@
 
 #include <fstream>
 #include <iomanip>
+#include <thread>
 
 bool
 PosGenerator::generate(const std::string& type) {
@@ -664,18 +665,32 @@ PosGenerator::wdlDump(const std::vector<std::string>& tbTypes) {
         double t0 = currentTime();
         U64 nPos = 0;
         U64 cnt[5] = {0, 0, 0, 0, 0};
+        const size_t batchSize = 4096;
+        std::vector<Position> batch;
+        std::vector<int> wdlVec(batchSize), successVec(batchSize);
+        Syzygy::BlockCache cache;
+        auto probeBatch = [&]() {
+            const int n = batch.size();
+            Syzygy::probe_wdl_batch(batch.data(), n, wdlVec.data(), successVec.data(), cache);
+            for (int i = 0; i < n; i++) {
+                if (!successVec[i])
+                    throw ChessParseError("RTB probe failed, pos:" + TextIO::toFEN(batch[i]));
+                int wdl = wdlVec[i];
+                if (!batch[i].isWhiteMove())
+                    wdl = -wdl;
+                cnt[wdl+2]++;
+                S8 c = wdl;
+                ofs.write((const char*)&c, 1);
+            }
+            batch.clear();
+        };
         iteratePositions(tbType, [&](Position& pos) {
             nPos++;
-            int success;
-            int wdl = Syzygy::probe_wdl(pos, &success);
-            if (!success)
-                throw ChessParseError("RTB probe failed, pos:" + TextIO::toFEN(pos));
-            if (!pos.isWhiteMove())
-                wdl = -wdl;
-            cnt[wdl+2]++;
-            S8 c = wdl;
-            ofs.write((const char*)&c, 1);
+            batch.push_back(pos);
+            if (batch.size() >= batchSize)
+                probeBatch();
         });
+        probeBatch();
         double t1 = currentTime();
         std::cout << tbType << " nPos:" << nPos << " t:" << (t1-t0) << std::endl;
         std::cout << cnt[0] << ' ' << cnt[1] << ' ' << cnt[2] << ' ' << cnt[3] << ' ' << cnt[4] << std::endl;
@@ -769,7 +784,7 @@ PosGenerator::tbgenTest(const std::vector<std::string>& tbTypes) {
         VectorStorage vs;
         TBGenerator<VectorStorage> tbGen(vs, pc);
         RelaxedShared<S64> maxTimeMillis(-1);
-        tbGen.generate(maxTimeMillis, false);
+        tbGen.generate(maxTimeMillis, false, std::thread::hardware_concurrency());
         double t0 = currentTime();
 
         U64 nPos = 0;
@@ -38,6 +38,7 @@
 #include <iostream>
 #include <fstream>
 #include <string>
+#include <thread>
 
 void
 parseParValues(const std::string& fname, std::vector<ParamValue>& parValues) {
@@ -520,7 +521,7 @@ main(int argc, char* argv[]) {
                 TBGenerator<TTStorage> tbGen(tts, pc);
 #endif
                 RelaxedShared<S64> maxTimeMillis(-1);
-                tbGen.generate(maxTimeMillis, true);
+                tbGen.generate(maxTimeMillis, true, std::thread::hardware_concurrency());
         } else if (cmd == "tbgentest") {
             if (argc < 3)
                 usage();
@@ -64,7 +64,7 @@ public:
     void extractPVMoves(const Position& rootPos, const Move& mFirst, std::vector<Move>& pv);
     std::string extractPV(const Position& posIn);
     int getHashFull() const;
-    bool updateTB(const Position& pos, RelaxedShared<S64>& maxTimeMillis);
+    bool updateTB(const Position& pos, RelaxedShared<S64>& maxTimeMillis, int nThreads);
 
     const TranspositionTable& getTT() const;
     void insert(const TranspositionTable::TTEntry& ent);
@@ -188,8 +188,8 @@ ClusterTT::getHashFull() const {
 }
 
 inline bool
-ClusterTT::updateTB(const Position& pos, RelaxedShared<S64>& maxTimeMillis) {
-    return tt.updateTB(pos, maxTimeMillis);
+ClusterTT::updateTB(const Position& pos, RelaxedShared<S64>& maxTimeMillis, int nThreads) {
+    return tt.updateTB(pos, maxTimeMillis, nThreads);
 }
 
 inline const TranspositionTable&
@@ -234,8 +234,8 @@ public:
     int getHashFull() const {
         return tt.getHashFull();
     }
-    bool updateTB(const Position& pos, RelaxedShared<S64>& maxTimeMillis) {
-        return tt.updateTB(pos, maxTimeMillis);
+    bool updateTB(const Position& pos, RelaxedShared<S64>& maxTimeMillis, int nThreads) {
+        return tt.updateTB(pos, maxTimeMillis, nThreads);
     }
     const TranspositionTable& getTT() const {
         return tt;
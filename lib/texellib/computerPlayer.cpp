@@ -59,6 +59,12 @@ ComputerPlayer::initEngine() {
     UciParams::gtbPath->addListener(tbInit);
     UciParams::gtbCache->addListener(tbInit, false);
     UciParams::rtbPath->addListener(tbInit, false);
+    UciParams::rtbBlockCache->addListener([]() {
+        TBProbe::setRtbBlockCache(UciParams::rtbBlockCache->getIntPar());
+    });
+    UciParams::rtbPrefetch->addListener([]() {
+        TBProbe::setRtbPrefetch(UciParams::rtbPrefetch->getIntPar());
+    });
 
     knightMobScore.addListener(Evaluate::updateEvalParams);
     castleFactor.addListener(Evaluate::updateEvalParams, false);
@@ -41,6 +41,7 @@
 #else
 #ifdef NUMA
 #include <numa.h>
+#include <numaif.h>
 #endif
 #endif
 
@@ -83,6 +84,9 @@ Numa::Numa() {
     }
 #endif
 #endif
+    for (int node : threadToNode)
+        if (std::find(usedNodes.begin(), usedNodes.end(), node) == usedNodes.end())
+            usedNodes.push_back(node);
 }
 
 void
@@ -263,6 +267,7 @@ Numa::getNodeInfoMap(int maxNode, std::map<int, NodeInfo>& nodeInfo) {
 void
 Numa::disable() {
     threadToNode.clear();
+    usedNodes.clear();
 }
 
 int
@@ -281,6 +286,49 @@ Numa::bindThread(int threadNo) const {
     if (node < 0)
         return;
 //    Logger::log([&](std::ostream& os){os << "threadNo:" << threadNo << " node:" << node;});
+    bindToNode(node);
+#endif
+}
+
+int
+Numa::getNumNodes() const {
+    return std::max((int)usedNodes.size(), 1);
+}
+
+void
+Numa::bindThreadToNode(int nodeIdx) const {
+#ifdef NUMA
+    if (nodeIdx >= 0 && nodeIdx < (int)usedNodes.size())
+        bindToNode(usedNodes[nodeIdx]);
+#endif
+}
+
+bool
+Numa::interleaveMemory(void* mem, size_t size) const {
+#if defined(NUMA) && !defined(_WIN32)
+    if (usedNodes.size() > 1 && numa_available() != -1) {
+        // mbind() fails with EINVAL unless the start address is page aligned.
+        // Pages only partially inside the block keep the default policy.
+        const uintptr_t pageSize = numa_pagesize();
+        const uintptr_t begin = ((uintptr_t)mem + pageSize - 1) & ~(pageSize - 1);
+        const uintptr_t end = ((uintptr_t)mem + size) & ~(pageSize - 1);
+        if (end <= begin)
+            return true;
+        bitmask* nodeMask = numa_allocate_nodemask();
+        for (int node : usedNodes)
+            numa_bitmask_setbit(nodeMask, node);
+        int ret = mbind((void*)begin, end - begin, MPOL_INTERLEAVE,
+                        nodeMask->maskp, nodeMask->size + 1, 0);
+        numa_free_nodemask(nodeMask);
+        return ret == 0;
+    }
+#endif
+    return true;
+}
+
+void
+Numa::bindToNode(int node) {
+#ifdef NUMA
 #ifdef _WIN32
 #if _WIN32_WINNT >= 0x0601
     GROUP_AFFINITY mask;
@@ -28,6 +28,7 @@
 
 #include <vector>
 #include <map>
+#include <cstddef>
 
 
 /** Bind search threads to suitable NUMA nodes. */
@@ -47,12 +48,32 @@ public:
     /** Bind current thread to NUMA node determined by nodeForThread(). */
     void bindThread(int threadNo) const;
 
+    /** Return the number of NUMA nodes used by search threads, or 1 if NUMA
+     *  awareness is not used. */
+    int getNumNodes() const;
+
+    /** Bind current thread to the NUMA node with index "nodeIdx",
+     *  0 <= nodeIdx < getNumNodes(). */
+    void bindThreadToNode(int nodeIdx) const;
+
+    /** Make the pages in a memory block be interleaved over all NUMA nodes used
+     *  by search threads. Must be called before the memory is first touched.
+     *  Has no effect on WIN32, where the memory should instead be first
+     *  touched by threads bound to different nodes. The block does not have
+     *  to be page aligned. Return false if the memory policy could not be set.
+     *  The result can be checked in /proc/<pid>/numa_maps, where the pages
+     *  of the block should be listed as "interleave:<nodes>". */
+    bool interleaveMemory(void* mem, size_t size) const;
+
 private:
     Numa();
 
     /** Preferred node for a given search thread. */
     int nodeForThread(int threadNo) const;
 
+    /** Bind current thread to a NUMA node. */
+    static void bindToNode(int node);
+
     struct NodeInfo {
         int node = 0;
         int numCores = 0;
@@ -67,6 +88,9 @@ private:
 
     /** Thread number to node number. */
     std::vector<int> threadToNode;
+
+    /** All nodes in threadToNode, in order of first occurrence. */
+    std::vector<int> usedNodes;
 };
 
 #endif /* NUMA_HPP_ */
@@ -39,6 +39,7 @@ namespace UciParams {
     std::shared_ptr<SpinParam> threads(std::make_shared<SpinParam>("Threads", 1, maxThreads, 1));
 
     std::shared_ptr<SpinParam> hash(std::make_shared<SpinParam>("Hash", 1, 1024*1024, 16));
+    std::shared_ptr<CheckParam> compactHash(std::make_shared<CheckParam>("CompactHash", false));
     std::shared_ptr<SpinParam> multiPV(std::make_shared<SpinParam>("MultiPV", 1, 256, 1));
     std::shared_ptr<CheckParam> ponder(std::make_shared<CheckParam>("Ponder", false));
     std::shared_ptr<CheckParam> analyseMode(std::make_shared<CheckParam>("UCI_AnalyseMode", false));
@@ -62,6 +63,8 @@ namespace UciParams {
     std::shared_ptr<StringParam> gtbPath(std::make_shared<StringParam>("GaviotaTbPath", ""));
     std::shared_ptr<SpinParam> gtbCache(std::make_shared<SpinParam>("GaviotaTbCache", 1, 2047, 1));
     std::shared_ptr<StringParam> rtbPath(std::make_shared<StringParam>("SyzygyPath", ""));
+    std::shared_ptr<SpinParam> rtbBlockCache(std::make_shared<SpinParam>("SyzygyBlockCache", 0, 256, 0));
+    std::shared_ptr<SpinParam> rtbPrefetch(std::make_shared<SpinParam>("SyzygyPrefetch", 0, 2, 0));
     std::shared_ptr<SpinParam> minProbeDepth(std::make_shared<SpinParam>("MinProbeDepth", 0, 100, 1));
     std::shared_ptr<SpinParam> minProbeDepth6(std::make_shared<SpinParam>("MinProbeDepth6", 0, 100, 1));
     std::shared_ptr<SpinParam> minProbeDepth7(std::make_shared<SpinParam>("MinProbeDepth7", 0, 100, 10));
@@ -635,6 +638,7 @@ Parameters::Parameters() {
     addPar(UciParams::threads);
 
     addPar(UciParams::hash);
+    addPar(UciParams::compactHash);
     addPar(UciParams::multiPV);
     addPar(UciParams::ponder);
     addPar(UciParams::analyseMode);
@@ -658,6 +662,8 @@ Parameters::Parameters() {
     addPar(UciParams::gtbPath);
     addPar(UciParams::gtbCache);
     addPar(UciParams::rtbPath);
+    addPar(UciParams::rtbBlockCache);
+    addPar(UciParams::rtbPrefetch);
     addPar(UciParams::minProbeDepth);
     addPar(UciParams::minProbeDepth6);
     addPar(UciParams::minProbeDepth7);
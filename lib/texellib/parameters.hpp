@@ -366,6 +366,7 @@ namespace UciParams {
     extern std::shared_ptr<Parameters::SpinParam> threads;
 
     extern std::shared_ptr<Parameters::SpinParam> hash;
+    extern std::shared_ptr<Parameters::CheckParam> compactHash;
     extern std::shared_ptr<Parameters::SpinParam> multiPV;
     extern std::shared_ptr<Parameters::CheckParam> ponder;
     extern std::shared_ptr<Parameters::CheckParam> analyseMode;
@@ -389,6 +390,8 @@ namespace UciParams {
     extern std::shared_ptr<Parameters::StringParam> gtbPath;
     extern std::shared_ptr<Parameters::SpinParam> gtbCache;
     extern std::shared_ptr<Parameters::StringParam> rtbPath;
+    extern std::shared_ptr<Parameters::SpinParam> rtbBlockCache;
+    extern std::shared_ptr<Parameters::SpinParam> rtbPrefetch;
     extern std::shared_ptr<Parameters::SpinParam> minProbeDepth;  // Generic min TB probe depth
     extern std::shared_ptr<Parameters::SpinParam> minProbeDepth6; // Min probe depth for 6-men
     extern std::shared_ptr<Parameters::SpinParam> minProbeDepth7; // Min probe depth for 7-men
@@ -64,6 +64,7 @@ Search::init(const Position& pos0, const std::vector<U64>& posHashList0,
     searchNeedMoreTime = false;
     maxNodes = -1;
     minProbeDepth = 0;
+    nThreads = 1;
     setStrength(1000, 0, 0);
     tLastStats = currentTimeMillis();
     totalNodes = 0;
@@ -117,7 +118,7 @@ Search::iterativeDeepening(const MoveList& scMovesIn,
     maxNodes = initialMaxNodes;
     this->minProbeDepth = TBProbe::tbEnabled() ? minProbeDepth : MAX_SEARCH_DEPTH;
     if ((maxDepth < 0) && (maxNodes < 0) && !TBProbe::tbEnabled())
-        if (tt.updateTB(pos, maxTimeMillis))
+        if (tt.updateTB(pos, maxTimeMillis, nThreads))
             this->minProbeDepth = 1; // In-memory on-demand tables can be probed aggressively
     std::vector<MoveInfo> rootMoves;
     getRootMoves(scMovesIn, rootMoves, maxDepth);
@@ -112,6 +112,10 @@ public:
     /** Set minimum depth for TB probes. */
     void setMinProbeDepth(int depth);
 
+    /** Set number of threads that can be used for on-demand TB generation,
+     *  which happens before helper threads start searching. */
+    void setNumThreads(int nThreads);
+
     Move iterativeDeepening(const MoveList& scMovesIn,
                             int maxDepth, S64 initialMaxNodes,
                             int maxPV = 1, bool onlyExact = false,
@@ -286,6 +290,7 @@ private:
     double hardFactor;         // How hard it seems to be to determine the best move.
     S64 maxNodes;              // Maximum number of nodes to search (approximately)
     int minProbeDepth;         // Minimum depth to probe endgame tablebases.
+    int nThreads;              // Number of threads for on-demand TB generation
     int nodesToGo;             // Number of nodes until next time check
     int nodesBetweenTimeCheck; // How often to check remaining time
 
@@ -479,4 +484,9 @@ Search::setMinProbeDepth(int depth) {
     minProbeDepth = depth;
 }
 
+inline void
+Search::setNumThreads(int nThreads) {
+    this->nThreads = nThreads;
+}
+
 #endif /* SEARCH_HPP_ */
@@ -39,8 +39,10 @@
 #define TB_BPAWN (TB_PAWN | 8)
 
 static std::mutex TB_mutex;
+static std::mutex prefetch_mutex; // Held by the prefetch thread while using table data
 
 static bool initialized = false;
+static int tb_generation = 0; // Incremented when tables are reinitialized
 static int num_paths = 0;
 static char *path_string = NULL;
 static char **paths = NULL;
@@ -56,6 +58,7 @@ static void init_indices(void);
 static uint64_t calc_key_from_pcs(const int *pcs, bool mirror);
 static void free_wdl_entry(struct TBEntry *entry);
 static void free_dtz_entry(struct TBEntry *entry);
+static void prefetch_reset(void);
 
 static FD open_tb(const char *str, const char *suffix)
 {
@@ -273,6 +276,9 @@ void Syzygy::init(const std::string& path)
             return;
     }
 
+    std::lock_guard<std::mutex> P(prefetch_mutex);
+    prefetch_reset();
+    tb_generation++;
     if (initialized) {
         free(path_string); path_string = NULL;
         free(paths); paths = NULL;
@@ -1296,14 +1302,13 @@ static inline uint32_t bswap32(uint32_t val) {
 #endif
 }
 
-static uint8_t decompress_pairs(struct PairsData *d, uint64_t idx)
+// Find the block containing index "idx", and the position "litidx" of
+// "idx" within the block. Must not be called if d->idxbits == 0.
+static void find_pairs_block(struct PairsData *d, uint64_t idx, uint32_t& block, int& litidx)
 {
-    if (!d->idxbits)
-        return d->min_len;
-
     uint32_t mainidx = idx >> d->idxbits;
-    int litidx = (idx & ((1 << d->idxbits) - 1)) - (1 << (d->idxbits - 1));
-    uint32_t block = *(uint32_t *)(d->indextable + 6 * mainidx);
+    litidx = (idx & ((1 << d->idxbits) - 1)) - (1 << (d->idxbits - 1));
+    block = *(uint32_t *)(d->indextable + 6 * mainidx);
     litidx += *(uint16_t *)(d->indextable + 6 * mainidx + 4);
     if (litidx < 0) {
         do {
@@ -1313,6 +1318,16 @@ static uint8_t decompress_pairs(struct PairsData *d, uint64_t idx)
         while (litidx > d->sizetable[block])
             litidx -= d->sizetable[block++] + 1;
     }
+}
+
+static uint8_t decompress_pairs(struct PairsData *d, uint64_t idx)
+{
+    if (!d->idxbits)
+        return d->min_len;
+
+    uint32_t block;
+    int litidx;
+    find_pairs_block(d, idx, block, litidx);
 
     uint32_t *ptr = (uint32_t *)(d->data + ((uint64_t)block << d->blocksize));
 
@@ -1354,6 +1369,94 @@ static uint8_t decompress_pairs(struct PairsData *d, uint64_t idx)
     return *(sympat + 3 * sym);
 }
 
+// Store all symlen[sym] + 1 values that symbol "sym" expands to in "out".
+// Return the number of stored values.
+static int expand_pairs_symbol(struct PairsData *d, int sym, uint8_t *out)
+{
+    uint8_t *sympat = d->sympat;
+    uint8_t *symlen = d->symlen;
+    int stack[256]; // Right halves not yet expanded
+    int sp = 0;
+    int n = 0;
+    for (;;) {
+        while (symlen[sym] != 0) {
+            int w = *(int *)(sympat + 3 * sym);
+            stack[sp++] = (w >> 12) & 0x0fff;
+            sym = w & 0x0fff;
+        }
+        out[n++] = *(sympat + 3 * sym);
+        if (sp == 0)
+            return n;
+        sym = stack[--sp];
+    }
+}
+
+// State for decompressing one block incrementally. Values are only
+// decompressed as far as needed, so a lookup near the start of a block does
+// not pay for decoding the whole block.
+struct PairsBlockDecoder {
+    uint32_t *ptr = NULL;
+    uint64_t code = 0;
+    int bitcnt = 0;   // number of "empty bits" in code
+    int nDecoded = 0; // number of values stored so far
+    int nValues = 0;  // number of values in the block
+};
+
+// Prepare "dec" for decompressing block "block". Must not be called if
+// d->idxbits == 0.
+static void init_pairs_decoder(struct PairsData *d, uint32_t block, PairsBlockDecoder& dec)
+{
+    dec.ptr = (uint32_t *)(d->data + ((uint64_t)block << d->blocksize));
+    dec.code = bswap64(*((uint64_t *)dec.ptr));
+    dec.ptr += 2;
+    dec.bitcnt = 0;
+    dec.nDecoded = 0;
+    dec.nValues = d->sizetable[block] + 1;
+}
+
+// Continue decompressing the block until value "litidx" has been stored in
+// "out". "out" must be the same buffer for all calls using the same decoder
+// and must have room for PAIRS_MAX_BLOCK_VALUES values.
+static void decode_pairs_until(struct PairsData *d, PairsBlockDecoder& dec, int litidx,
+                               uint8_t *out)
+{
+    int m = d->min_len;
+    uint16_t *offset = d->offset;
+    base_t *base = d->base - m;
+    uint64_t code = dec.code;
+    int bitcnt = dec.bitcnt;
+    uint32_t *ptr = dec.ptr;
+    int n = dec.nDecoded;
+    while (n <= litidx) {
+        int l = m;
+        while (code < base[l]) l++;
+        int sym = offset[l] + ((code - base[l]) >> (64 - l));
+        n += expand_pairs_symbol(d, sym, out + n);
+        if (n >= dec.nValues) break;
+        code <<= l;
+        bitcnt += l;
+        if (bitcnt >= 32) {
+            bitcnt -= 32;
+            code |= (uint64_t)(bswap32(*ptr++)) << bitcnt;
+        }
+    }
+    dec.code = code;
+    dec.bitcnt = bitcnt;
+    dec.ptr = ptr;
+    dec.nDecoded = n;
+}
+
+// Decompress all values in block "block" and store them in "out", which
+// must have room for PAIRS_MAX_BLOCK_VALUES values. Return the number of
+// values in the block. Must not be called if d->idxbits == 0.
+static int decompress_pairs_block(struct PairsData *d, uint32_t block, uint8_t *out)
+{
+    PairsBlockDecoder dec;
+    init_pairs_decoder(d, block, dec);
+    decode_pairs_until(d, dec, dec.nValues - 1, out);
+    return dec.nValues;
+}
+
 TBEntry* load_dtz_table(const char* str, uint64_t key1)
 {
     int i;
@@ -27,6 +27,10 @@
 
 #define TBHASHBITS 11
 
+// Size of a buffer that can hold all values in a decompressed pairs block.
+// The last symbol in a block may expand to at most 256 values.
+#define PAIRS_MAX_BLOCK_VALUES (65536 + 256)
+
 struct TBHashEntry;
 
 using base_t = uint64_t;
@@ -12,6 +12,17 @@
 #include "../moveGen.hpp"
 
 #include <type_traits>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <thread>
+#include <unordered_set>
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+#include <algorithm>
+#include <vector>
 
 #include "rtb-probe.hpp"
 #include "rtb-core.hpp"
@@ -102,29 +113,30 @@ static inline int pop_lsb(uint64_t& bb) {
     return BitBoard::extractSquare(bb);
 }
 
+// Find the pairs data and index of a position in its WDL table.
+// Returns NULL if the probe failed, in which case *success is set to 0,
+// or if the position is KvK, which is a draw.
 // probe_wdl_table and probe_dtz_table require similar adaptations.
-static int probe_wdl_table(Position& pos, int *success)
+static struct PairsData *wdl_table_index(Position& pos, uint64_t& idx, int *success)
 {
     struct TBEntry *ptr;
     struct TBHashEntry *ptr2;
-    uint64_t idx;
     uint64_t key;
     int i;
-    uint8_t res;
     int p[TBPIECES];
 
     // Obtain the position's material signature key.
     key = calc_key(pos, false);
 
     // Test for KvK.
-    if (!key) return 0;
+    if (!key) return NULL;
 
     ptr2 = WDL_hash[key >> (64 - TBHASHBITS)];
     for (i = 0; i < HSHMAX; i++)
         if (ptr2[i].key == key) break;
     if (i == HSHMAX) {
         *success = 0;
-        return 0;
+        return NULL;
     }
 
     ptr = ptr2[i].ptr;
@@ -139,7 +151,7 @@ static int probe_wdl_table(Position& pos, int *success)
             if (!init_table_wdl(ptr, str)) {
                 ptr2[i].key = 0ULL;
                 *success = 0;
-                return 0;
+                return NULL;
             }
             std::atomic_thread_fence(std::memory_order_release);
             ptr->ready.store(1, std::memory_order_relaxed);
@@ -175,7 +187,7 @@ static int probe_wdl_table(Position& pos, int *success)
             } while (bb);
         }
         idx = encode_piece(entry, entry->norm[bside], p, entry->factor[bside]);
-        res = decompress_pairs(entry->precomp[bside], idx);
+        return entry->precomp[bside];
     } else {
         struct TBEntry_pawn *entry = (struct TBEntry_pawn *)ptr;
         int k = entry->file[0].pieces[0][0] ^ cmirror;
@@ -193,10 +205,104 @@ static int probe_wdl_table(Position& pos, int *success)
             } while (bb);
         }
         idx = encode_pawn(entry, entry->file[f].norm[bside], p, entry->file[f].factor[bside]);
-        res = decompress_pairs(entry->file[f].precomp[bside], idx);
+        return entry->file[f].precomp[bside];
     }
+}
+
+// Per-thread LRU cache of decompressed WDL/DTZ blocks, keyed by (table, block).
+// Search probes tend to hit nearby indices, so a hit avoids decoding the
+// symbol path of the block again. A block is only decompressed up to the
+// largest index looked up so far, so a miss costs no more than an uncached
+// probe plus storing the decoded values.
+struct LruBlockCache {
+    struct Entry {
+        const PairsData* table = NULL;
+        uint32_t block = 0;
+        uint64_t lastUsed = 0;
+        PairsBlockDecoder dec;
+        std::vector<uint8_t> values;
+    };
+    std::vector<Entry> entries;
+    int generation = -1;
+    uint64_t useCount = 0;
+
+    uint64_t nProbes = 0; // Not yet added to global counters
+    uint64_t nHits = 0;
+};
+
+static std::atomic<int> block_cache_size(0);
+static std::atomic<uint64_t> block_cache_probes(0);
+static std::atomic<uint64_t> block_cache_hits(0);
+static thread_local LruBlockCache lru_cache;
+
+void Syzygy::set_block_cache_size(int nBlocks)
+{
+    block_cache_size.store(std::max(nBlocks, 0), std::memory_order_relaxed);
+}
+
+static void flush_block_cache_stats(LruBlockCache& c)
+{
+    block_cache_probes.fetch_add(c.nProbes, std::memory_order_relaxed);
+    block_cache_hits.fetch_add(c.nHits, std::memory_order_relaxed);
+    c.nProbes = c.nHits = 0;
+}
 
-    return ((int)res) - 2;
+void Syzygy::get_block_cache_stats(uint64_t& nProbes, uint64_t& nHits)
+{
+    flush_block_cache_stats(lru_cache);
+    nProbes = block_cache_probes.load(std::memory_order_relaxed);
+    nHits = block_cache_hits.load(std::memory_order_relaxed);
+}
+
+// Same as decompress_pairs(), but uses the block cache if it is enabled.
+static uint8_t decompress_pairs_cached(struct PairsData *d, uint64_t idx)
+{
+    const int size = block_cache_size.load(std::memory_order_relaxed);
+    if (size <= 0 || !d->idxbits)
+        return decompress_pairs(d, idx);
+
+    LruBlockCache& c = lru_cache;
+    if (c.generation != tb_generation || (int)c.entries.size() != size) {
+        c.entries.clear();
+        c.entries.resize(size);
+        c.generation = tb_generation;
+    }
+
+    uint32_t block;
+    int litidx;
+    find_pairs_block(d, idx, block, litidx);
+
+    if (++c.nProbes >= 1024)
+        flush_block_cache_stats(c);
+
+    LruBlockCache::Entry* lru = &c.entries[0];
+    for (LruBlockCache::Entry& e : c.entries) {
+        if (e.table == d && e.block == block) {
+            e.lastUsed = ++c.useCount;
+            c.nHits++;
+            if (litidx >= e.dec.nDecoded)
+                decode_pairs_until(d, e.dec, litidx, e.values.data());
+            return e.values[litidx];
+        }
+        if (e.lastUsed < lru->lastUsed)
+            lru = &e;
+    }
+
+    lru->values.resize(PAIRS_MAX_BLOCK_VALUES);
+    init_pairs_decoder(d, block, lru->dec);
+    decode_pairs_until(d, lru->dec, litidx, lru->values.data());
+    lru->table = d;
+    lru->block = block;
+    lru->lastUsed = ++c.useCount;
+    return lru->values[litidx];
+}
+
+static int probe_wdl_table(Position& pos, int *success)
+{
+    uint64_t idx;
+    struct PairsData *d = wdl_table_index(pos, idx, success);
+    if (!d) return 0;
+    return ((int)decompress_pairs_cached(d, idx)) - 2;
 }
 
 static int probe_dtz_table(Position& pos, int wdl, int *success)
@@ -283,7 +389,7 @@ static int probe_dtz_table(Position& pos, int wdl, int *success)
             } while (bb);
         }
         idx = encode_piece((struct TBEntry_piece *)entry, entry->norm, p, entry->factor);
-        res = decompress_pairs(entry->precomp, idx);
+        res = decompress_pairs_cached(entry->precomp, idx);
 
         if (entry->flags & 2) {
             if (entry->flags & 16)
@@ -315,7 +421,7 @@ static int probe_dtz_table(Position& pos, int wdl, int *success)
             } while (bb);
         }
         idx = encode_pawn((struct TBEntry_pawn *)entry, entry->file[f].norm, p, entry->file[f].factor);
-        res = decompress_pairs(entry->file[f].precomp, idx);
+        res = decompress_pairs_cached(entry->file[f].precomp, idx);
 
         if (entry->flags[f] & 2)
             res = entry->map[entry->map_idx[f][wdl_to_map[wdl + 2]] + res];
@@ -342,7 +448,12 @@ static void add_underprom_caps(Position& pos, MoveList& moveList)
     }
 }
 
-static int probe_ab(Position& pos, int alpha, int beta, int *success)
+static int probe_ab(Position& pos, int alpha, int beta, int *success);
+
+// First part of probe_ab(). Probe all captures in "pos" and update "alpha".
+// Return true if the result, stored in "v", is known without probing the
+// table for "pos".
+static bool probe_ab_captures(Position& pos, int& alpha, int beta, int *success, int& v)
 {
     // Generate (at least) all legal non-ep captures including (under)promotions.
     // It is OK to generate more, as long as they are filtered out below.
@@ -363,19 +474,27 @@ static int probe_ab(Position& pos, int alpha, int beta, int *success)
             !MoveGen::isLegal(pos, capture, inCheck))
             continue;
         pos.makeMove(capture, ui);
-        int v = -probe_ab(pos, -beta, -alpha, success);
+        v = -probe_ab(pos, -beta, -alpha, success);
         pos.unMakeMove(capture, ui);
-        if (*success == 0) return 0;
+        if (*success == 0) {
+            v = 0;
+            return true;
+        }
         if (v > alpha) {
             if (v >= beta) {
                 *success = 2;
-                return v;
+                return true;
             }
             alpha = v;
         }
     }
+    return false;
+}
 
-    int v = probe_wdl_table(pos, success);
+// Last part of probe_ab(). Combine the best capture score "alpha" with
+// the table value "v" for the position.
+static int probe_ab_result(int alpha, int v, int *success)
+{
     if (*success == 0) return 0;
     if (alpha >= v) {
         *success = 1 + (alpha > 0);
@@ -386,11 +505,19 @@ static int probe_ab(Position& pos, int alpha, int beta, int *success)
     }
 }
 
-int Syzygy::probe_wdl(Position& pos, int *success)
+static int probe_ab(Position& pos, int alpha, int beta, int *success)
 {
-    *success = 1;
-    int v = probe_ab(pos, -2, 2, success);
+    int v;
+    if (probe_ab_captures(pos, alpha, beta, success, v))
+        return v;
+    v = probe_wdl_table(pos, success);
+    return probe_ab_result(alpha, v, success);
+}
 
+// Last part of probe_wdl(). Take en passant captures into account.
+// "v" is the result of probe_ab() for "pos".
+static int probe_wdl_ep(Position& pos, int v, int *success)
+{
     // If en passant is not possible, we are done.
     if (pos.getEpSquare() == -1)
         return v;
@@ -441,6 +568,132 @@ int Syzygy::probe_wdl(Position& pos, int *success)
     return v;
 }
 
+// Probe time statistics, accumulated per thread and added to the global
+// counters in batches.
+struct ProbeTimes {
+    int depth = 0; // Number of active ProbeTimer objects
+    uint64_t nProbes = 0;
+    uint64_t probeNs = 0;
+    uint64_t maxProbeNs = 0;
+    uint64_t nSlowProbes = 0;
+};
+
+static std::atomic<int> prefetch_mode(Syzygy::PREFETCH_NONE);
+static thread_local ProbeTimes probe_times;
+static std::atomic<uint64_t> probe_count(0);
+static std::atomic<uint64_t> probe_ns(0);
+static std::atomic<uint64_t> probe_max_ns(0);
+static std::atomic<uint64_t> probe_slow(0);
+
+// Measure the time of a probe_wdl() or probe_dtz() call. Nested calls are
+// included in the outermost call. Probes are only timed when prefetching is
+// enabled, so that normal probes do not pay for reading the clock.
+class ProbeTimer {
+public:
+    ProbeTimer() : pt(probe_times),
+                   active(pt.depth > 0 ||
+                          prefetch_mode.load(std::memory_order_relaxed) != Syzygy::PREFETCH_NONE) {
+        if (active && pt.depth++ == 0)
+            t0 = std::chrono::steady_clock::now();
+    }
+    ~ProbeTimer() {
+        if (!active || --pt.depth > 0)
+            return;
+        auto t1 = std::chrono::steady_clock::now();
+        uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count();
+        pt.nProbes++;
+        pt.probeNs += ns;
+        pt.maxProbeNs = std::max(pt.maxProbeNs, ns);
+        const bool slow = ns > 1000000;
+        if (slow)
+            pt.nSlowProbes++;
+        if (pt.nProbes >= 1024 || slow) {
+            probe_count.fetch_add(pt.nProbes, std::memory_order_relaxed);
+            probe_ns.fetch_add(pt.probeNs, std::memory_order_relaxed);
+            probe_slow.fetch_add(pt.nSlowProbes, std::memory_order_relaxed);
+            uint64_t m = probe_max_ns.load(std::memory_order_relaxed);
+            while (pt.maxProbeNs > m &&
+                   !probe_max_ns.compare_exchange_weak(m, pt.maxProbeNs,
+                                                       std::memory_order_relaxed))
+                ;
+            pt.nProbes = pt.probeNs = pt.maxProbeNs = pt.nSlowProbes = 0;
+        }
+    }
+private:
+    ProbeTimes& pt;
+    const bool active;
+    std::chrono::steady_clock::time_point t0;
+};
+
+int Syzygy::probe_wdl(Position& pos, int *success)
+{
+    ProbeTimer timer;
+    *success = 1;
+    int v = probe_ab(pos, -2, 2, success);
+    return probe_wdl_ep(pos, v, success);
+}
+
+void Syzygy::probe_wdl_batch(Position* pos, int nPos, int* wdl, int* success,
+                             BlockCache& cache)
+{
+    struct Request {
+        struct PairsData *d;
+        uint64_t idx;
+        int i;
+    };
+    std::vector<Request> requests;
+    const int capturesDone = 3;
+    std::vector<int> alpha(nPos);
+    for (int i = 0; i < nPos; i++) {
+        success[i] = 1;
+        alpha[i] = -2;
+        if (probe_ab_captures(pos[i], alpha[i], 2, &success[i], wdl[i])) {
+            alpha[i] = capturesDone;
+            continue;
+        }
+        uint64_t idx;
+        struct PairsData *d = wdl_table_index(pos[i], idx, &success[i]);
+        if (d)
+            requests.push_back(Request{d, idx, i});
+        else
+            wdl[i] = 0;
+    }
+
+    std::sort(requests.begin(), requests.end(), [](const Request& a, const Request& b) {
+        if (a.d != b.d)
+            return a.d < b.d;
+        return a.idx < b.idx;
+    });
+    if (cache.generation != tb_generation) {
+        cache.table = NULL;
+        cache.generation = tb_generation;
+    }
+    cache.values.resize(PAIRS_MAX_BLOCK_VALUES);
+    for (const Request& r : requests) {
+        cache.nProbes++;
+        if (!r.d->idxbits) {
+            wdl[r.i] = r.d->min_len - 2;
+            continue;
+        }
+        uint32_t block;
+        int litidx;
+        find_pairs_block(r.d, r.idx, block, litidx);
+        if (cache.table != r.d || cache.block != block) {
+            decompress_pairs_block(r.d, block, cache.values.data());
+            cache.table = r.d;
+            cache.block = block;
+            cache.nDecoded++;
+        }
+        wdl[r.i] = cache.values[litidx] - 2;
+    }
+
+    for (int i = 0; i < nPos; i++) {
+        if (alpha[i] != capturesDone)
+            wdl[i] = probe_ab_result(alpha[i], wdl[i], &success[i]);
+        wdl[i] = probe_wdl_ep(pos[i], wdl[i], &success[i]);
+    }
+}
+
 // This routine treats a position with en passant captures as one without.
 static int probe_dtz_no_ep(Position& pos, int *success)
 {
@@ -541,6 +794,7 @@ static int wdl_to_dtz[] = {
 
 int Syzygy::probe_dtz(Position& pos, int *success)
 {
+    ProbeTimer timer;
     *success = 1;
     int v = probe_dtz_no_ep(pos, success);
 
@@ -604,3 +858,368 @@ int Syzygy::probe_dtz(Position& pos, int *success)
 
     return v;
 }
+
+// ------------------------------------------------------------
+// Background prefetching of WDL and DTZ tables
+
+
+// Material classes seen by prefetch_material(). A slot contains a material
+// key with the two low bits replaced by the prefetch state, or 0 if unused.
+static const int PREFETCH_SLOTS = 4096;
+static const uint64_t PREFETCH_QUEUED = 1;
+static const uint64_t PREFETCH_DONE = 2;
+static std::atomic<uint64_t> prefetch_slots[PREFETCH_SLOTS];
+
+static std::atomic<uint64_t> prefetch_materials(0);
+static std::atomic<uint64_t> prefetch_tables(0);
+static std::atomic<uint64_t> prefetch_bytes(0);
+static std::atomic<uint64_t> prefetch_ns(0);
+static std::atomic<uint64_t> prefetch_faults(0);
+
+// Like prt_str(), but for the material defined by pcs[16].
+static void prt_str_from_pcs(const int *pcs, char *str, bool mirror)
+{
+    int c1 = mirror ? 8 : 0;
+    int c2 = mirror ? 0 : 8;
+    for (int t = TB_KING; t >= TB_PAWN; t--)
+        for (int i = 0; i < pcs[c1 + t]; i++)
+            *str++ = pchr[TB_KING - t];
+    *str++ = 'v';
+    for (int t = TB_KING; t >= TB_PAWN; t--)
+        for (int i = 0; i < pcs[c2 + t]; i++)
+            *str++ = pchr[TB_KING - t];
+    *str++ = 0;
+}
+
+static uint64_t get_major_faults()
+{
+#ifdef RUSAGE_THREAD
+    struct rusage usage;
+    if (getrusage(RUSAGE_THREAD, &usage) == 0)
+        return usage.ru_majflt;
+#endif
+    return 0;
+}
+
+// Thread that loads and warms WDL and DTZ tables requested by prefetch_material().
+class Prefetcher {
+public:
+    struct Job {
+        int pcs[16];
+        int slot;
+        uint64_t tag;
+        int generation;
+    };
+
+    ~Prefetcher();
+
+    // Add a job to the queue. Start the thread if not already started.
+    void addJob(const Job& job);
+
+private:
+    // Thread main loop.
+    void run();
+
+    // Warm the tables for job.pcs and all materials reachable from it.
+    void warmMaterial(const Job& job);
+
+    // Load and warm one WDL table. Return false if tables were reinitialized
+    // or the thread is stopping.
+    bool warmTable(const int *pcs, uint64_t key, int generation);
+
+    // Load and warm one DTZ table. Return value as for warmTable().
+    bool warmDtzTable(const int *pcs, uint64_t key, int generation);
+
+    // Warm the mapping of a loaded table. "P" must hold prefetch_mutex.
+    // Return value as for warmTable().
+    bool warmMapping(struct TBEntry *ptr, std::unique_lock<std::mutex>& P, int generation);
+
+    // Prepare for warming tables with the given generation. "P" must hold
+    // prefetch_mutex. Return false if the generation is not current.
+    bool checkGeneration(int generation);
+
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::deque<Job> queue;
+    std::atomic<bool> stopped{false};
+    std::thread thread;
+
+    // Tables warmed since the tables were last initialized
+    std::unordered_set<const TBEntry*> warmed;
+    int warmedGeneration = -1;
+};
+
+static Prefetcher prefetcher;
+
+Prefetcher::~Prefetcher()
+{
+    {
+        std::lock_guard<std::mutex> L(mutex);
+        stopped = true;
+    }
+    cv.notify_one();
+    if (thread.joinable())
+        thread.join();
+}
+
+void Prefetcher::addJob(const Job& job)
+{
+    {
+        std::lock_guard<std::mutex> L(mutex);
+        queue.push_back(job);
+        if (!thread.joinable())
+            thread = std::thread([this]() { run(); });
+    }
+    cv.notify_one();
+}
+
+void Prefetcher::run()
+{
+    for (;;) {
+        Job job;
+        {
+            std::unique_lock<std::mutex> L(mutex);
+            cv.wait(L, [this]() { return stopped || !queue.empty(); });
+            if (stopped)
+                return;
+            job = queue.front();
+            queue.pop_front();
+        }
+        warmMaterial(job);
+    }
+}
+
+void Prefetcher::warmMaterial(const Job& job)
+{
+    auto t0 = std::chrono::steady_clock::now();
+    uint64_t faults0 = get_major_faults();
+
+    struct Material {
+        int pcs[16];
+    };
+    std::vector<Material> stack(1);
+    std::copy(job.pcs, job.pcs + 16, stack[0].pcs);
+    std::unordered_set<uint64_t> visited;
+    bool ok = true;
+    while (ok && !stack.empty()) {
+        Material m = stack.back();
+        stack.pop_back();
+        uint64_t key = calc_key_from_pcs(m.pcs, false);
+        if (!visited.insert(key).second)
+            continue;
+        if (key && (!warmTable(m.pcs, key, job.generation) ||
+                    !warmDtzTable(m.pcs, key, job.generation)))
+            ok = false;
+
+        // Materials reachable by a capture or a promotion
+        for (int c = 0; c <= 8; c += 8) {
+            for (int t = TB_PAWN; t <= TB_QUEEN; t++) {
+                if (m.pcs[c + t] == 0)
+                    continue;
+                Material m2 = m;
+                m2.pcs[c + t]--;
+                stack.push_back(m2);
+                if (t == TB_PAWN) {
+                    for (int t2 = TB_KNIGHT; t2 <= TB_QUEEN; t2++) {
+                        m2 = m;
+                        m2.pcs[c + t]--;
+                        m2.pcs[c + t2]++;
+                        stack.push_back(m2);
+                    }
+                }
+            }
+        }
+    }
+
+    if (ok) {
+        uint64_t val = job.tag | PREFETCH_QUEUED;
+        prefetch_slots[job.slot].compare_exchange_strong(val, job.tag | PREFETCH_DONE);
+    }
+
+    auto t1 = std::chrono::steady_clock::now();
+    prefetch_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count();
+    prefetch_faults += get_major_faults() - faults0;
+}
+
+bool Prefetcher::checkGeneration(int generation)
+{
+    if (generation != tb_generation || stopped)
+        return false;
+    if (warmedGeneration != generation) {
+        warmed.clear();
+        warmedGeneration = generation;
+    }
+    return true;
+}
+
+bool Prefetcher::warmTable(const int *pcs, uint64_t key, int generation)
+{
+    std::unique_lock<std::mutex> P(prefetch_mutex);
+    if (!checkGeneration(generation))
+        return false;
+
+    struct TBHashEntry *ptr2 = WDL_hash[key >> (64 - TBHASHBITS)];
+    int i;
+    for (i = 0; i < HSHMAX; i++)
+        if (ptr2[i].key == key) break;
+    if (i == HSHMAX)
+        return true; // Table not available
+
+    struct TBEntry *ptr = ptr2[i].ptr;
+    if (warmed.count(ptr))
+        return true;
+
+    uint8_t ready = ptr->ready.load(std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (!ready) {
+        std::lock_guard<std::mutex> L(TB_mutex);
+        ready = ptr->ready.load(std::memory_order_relaxed);
+        if (!ready) {
+            char str[16];
+            prt_str_from_pcs(pcs, str, ptr->key != key);
+            if (!init_table_wdl(ptr, str)) {
+                ptr2[i].key = 0ULL;
+                return true;
+            }
+            std::atomic_thread_fence(std::memory_order_release);
+            ptr->ready.store(1, std::memory_order_relaxed);
+        }
+    }
+    return warmMapping(ptr, P, generation);
+}
+
+bool Prefetcher::warmDtzTable(const int *pcs, uint64_t key, int generation)
+{
+    std::unique_lock<std::mutex> P(prefetch_mutex);
+    if (!checkGeneration(generation))
+        return false;
+
+    // Same lookup as in probe_dtz_table()
+    DTZTableEntry *dtzTabEnt = DTZ_hash[key >> (64 - TBHASHBITS)];
+    int i;
+    for (i = 0; i < HSHMAX; i++)
+        if (dtzTabEnt[i].key1 == key) break;
+    if (i == HSHMAX) {
+        uint64_t key2 = calc_key_from_pcs(pcs, true);
+        dtzTabEnt = DTZ_hash[key2 >> (64 - TBHASHBITS)];
+        for (i = 0; i < HSHMAX; i++)
+            if (dtzTabEnt[i].key2 == key) break;
+    }
+    if (i == HSHMAX)
+        return true; // Table not available
+    dtzTabEnt += i;
+
+    TBEntry *ptr = dtzTabEnt->entry.load(std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (!ptr) {
+        std::lock_guard<std::mutex> L(TB_mutex);
+        ptr = dtzTabEnt->entry.load(std::memory_order_relaxed);
+        if (!ptr) {
+            struct TBHashEntry *ptr2 = WDL_hash[key >> (64 - TBHASHBITS)];
+            for (i = 0; i < HSHMAX; i++)
+                if (ptr2[i].key == key) break;
+            if (i == HSHMAX)
+                return true;
+            char str[16];
+            bool mirror = (ptr2[i].ptr->key != key);
+            prt_str_from_pcs(pcs, str, mirror);
+            ptr = load_dtz_table(str, calc_key_from_pcs(pcs, mirror));
+            std::atomic_thread_fence(std::memory_order_release);
+            dtzTabEnt->entry.store(ptr, std::memory_order_relaxed);
+        }
+    }
+    if (!ptr || warmed.count(ptr))
+        return true;
+    return warmMapping(ptr, P, generation);
+}
+
+bool Prefetcher::warmMapping(struct TBEntry *ptr, std::unique_lock<std::mutex>& P,
+                             int generation)
+{
+#ifndef _WIN32
+    uint8_t *data = ptr->data;
+    const uint64_t size = ptr->mapping;
+    madvise(data, size, MADV_WILLNEED);
+    if (prefetch_mode == Syzygy::PREFETCH_POPULATE) {
+        // Read one byte per page. The lock is released between chunks so
+        // that reinitializing the tables is not blocked for long.
+        const uint64_t pageSize = sysconf(_SC_PAGESIZE);
+        const uint64_t chunkSize = 1024 * pageSize;
+        uint8_t sum = 0;
+        for (uint64_t chunk = 0; chunk < size; chunk += chunkSize) {
+            const uint64_t end = std::min(chunk + chunkSize, size);
+            for (uint64_t offs = chunk; offs < end; offs += pageSize)
+                sum += ((volatile uint8_t *)data)[offs];
+            P.unlock();
+            P.lock();
+            if (generation != tb_generation || stopped)
+                return false;
+        }
+        (void)sum;
+    }
+    prefetch_bytes += size;
+#endif
+    warmed.insert(ptr);
+    prefetch_tables++;
+    return true;
+}
+
+static void prefetch_reset(void)
+{
+    for (int i = 0; i < PREFETCH_SLOTS; i++)
+        prefetch_slots[i].store(0, std::memory_order_relaxed);
+}
+
+void Syzygy::set_prefetch_mode(int mode)
+{
+    prefetch_mode = std::min(std::max(mode, (int)PREFETCH_NONE), (int)PREFETCH_POPULATE);
+}
+
+bool Syzygy::prefetch_material(const Position& pos)
+{
+    if (prefetch_mode.load(std::memory_order_relaxed) == PREFETCH_NONE)
+        return true;
+
+    uint64_t key = calc_key(pos, false);
+    uint64_t tag = key & ~3ULL;
+    if (!tag)
+        tag = 4;
+    int slot = (key >> 32) % PREFETCH_SLOTS;
+    for (int n = 0; n < 16; n++, slot = (slot + 1) % PREFETCH_SLOTS) {
+        uint64_t val = prefetch_slots[slot].load(std::memory_order_relaxed);
+        if (val == 0) {
+            if (!prefetch_slots[slot].compare_exchange_strong(val, tag | PREFETCH_QUEUED)) {
+                if ((val & ~3ULL) == tag)
+                    return (val & 3) == PREFETCH_DONE;
+                continue;
+            }
+            Prefetcher::Job job;
+            for (int c = 0; c <= 8; c += 8)
+                for (int t = 0; t < 8; t++)
+                    job.pcs[c + t] = (t >= TB_PAWN && t <= TB_KING) ?
+                        BitBoard::bitCount(get_pieces(pos, c >> 3, t)) : 0;
+            job.slot = slot;
+            job.tag = tag;
+            job.generation = tb_generation;
+            prefetch_materials++;
+            prefetcher.addJob(job);
+            return false;
+        }
+        if ((val & ~3ULL) == tag)
+            return (val & 3) == PREFETCH_DONE;
+    }
+    return true; // Too many materials, probe without prefetching
+}
+
+void Syzygy::get_io_stats(IOStats& stats)
+{
+    stats.nProbes = probe_count.load(std::memory_order_relaxed);
+    stats.probeNs = probe_ns.load(std::memory_order_relaxed);
+    stats.maxProbeNs = probe_max_ns.load(std::memory_order_relaxed);
+    stats.nSlowProbes = probe_slow.load(std::memory_order_relaxed);
+    stats.nMaterials = prefetch_materials.load(std::memory_order_relaxed);
+    stats.nTables = prefetch_tables.load(std::memory_order_relaxed);
+    stats.nBytes = prefetch_bytes.load(std::memory_order_relaxed);
+    stats.prefetchNs = prefetch_ns.load(std::memory_order_relaxed);
+    stats.majorFaults = prefetch_faults.load(std::memory_order_relaxed);
+}
@@ -2,8 +2,11 @@
 #define RTB_PROBE_HPP_
 
 #include <string>
+#include <vector>
+#include <stdint.h>
 
 class Position;
+struct PairsData;
 
 namespace Syzygy {
 
@@ -21,6 +24,79 @@ void init(const std::string& path);
 //  2 : win
 int probe_wdl(Position& pos, int *success);
 
+// The most recently decompressed WDL table block, kept between calls to
+// probe_wdl_batch(). An object must only be used by one thread at a time.
+struct BlockCache {
+    const PairsData* table = nullptr;
+    uint32_t block = 0;
+    int generation = -1;
+    std::vector<uint8_t> values;
+
+    uint64_t nProbes = 0;  // Number of table lookups
+    uint64_t nDecoded = 0; // Number of decompressed blocks
+};
+
+// Probe the WDL tables for positions pos[0], ..., pos[nPos-1]. The results
+// are the same as calling probe_wdl() for each position, and are stored in
+// wdl[i] and success[i]. The table lookups are sorted by table and index,
+// and each compressed block is decompressed only once, so this is much
+// faster than individual probes when many positions have the same material,
+// for example when sweeping over all positions in a material class.
+// Capture and en passant probes are not batched. The positions are given
+// explicitly; there is no interface for probing a material class by index
+// range, so callers sweeping a class must construct the positions.
+void probe_wdl_batch(Position* pos, int nPos, int* wdl, int* success,
+                     BlockCache& cache);
+
+// Set the number of decompressed WDL/DTZ blocks kept in the per-thread LRU
+// block cache used by probe_wdl() and probe_dtz(). 0 disables the cache.
+// Each block uses up to 64KB per thread. Blocks are decompressed lazily, up
+// to the largest index looked up in the block.
+void set_block_cache_size(int nBlocks);
+
+// Get statistics for the per-thread LRU block caches, summed over all
+// threads. The counters are updated in batches, so recent probes made by
+// other threads may not be included yet. The calling thread's own probes
+// are always included.
+void get_block_cache_stats(uint64_t& nProbes, uint64_t& nHits);
+
+// How tables are prefetched by prefetch_material().
+enum PrefetchMode {
+    PREFETCH_NONE = 0,     // No prefetching
+    PREFETCH_ADVISE = 1,   // Load tables and madvise(MADV_WILLNEED) their mappings
+    PREFETCH_POPULATE = 2, // Also read all pages into memory
+};
+
+// Set the prefetch mode. PREFETCH_NONE is the default.
+void set_prefetch_mode(int mode);
+
+// Called by the search when it wants to probe a position. The first time a
+// material class is seen, a background thread is asked to warm the WDL and
+// DTZ tables for the material and all materials reachable from it by
+// captures and promotions. Does not block. Returns true if WDL and DTZ probes
+// for the material can be performed, which is when the prefetch mode is
+// PREFETCH_NONE or when the warming has finished.
+bool prefetch_material(const Position& pos);
+
+// Tablebase I/O statistics.
+struct IOStats {
+    uint64_t nProbes = 0;     // Number of probe_wdl() and probe_dtz() calls,
+                              // only counted when prefetching is enabled
+    uint64_t probeNs = 0;     // Total probe time
+    uint64_t maxProbeNs = 0;  // Longest probe time
+    uint64_t nSlowProbes = 0; // Probes taking more than 1ms, typically page faults
+
+    uint64_t nMaterials = 0;  // Material classes queued for prefetching
+    uint64_t nTables = 0;     // Number of prefetched tables
+    uint64_t nBytes = 0;      // Total size of prefetched tables
+    uint64_t prefetchNs = 0;  // Time spent by the prefetch thread
+    uint64_t majorFaults = 0; // Major page faults in the prefetch thread
+};
+
+// Get tablebase I/O statistics. The probe counters are updated in batches,
+// so recent probes may not be included yet.
+void get_io_stats(IOStats& stats);
+
 // Probe the DTZ table for a particular position.
 // If *success != 0, the probe was successful.
 // The return value is from the point of view of the side to move:
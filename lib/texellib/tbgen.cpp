@@ -29,6 +29,8 @@
 #include "constants.hpp"
 #include "transpositionTable.hpp"
 
+#include <thread>
+
 
 static StaticInitializer<TBIndex> tbIdxInit;
 
@@ -475,120 +477,198 @@ TBGenerator<TBStorage>::TBGenerator(TBStorage& storage, const PieceCount& pc)
     table.resize(tbPos.nPositions());
 }
 
+/** Call func(threadNo, beg, end) for consecutive index ranges covering [0,size),
+ *  using nThreads threads. Range boundaries are multiples of chunkSize. Ranges
+ *  are handed out dynamically, so uneven work is balanced between threads. */
+template <typename Func>
+static void
+parallelFor(int nThreads, U64 size, U64 chunkSize, Func func) {
+    std::atomic<U64> next(0);
+    auto worker = [&](int threadNo) {
+        while (true) {
+            U64 beg = next.fetch_add(chunkSize);
+            if (beg >= size)
+                break;
+            func(threadNo, beg, std::min(beg + chunkSize, size));
+        }
+    };
+    std::vector<std::thread> threads;
+    for (int i = 1; i < nThreads; i++)
+        threads.emplace_back(worker, i);
+    worker(0);
+    for (auto& t : threads)
+        t.join();
+}
+
+template <typename TBStorage>
+void
+TBGenerator<TBStorage>::setBit(std::vector<std::atomic<U64>>& bits, U32 idx) {
+    std::atomic<U64>& w = bits[idx / 64];
+    U64 mask = 1ULL << (idx % 64);
+    if (!(w.load(std::memory_order_relaxed) & mask))
+        w.fetch_or(mask, std::memory_order_relaxed);
+}
+
 template <typename TBStorage>
 bool
-TBGenerator<TBStorage>::generate(RelaxedShared<S64>& maxTimeMillis, bool verbose) {
+TBGenerator<TBStorage>::generate(RelaxedShared<S64>& maxTimeMillis, bool verbose,
+                                 int nThreads) {
     double t0 = currentTime();
-
-    TBPosition tbPos(pieceCount);
-    const U32 nPos = tbPos.nPositions();
-    std::vector<U8> newMated, oldMated;
-    size_t bitSize = nPos / 64;
-    newMated.resize(bitSize);
-    oldMated.resize(bitSize);
+    nThreads = std::max(nThreads, 1);
+
+    std::vector<TBPosition> tbPositions(nThreads, TBPosition(pieceCount));
+    const U32 nPos = tbPositions[0].nPositions();
+
+    // One bit per position, set for positions that became MATED_IN_N in the
+    // previous/current iteration.
+    const size_t bitSize = (nPos + 63) / 64;
+    std::vector<std::atomic<U64>> newMated(bitSize), oldMated(bitSize);
+    for (size_t i = 0; i < bitSize; i++)
+        newMated[i].store(0, std::memory_order_relaxed);
+
+    // Range boundaries are multiples of 64, so threads never store to
+    // positions sharing the same storage word in the first passes.
+    const U64 chunkSize = 0x10000;
+    std::atomic<bool> timeout(false);
+    auto checkTime = [&]() -> bool {
+        if (timeout.load(std::memory_order_relaxed))
+            return false;
+        if ((maxTimeMillis >= 0) && (currentTime() - t0 > 0.3e-3 * maxTimeMillis)) {
+            timeout.store(true, std::memory_order_relaxed);
+            return false;
+        }
+        return true;
+    };
 
     // Classify positions into INVALID, MATE_IN_0 and UNKNOWN
-    PositionValue pv;
-    for (U32 idx = 0; idx < nPos; idx++) {
-        if (((idx & 0xffff) == 0) && (maxTimeMillis >= 0)) {
-            double t = currentTime();
-            if (t - t0 > 0.3e-3 * maxTimeMillis)
-                return false;
-        }
-        tbPos.setIndex(idx);
-        if (!tbPos.indexValid()) {
-            pv.setInvalid();
-        } else if (tbPos.canTakeKing()) {
-            pv.setMateInN(0);
-        } else {
-            pv.setUnknown();
+    parallelFor(nThreads, nPos, chunkSize, [&](int threadNo, U32 beg, U32 end) {
+        if (!checkTime())
+            return;
+        TBPosition& tbPos = tbPositions[threadNo];
+        PositionValue pv;
+        for (U32 idx = beg; idx < end; idx++) {
+            tbPos.setIndex(idx);
+            if (!tbPos.indexValid()) {
+                pv.setInvalid();
+            } else if (tbPos.canTakeKing()) {
+                pv.setMateInN(0);
+            } else {
+                pv.setUnknown();
+            }
+            table.store(idx, pv);
         }
-        table.store(idx, pv);
-    }
+    });
+    if (timeout)
+        return false;
 
     // Classify positions into MATED_IN_0, DRAW (stalemate), and REMAINING_N
-    for (U32 idx = 0; idx < nPos; idx++) {
-        if (((idx & 0xffff) == 0) && (maxTimeMillis >= 0)) {
-            double t = currentTime();
-            if (t - t0 > 0.3e-3 * maxTimeMillis)
-                return false;
-        }
-        if (!table[idx].isUnknown())
-            continue;
-        tbPos.setIndex(idx);
-        TbMoveList moves;
-        tbPos.getMoves(moves);
-        int nLegal = 0;
-        for (int m = 0; m < moves.getSize(); m++) {
-            if (m > 0 && moves[m] == moves[m-1])
-                continue; // Skip duplicated moves
-            int idx2 = moves[m];
-            if (!table[idx2].isMateInN(0))
-                nLegal++;
-        }
-        if (nLegal > 0) {
-            pv.setRemaining(nLegal);
-        } else {
-            tbPos.swapSide();
-            int idx2 = tbPos.getIndex();
-            if (table[idx2].isMateInN(0)) {
-                pv.setMatedInN(0);
-                newMated[idx>>6] = 1;
+    parallelFor(nThreads, nPos, chunkSize, [&](int threadNo, U32 beg, U32 end) {
+        if (!checkTime())
+            return;
+        TBPosition& tbPos = tbPositions[threadNo];
+        PositionValue pv;
+        for (U32 idx = beg; idx < end; idx++) {
+            if (!table[idx].isUnknown())
+                continue;
+            tbPos.setIndex(idx);
+            TbMoveList moves;
+            tbPos.getMoves(moves);
+            int nLegal = 0;
+            for (int m = 0; m < moves.getSize(); m++) {
+                if (m > 0 && moves[m] == moves[m-1])
+                    continue; // Skip duplicated moves
+                int idx2 = moves[m];
+                if (!table[idx2].isMateInN(0))
+                    nLegal++;
+            }
+            if (nLegal > 0) {
+                pv.setRemaining(nLegal);
             } else {
-                pv.setDraw();
+                tbPos.swapSide();
+                int idx2 = tbPos.getIndex();
+                if (table[idx2].isMateInN(0)) {
+                    pv.setMatedInN(0);
+                    setBit(newMated, idx);
+                } else {
+                    pv.setDraw();
+                }
             }
+            table.store(idx, pv);
         }
-        table.store(idx, pv);
-    }
+    });
+    if (timeout)
+        return false;
 
     double t1 = currentTime();
 
-    // Find all MATE_IN_N and MATED_IN_N positions
+    // Find all MATE_IN_N and MATED_IN_N positions. Several threads can update
+    // the same position, so all updates use compareExchange(). A position is
+    // only expanded by the thread that changed it to MATE_IN_N. The result
+    // does not depend on the thread scheduling.
     for (int n = 1; ; n++) {
         if (maxTimeMillis == 0)
             return false; // Cancelled by UCI stop command
         double t2 = currentTime();
-        int modified = 0;
-        int handled = 0;
+        std::atomic<int> modified(0);
+        std::atomic<int> handled(0);
         oldMated.swap(newMated);
-        for (size_t i = 0; i < bitSize; i++) newMated[i] = 0;
-        for (U32 idx = 0; idx < nPos; idx++) {
-            if (((idx & 63) == 0) && !oldMated[idx>>6]) {
-                idx += 63;
-                continue;
-            }
-            if (!table[idx].isMatedInN(n-1))
-                continue;
-            tbPos.setIndex(idx);
-            handled++;
-            TbMoveList lst;
-            tbPos.getUnMoves(lst);
-            for (int m1 = 0; m1 < lst.getSize(); m1++) {
-                if (m1 > 0 && lst[m1] == lst[m1-1])
-                    continue; // Skip duplicated moves
-                int idx2 = lst[m1];
-                tbPos.setIndex(idx2);
-                if (!table[idx2].isComputed()) {
-                    modified++;
-                    pv.setMateInN(n); table.store(idx2, pv);
-                    TbMoveList lst2;
-                    tbPos.getUnMoves(lst2);
-                    for (int m2 = 0; m2 < lst2.getSize(); m2++) {
-                        if (m2 > 0 && lst2[m2] == lst2[m2-1])
+        for (size_t i = 0; i < bitSize; i++)
+            newMated[i].store(0, std::memory_order_relaxed);
+        parallelFor(nThreads, bitSize, chunkSize / 64, [&](int threadNo, U64 beg, U64 end) {
+            TBPosition& tbPos = tbPositions[threadNo];
+            int nModified = 0;
+            int nHandled = 0;
+            PositionValue mateInN;
+            mateInN.setMateInN(n);
+            for (U64 w = beg; w < end; w++) {
+                U64 m = oldMated[w].load(std::memory_order_relaxed);
+                while (m) {
+                    U32 idx = w * 64 + BitBoard::extractSquare(m);
+                    tbPos.setIndex(idx);
+                    nHandled++;
+                    TbMoveList lst;
+                    tbPos.getUnMoves(lst);
+                    for (int m1 = 0; m1 < lst.getSize(); m1++) {
+                        if (m1 > 0 && lst[m1] == lst[m1-1])
                             continue; // Skip duplicated moves
-                        int idx3 = lst2[m2];
-                        pv = table[idx3];
-                        if (pv.isRemainingN()) {
-                            if (pv.decRemaining()) {
-                                pv.setMatedInN(n);
-                                newMated[idx3>>6] = 1;
+                        int idx2 = lst[m1];
+                        PositionValue pv = table[idx2];
+                        bool changed = false;
+                        while (!pv.isComputed()) {
+                            if (table.compareExchange(idx2, pv, mateInN)) {
+                                changed = true;
+                                break;
+                            }
+                        }
+                        if (!changed)
+                            continue;
+                        nModified++;
+                        tbPos.setIndex(idx2);
+                        TbMoveList lst2;
+                        tbPos.getUnMoves(lst2);
+                        for (int m2 = 0; m2 < lst2.getSize(); m2++) {
+                            if (m2 > 0 && lst2[m2] == lst2[m2-1])
+                                continue; // Skip duplicated moves
+                            int idx3 = lst2[m2];
+                            pv = table[idx3];
+                            while (pv.isRemainingN()) {
+                                PositionValue newPv(pv);
+                                bool mated = newPv.decRemaining();
+                                if (mated)
+                                    newPv.setMatedInN(n);
+                                if (table.compareExchange(idx3, pv, newPv)) {
+                                    if (mated)
+                                        setBit(newMated, idx3);
+                                    break;
+                                }
                             }
-                            table.store(idx3, pv);
                         }
                     }
                 }
             }
-        }
+            modified += nModified;
+            handled += nHandled;
+        });
         double t3 = currentTime();
         if (verbose)
             std::cout << "n: " << std::setw(2) << n << " handled: " << std::setw(8) << handled
@@ -602,11 +682,13 @@ TBGenerator<TBStorage>::generate(RelaxedShared<S64>& maxTimeMillis, bool verbose
     }
 
     // Remaining positions are DRAW
-    for (U32 idx = 0; idx < nPos; idx++) {
-        if (table[idx].isRemainingN()) {
-            pv.setDraw(); table.store(idx, pv);
-        }
-    }
+    parallelFor(nThreads, nPos, chunkSize, [&](int threadNo, U32 beg, U32 end) {
+        PositionValue pv;
+        pv.setDraw();
+        for (U32 idx = beg; idx < end; idx++)
+            if (table[idx].isRemainingN())
+                table.store(idx, pv);
+    });
 
     return true;
 }
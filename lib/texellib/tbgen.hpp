@@ -29,6 +29,8 @@
 #include "util/util.hpp"
 
 #include <algorithm>
+#include <atomic>
+#include <vector>
 #include <cassert>
 
 
@@ -252,14 +254,18 @@ private:
 };
 
 
-/** TB storage type that stores data in a private vector. */
+/** TB storage type that stores data in a private vector.
+ *  All operations can be used concurrently from several threads. */
 class VectorStorage {
 public:
-    void resize(U32 size) { table.resize(size); }
-    const PositionValue operator[](U32 idx) const { return table[idx]; }
-    void store(U32 idx, PositionValue pv) { table[idx] = pv; }
+    void resize(U32 size);
+    const PositionValue operator[](U32 idx) const;
+    void store(U32 idx, PositionValue pv);
+    /** If the value at idx equals "expected", replace it with "desired" and
+     *  return true. Otherwise set "expected" to the current value and return false. */
+    bool compareExchange(U32 idx, PositionValue& expected, PositionValue desired);
 private:
-    std::vector<PositionValue> table;
+    std::vector<std::atomic<U8>> table;
 };
 
 
@@ -272,8 +278,9 @@ public:
      * rooks, bishops and knights. Pawns are not supported. */
     TBGenerator(TBStorage& storage, const PieceCount& pc);
 
-    /** Generate the tablebase. */
-    bool generate(RelaxedShared<S64>& maxTimeMillis, bool verbose);
+    /** Generate the tablebase using "nThreads" threads. Return false if
+     *  the computation was aborted because of the time limit. */
+    bool generate(RelaxedShared<S64>& maxTimeMillis, bool verbose, int nThreads = 1);
 
     /** Probe tablebase.
      * @param pos  The position to probe.
@@ -287,12 +294,44 @@ private:
     /** Get the TB PositionValue as an integer for the current position. */
     int getValue(TBPosition& tbPos) const;
 
+    /** Set bit "idx" in a bit set. Can be called concurrently from several threads. */
+    static void setBit(std::vector<std::atomic<U64>>& bits, U32 idx);
+
     PieceCount pieceCount;
     TBStorage& table;
 };
 
 
 
+inline void
+VectorStorage::resize(U32 size) {
+    std::vector<std::atomic<U8>> tmp(size);
+    table.swap(tmp);
+    PositionValue pv;
+    for (U32 i = 0; i < size; i++)
+        store(i, pv);
+}
+
+inline const PositionValue
+VectorStorage::operator[](U32 idx) const {
+    return PositionValue(table[idx].load(std::memory_order_relaxed));
+}
+
+inline void
+VectorStorage::store(U32 idx, PositionValue pv) {
+    table[idx].store((U8)pv.getState(), std::memory_order_relaxed);
+}
+
+inline bool
+VectorStorage::compareExchange(U32 idx, PositionValue& expected, PositionValue desired) {
+    U8 e = (U8)expected.getState();
+    bool ret = table[idx].compare_exchange_strong(e, (U8)desired.getState(),
+                                                  std::memory_order_relaxed);
+    expected = PositionValue(e);
+    return ret;
+}
+
+
 inline
 PositionValue::PositionValue()
     : state(State::UNINITIALIZED) {
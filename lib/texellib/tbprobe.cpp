@@ -31,6 +31,9 @@
 #include "moveGen.hpp"
 #include "constants.hpp"
 #include <unordered_map>
+#include <limits>
+#include <sstream>
+#include <iostream>
 #include <cassert>
 
 #include "util/timeUtil.hpp"
@@ -83,6 +86,38 @@ TBProbe::initialize(const std::string& gtbPath, int cacheMB,
     TBProbeData::maxPieces = std::max({4, gtbMaxPieces, Syzygy::TBLargest});
 }
 
+void
+TBProbe::setRtbBlockCache(int nBlocks) {
+    Syzygy::set_block_cache_size(nBlocks);
+}
+
+void
+TBProbe::setRtbPrefetch(int mode) {
+    Syzygy::set_prefetch_mode(mode);
+}
+
+void
+TBProbe::printStats(std::ostream& os, const std::string& prefix) {
+    uint64_t nProbes, nHits;
+    Syzygy::get_block_cache_stats(nProbes, nHits);
+    std::stringstream ss;
+    ss.precision(2);
+    ss << std::fixed << prefix << "tbstat: blockCache probes:" << nProbes
+       << " hits:" << nHits << " misses:" << (nProbes - nHits)
+       << " (" << (nProbes > 0 ? nHits * 100.0 / nProbes : 0.0) << "%)" << std::endl;
+    Syzygy::IOStats io;
+    Syzygy::get_io_stats(io);
+    ss << prefix << "tbstat: probes:" << io.nProbes
+       << " avgUs:" << (io.nProbes > 0 ? io.probeNs * 1e-3 / io.nProbes : 0.0)
+       << " maxUs:" << io.maxProbeNs * 1e-3
+       << " slow:" << io.nSlowProbes << std::endl;
+    ss << prefix << "tbstat: prefetch materials:" << io.nMaterials << " tables:" << io.nTables
+       << " MB:" << io.nBytes / (1024.0 * 1024.0)
+       << " ms:" << io.prefetchNs * 1e-6
+       << " majorFaults:" << io.majorFaults << std::endl;
+    os << ss.str();
+}
+
 bool
 TBProbe::tbEnabled() {
     return Syzygy::TBLargest > 0 || gtbMaxPieces > 0;
@@ -136,7 +171,8 @@ TBProbe::tbProbe(Position& pos, int ply, int alpha, int beta,
     bool hasResult = false;
     bool checkABBound = false;
     int wdlScore;
-    if (nPieces <= Syzygy::TBLargest && rtbProbeWDL(pos, ply, wdlScore, ent)) {
+    const bool rtbReady = nPieces <= Syzygy::TBLargest && Syzygy::prefetch_material(pos);
+    if (rtbReady && rtbProbeWDL(pos, ply, wdlScore, ent)) {
         if ((wdlScore == 0) || (hmc == 0))
             hasResult = true;
         else
@@ -204,7 +240,7 @@ TBProbe::tbProbe(Position& pos, int ply, int alpha, int beta,
 
     // Try RTB DTZ probe
     int dtzScore;
-    if (nPieces <= Syzygy::TBLargest && rtbProbeDTZ(pos, ply, dtzScore, ent)) {
+    if (rtbReady && rtbProbeDTZ(pos, ply, dtzScore, ent)) {
         hasResult = true;
         ent.setScore(dtzScore, ply);
         if (dtzScore > 0) {
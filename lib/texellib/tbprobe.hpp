@@ -31,6 +31,7 @@
 #include "parameters.hpp"
 
 #include <string>
+#include <iosfwd>
 
 
 class MoveList;
@@ -50,6 +51,21 @@ public:
     static void initialize(const std::string& gtbPath, int cacheMB,
                            const std::string& rtbPath);
 
+    /** Set the number of decompressed syzygy blocks cached by each search
+     *  thread. 0 disables the cache. */
+    static void setRtbBlockCache(int nBlocks);
+
+    /** Set how syzygy tables are prefetched when the search first probes a
+     *  material class. 0 = no prefetch, 1 = madvise(MADV_WILLNEED),
+     *  2 = read all pages. For 1 and 2, search probes for a material class
+     *  are skipped until its tables have been prefetched by a background
+     *  thread, so that search threads do not block on disk. */
+    static void setRtbPrefetch(int mode);
+
+    /** Print syzygy block cache and I/O statistics to "os". Each line starts
+     *  with "prefix". The statistics are summed over all threads. */
+    static void printStats(std::ostream& os, const std::string& prefix);
+
     /** Return true if GTB or RTB probing is enabled. */
     static bool tbEnabled();
 
@@ -28,9 +28,13 @@
 #include "moveGen.hpp"
 #include "textio.hpp"
 #include "largePageAlloc.hpp"
+#include "numa.hpp"
+#include "util/alignedAlloc.hpp"
 
 #include <iostream>
 #include <iomanip>
+#include <thread>
+#include <cassert>
 
 
 TranspositionTable::TranspositionTable(U64 numEntries)
@@ -39,28 +43,32 @@ TranspositionTable::TranspositionTable(U64 numEntries)
 }
 
 void
-TranspositionTable::reSize(U64 numEntries) {
+TranspositionTable::reSize(U64 numEntries, bool compact) {
     if (numEntries < 4)
         numEntries = 4;
+    if (compact)
+        numEntries &= ~3ULL;
+    this->compact = compact;
 
-    tableV.clear();
-    tableLP.reset();
+    tableMem.reset();
     table = nullptr;
     tableSize = 0;
 
-    tableLP = LargePageAlloc::allocate<TTEntryStorage>(numEntries);
-    if (tableLP) {
-        table = tableLP.get();
-    } else {
-        tableV.resize(numEntries);
-        table = &tableV[0];
+    tableMem = LargePageAlloc::allocate<TTEntryStorage>(numEntries);
+    if (!tableMem) {
+        AlignedAllocator<TTEntryStorage> alloc;
+        tableMem.reset(alloc.allocate(numEntries),
+                       [numEntries](TTEntryStorage* p) {
+                           AlignedAllocator<TTEntryStorage>().deallocate(p, numEntries);
+                       });
     }
+    table = tableMem.get();
     tableSize = numEntries;
+    if (!Numa::instance().interleaveMemory(table, tableSize * sizeof(TTEntryStorage)))
+        std::cout << "info string Failed to interleave hash table over NUMA nodes" << std::endl;
 
     generation = 0;
-    setUsedSize(tableSize);
-    tbGen.reset();
-    notUsedCnt = 0;
+    clear();
 }
 
 void TranspositionTable::setUsedSize(U64 s) {
@@ -73,6 +81,7 @@ void TranspositionTable::setUsedSize(U64 s) {
     }
     usedSizeTopBits = (int)topBits;
     usedSizeMask = ((1ULL << usedSizeShift) - 1) & ~3ULL;
+    assert(!compact || usedSizeShift <= compactFragShift);
 }
 
 void
@@ -80,9 +89,36 @@ TranspositionTable::clear() {
     setUsedSize(tableSize);
     tbGen.reset();
     notUsedCnt = 0;
-    TTEntry ent;
-    for (size_t i = 0; i < tableSize; i++)
-        ent.store(table[i]);
+    clearTable();
+}
+
+void
+TranspositionTable::clearTable() {
+    const int nNodes = Numa::instance().getNumNodes();
+    const U64 chunkSize = (2*1024*1024) / sizeof(TTEntryStorage);
+    const U64 nChunks = (tableSize + chunkSize - 1) / chunkSize;
+    auto clearChunks = [this,nNodes,chunkSize,nChunks](int node) {
+        TTEntry ent;
+        for (U64 c = node; c < nChunks; c += nNodes) {
+            U64 end = std::min((c + 1) * chunkSize, tableSize);
+            for (U64 i = c * chunkSize; i < end; i++)
+                ent.store(table[i]);
+        }
+    };
+
+    if (nNodes <= 1 || nChunks <= 1) {
+        clearChunks(0);
+        return;
+    }
+    std::vector<std::thread> threads;
+    for (int n = 0; n < nNodes; n++) {
+        threads.emplace_back([&clearChunks,n]() {
+            Numa::instance().bindThreadToNode(n);
+            clearChunks(n);
+        });
+    }
+    for (auto& t : threads)
+        t.join();
 }
 
 void
@@ -100,6 +136,10 @@ TranspositionTable::insert(U64 key, const Move& sm, int type, int ply, int depth
                            bool busy) {
     key ^= contemptHash;
     if (depth < 0) depth = 0;
+    if (compact) {
+        insertCompact(key, sm, type, ply, depth, evalScore, busy);
+        return;
+    }
     size_t idx0 = getIndex(key);
     TTEntry ent, tmp;
     size_t idx = idx0;
@@ -118,28 +158,76 @@ TranspositionTable::insert(U64 key, const Move& sm, int type, int ply, int depth
             idx = idx1;
         }
     }
-    bool doStore = true;
+    if (updateEntry(ent, key, sm, type, ply, depth, evalScore, busy))
+        ent.store(table[idx]);
+}
+
+void
+TranspositionTable::insertCompact(U64 key, const Move& sm, int type, int ply, int depth,
+                                  int evalScore, bool busy) {
+    CompactBucket& b = getBucket(key);
+    const U16 frag = keyFragment(key);
+    TTEntry ent, tmp;
+    int idx = -1;
+    U16 oldFrag = compactEmpty;
+    for (int i = 0; i < compactEntries; i++) {
+        U16 f = b.frag[i].load(std::memory_order_acquire);
+        if (f == compactLocked)
+            continue; // Being written by another thread
+        U64 data = b.data[i].load(std::memory_order_relaxed);
+        tmp = TTEntry(f == frag ? key : ~key, f == compactEmpty ? 0 : data);
+        if (f == frag) {
+            ent = tmp;
+            idx = i;
+            oldFrag = f;
+            break;
+        } else if (idx < 0 || ent.betterThan(tmp, generation)) {
+            ent = tmp;
+            idx = i;
+            oldFrag = f;
+        }
+    }
+    if (idx < 0)
+        return;
+    if (updateEntry(ent, key, sm, type, ply, depth, evalScore, busy))
+        storeCompact(b, idx, oldFrag, frag, ent.getData());
+}
+
+bool
+TranspositionTable::updateEntry(TTEntry& ent, U64 key, const Move& sm, int type, int ply,
+                                int depth, int evalScore, bool busy) const {
     if (!busy) {
         if ((ent.getKey() == key) && (ent.getDepth() > depth) && (ent.getType() == type)) {
             if (type == TType::T_EXACT)
-                doStore = false;
+                return false;
             else if ((type == TType::T_GE) && (sm.score() <= ent.getScore(ply)))
-                doStore = false;
+                return false;
             else if ((type == TType::T_LE) && (sm.score() >= ent.getScore(ply)))
-                doStore = false;
+                return false;
         }
     }
-    if (doStore) {
-        if ((ent.getKey() != key) || (sm.from() != sm.to()))
-            ent.setMove(sm);
-        ent.setKey(key);
-        ent.setScore(sm.score(), ply);
-        ent.setDepth(depth);
-        ent.setBusy(busy);
-        ent.setGeneration((S8)generation);
-        ent.setType(type);
-        ent.setEvalScore(evalScore);
-        ent.store(table[idx]);
+    if ((ent.getKey() != key) || (sm.from() != sm.to()))
+        ent.setMove(sm);
+    ent.setKey(key);
+    ent.setScore(sm.score(), ply);
+    ent.setDepth(depth);
+    ent.setBusy(busy);
+    ent.setGeneration((S8)generation);
+    ent.setType(type);
+    ent.setEvalScore(evalScore);
+    return true;
+}
+
+void
+TranspositionTable::loadEntry(U64 idx, TTEntry& ent) const {
+    if (compact) {
+        const CompactBucket& b = reinterpret_cast<const CompactBucket&>(table[idx / compactEntries * 4]);
+        const int i = idx % compactEntries;
+        U16 f = b.frag[i].load(std::memory_order_relaxed);
+        U64 data = b.data[i].load(std::memory_order_relaxed);
+        ent = TTEntry(0, (f == compactEmpty || f == compactLocked) ? 0 : data);
+    } else {
+        ent.load(table[idx]);
     }
 }
 
@@ -235,9 +323,10 @@ TranspositionTable::printStats(int rootDepth) const {
     int unused = 0;
     int thisGen = 0;
     std::vector<int> depHist;
-    for (size_t i = 0; i < tableSize; i++) {
+    const U64 nEntries = numEntries();
+    for (U64 i = 0; i < nEntries; i++) {
         TTEntry ent;
-        ent.load(table[i]);
+        loadEntry(i, ent);
         if (ent.getType() == TType::T_EMPTY) {
             unused++;
         } else {
@@ -249,10 +338,10 @@ TranspositionTable::printStats(int rootDepth) const {
             depHist[d]++;
         }
     }
-    double w = 100.0 / tableSize;
+    double w = 100.0 / nEntries;
     std::stringstream ss;
     ss.precision(2);
-    ss << std::fixed << "hstat: d:" << rootDepth << " size:" << tableSize
+    ss << std::fixed << "hstat: d:" << rootDepth << " size:" << nEntries
        << " unused:" << unused << " (" << (unused*w) << "%)"
        << " thisGen:" << thisGen << " (" << (thisGen*w) << "%)" << std::endl;
     std::cout << ss.str();
@@ -271,12 +360,12 @@ TranspositionTable::printStats(int rootDepth) const {
 
 int
 TranspositionTable::getHashFull() const {
-    if (tableSize < 1000)
+    if (numEntries() < 1000)
         return 0;
     int hashFull = 0;
     for (int i = 0; i < 1000; i++) {
         TTEntry ent;
-        ent.load(table[i]);
+        loadEntry(i, ent);
         if ((ent.getType() != TType::T_EMPTY) &&
             (ent.getGeneration() == generation))
             hashFull++;
@@ -287,7 +376,8 @@ TranspositionTable::getHashFull() const {
 // --------------------------------------------------------------------------------
 
 bool
-TranspositionTable::updateTB(const Position& pos, RelaxedShared<S64>& maxTimeMillis) {
+TranspositionTable::updateTB(const Position& pos, RelaxedShared<S64>& maxTimeMillis,
+                             int nThreads) {
     if (BitBoard::bitCount(pos.occupiedBB()) > 4 ||
         pos.pieceTypeBB(Piece::WPAWN, Piece::BPAWN)) { // pos not suitable for TB generation
         if (tbGen && notUsedCnt++ > 3) {
@@ -324,7 +414,7 @@ TranspositionTable::updateTB(const Position& pos, RelaxedShared<S64>& maxTimeMil
     pc.nbn = BitBoard::bitCount(pos.pieceTypeBB(Piece::BKNIGHT));
 
     tbGen = make_unique<TBGenerator<TTStorage>>(ttStorage, pc);
-    if (!tbGen->generate(maxTimeMillis, false)) {
+    if (!tbGen->generate(maxTimeMillis, false, nThreads)) {
         // Increase requiredTime unless computation was aborted
         S64 maxT = maxTimeMillis;
         if (maxT != 0)
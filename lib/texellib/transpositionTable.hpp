@@ -31,13 +31,18 @@
 #include "constants.hpp"
 #include "util/alignedAlloc.hpp"
 #include "tbgen.hpp"
+#include "bitBoard.hpp"
 
 #include <memory>
 #include <vector>
+#include <atomic>
 
 #if _MSC_VER
 #include <xmmintrin.h>
 #endif
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 class Position;
 class TranspositionTable;
@@ -52,6 +57,7 @@ public:
 
     const PositionValue operator[](U32 idx) const;
     void store(U32 idx, PositionValue pv);
+    bool compareExchange(U32 idx, PositionValue& expected, PositionValue desired);
 
 private:
     TranspositionTable& table;
@@ -60,7 +66,9 @@ private:
 
 
 /**
- * Implements the main transposition table using Cuckoo hashing.
+ * Implements the main transposition table. An entry is stored in one of 4
+ * consecutive slots, or in one of 6 slots in a 64-byte bucket if the compact
+ * layout is used.
  */
 class TranspositionTable {
 private:
@@ -75,6 +83,30 @@ private:
     };
     static_assert(sizeof(TTEntryStorage) == 16, "TTEntryStorage size wrong");
 
+    /** In-memory representation of a bucket in the compact layout. Occupies
+     * the same memory as 4 TTEntryStorage objects. Stores 6 entries, each
+     * consisting of a 16-bit key fragment and the TTEntry data. The key bits
+     * used by getIndex() are implied by the bucket position.
+     * A writer first changes the fragment to compactLocked using compare and
+     * exchange, so only one thread at a time can write an entry. A reader
+     * checks that the fragment is unchanged after reading the data. */
+    struct CompactBucket {
+        alignas(16) std::atomic<U16> frag[8]; // Key fragment, compactEmpty or compactLocked
+        std::atomic<U64> data[6];
+    };
+    static_assert(sizeof(CompactBucket) == 64, "CompactBucket size wrong");
+    // matchFragments() reads all fragments with one 16-byte vector load, which
+    // requires the atomics to be plain lock-free 16-bit values.
+    static_assert(sizeof(std::atomic<U16>) == sizeof(U16), "atomic<U16> size wrong");
+    static_assert(alignof(std::atomic<U16>) == alignof(U16), "atomic<U16> alignment wrong");
+    static_assert(ATOMIC_SHORT_LOCK_FREE == 2, "atomic<U16> not lock free");
+    static const int compactEntries = 6;
+    static const U16 compactEmpty = 0;
+    static const U16 compactLocked = 1;
+    /** First key bit of the fragment. getIndex() uses bits 48-63 and bits
+     *  0 to usedSizeShift-1, so usedSizeShift must not exceed this value. */
+    static const int compactFragShift = 32;
+
 public:
     /** A local copy of a transposition table entry. */
     class TTEntry {
@@ -142,7 +174,15 @@ public:
     TranspositionTable(const TranspositionTable& other) = delete;
     TranspositionTable operator=(const TranspositionTable& other) = delete;
 
-    void reSize(U64 numEntries);
+    /** Resize the table to numEntries TTEntryStorage slots. If "compact" is
+     *  true, the same memory is used for 1.5 times as many entries. */
+    void reSize(U64 numEntries, bool compact = false);
+
+    /** Return true if the compact layout is used. */
+    bool isCompact() const { return compact; }
+
+    /** Return the number of entries that fit in the table. */
+    U64 numEntries() const;
 
     void setWhiteContempt(int contempt);
 
@@ -186,10 +226,11 @@ public:
 
     /**
      * Possibly create or remove a tablebase based on the provided root position
-     * and available thinking time.
+     * and available thinking time. "nThreads" threads are used to generate
+     * the tablebase.
      * Return true if TBs are available.
      */
-    bool updateTB(const Position& pos, RelaxedShared<S64>& maxTimeMillis);
+    bool updateTB(const Position& pos, RelaxedShared<S64>& maxTimeMillis, int nThreads);
 
     /** Probe tablebase.
      * @param pos  The position to probe.
@@ -202,6 +243,9 @@ public:
     /** Low-level methods to read/write a single byte in the table. Used by TB generator code. */
     U8 getByte(U64 idx);
     void putByte(U64 idx, U8 value);
+    /** Atomically replace byte at idx with "desired" if it equals "expected".
+     *  Otherwise set "expected" to the current value. Return true if replaced. */
+    bool compareExchangeByte(U64 idx, U8& expected, U8 desired);
     U64 byteSize() const;
 
 private:
@@ -211,8 +255,39 @@ private:
     /** Get position in hash table given zobrist key. */
     size_t getIndex(U64 key) const;
 
+    /** Update "ent" for a new search result. Return false if the existing
+     *  entry is more valuable than the new result. */
+    bool updateEntry(TTEntry& ent, U64 key, const Move& sm, int type, int ply,
+                     int depth, int evalScore, bool busy) const;
+
+    /** Load entry number "idx", for statistics. The key is not restored. */
+    void loadEntry(U64 idx, TTEntry& ent) const;
+
+    /** Compact layout versions of probe() and insert(). */
+    void probeCompact(U64 key, TTEntry& result);
+    void insertCompact(U64 key, const Move& sm, int type, int ply, int depth,
+                       int evalScore, bool busy);
+
+    /** Get the compact bucket for a key. */
+    CompactBucket& getBucket(U64 key) const;
+
+    /** Get the key fragment stored in the compact layout. */
+    static U16 keyFragment(U64 key);
+
+    /** Return a mask with bit 2*i set if b.frag[i] == frag, i < compactEntries. */
+    static U64 matchFragments(const CompactBucket& b, U16 frag);
+
+    /** Store entry "i" in bucket "b", unless its fragment has been changed
+     *  from "oldFrag" by another thread. */
+    static void storeCompact(CompactBucket& b, int i, U16 oldFrag, U16 frag, U64 data);
+
+    /** Clear all entries in the table. If NUMA is used, the table is cleared
+     *  by one thread per NUMA node, so that on first touch the memory pages
+     *  are spread over all nodes. */
+    void clearTable();
 
-    TTEntryStorage* table; // Points to either tableV or tableLP
+
+    TTEntryStorage* table; // Points to tableMem
 
     U64 usedSize = 0;        // Number of used entries. Smaller than tableSize when TB used
     int usedSizeTopBits = 0; // < 256, (usedSizeTopBits << usedSizeShift) <= usedSize
@@ -221,10 +296,10 @@ private:
 
     U8 generation = 0;
     U64 contemptHash = 0;
-    U64 tableSize = 0;     // Number of entries
+    U64 tableSize = 0;     // Number of TTEntryStorage slots
+    bool compact = false;  // True if the compact layout is used
 
-    vector_aligned<TTEntryStorage> tableV;
-    std::shared_ptr<TTEntryStorage> tableLP; // Large page allocation if used
+    std::shared_ptr<TTEntryStorage> tableMem; // Large page or 64-byte aligned allocation
 
     // On-demand TB generation
     TTStorage ttStorage;
@@ -242,6 +317,7 @@ inline void
 TTStorage::resize(U32 size) {
     assert(table.byteSize() > size);
     idx0 = table.byteSize() - size;
+    assert(idx0 % 16 == 0); // store() for 64-aligned index ranges must not share words
 }
 
 inline const PositionValue
@@ -254,6 +330,14 @@ TTStorage::store(U32 idx, PositionValue pv) {
     table.putByte(idx0 + idx, (U8)pv.getState());
 }
 
+inline bool
+TTStorage::compareExchange(U32 idx, PositionValue& expected, PositionValue desired) {
+    U8 e = (U8)expected.getState();
+    bool ret = table.compareExchangeByte(idx0 + idx, e, (U8)desired.getState());
+    expected = PositionValue(e);
+    return ret;
+}
+
 
 inline
 TranspositionTable::TTEntryStorage::TTEntryStorage() {
@@ -441,9 +525,75 @@ TranspositionTable::getIndex(U64 key) const {
     return (size_t)r;
 }
 
+inline TranspositionTable::CompactBucket&
+TranspositionTable::getBucket(U64 key) const {
+    size_t idx0 = getIndex(key) & ~(size_t)3;
+    return *reinterpret_cast<CompactBucket*>(&table[idx0]);
+}
+
+inline U16
+TranspositionTable::keyFragment(U64 key) {
+    U16 frag = (U16)(key >> compactFragShift); // Bits not used by getIndex()
+    if (frag <= compactLocked)
+        frag += 2;
+    return frag;
+}
+
+inline U64
+TranspositionTable::matchFragments(const CompactBucket& b, U16 frag) {
+#ifdef __SSE2__
+    // Aligned 16-byte loads read each 16-bit element atomically on x86
+    __m128i frags = _mm_load_si128(reinterpret_cast<const __m128i*>(&b.frag[0]));
+    __m128i eq = _mm_cmpeq_epi16(frags, _mm_set1_epi16((short)frag));
+    std::atomic_signal_fence(std::memory_order_acquire);
+    return _mm_movemask_epi8(eq) & 0x555;
+#else
+    U64 mask = 0;
+    for (int i = 0; i < compactEntries; i++)
+        if (b.frag[i].load(std::memory_order_acquire) == frag)
+            mask |= 1ULL << (2 * i);
+    return mask;
+#endif
+}
+
+inline void
+TranspositionTable::storeCompact(CompactBucket& b, int i, U16 oldFrag, U16 frag, U64 data) {
+    if (!b.frag[i].compare_exchange_strong(oldFrag, compactLocked, std::memory_order_relaxed))
+        return;
+    std::atomic_thread_fence(std::memory_order_release);
+    b.data[i].store(data, std::memory_order_relaxed);
+    b.frag[i].store(frag, std::memory_order_release);
+}
+
+inline void
+TranspositionTable::probeCompact(U64 key, TTEntry& result) {
+    CompactBucket& b = getBucket(key);
+    const U16 frag = keyFragment(key);
+    U64 mask = matchFragments(b, frag);
+    while (mask) {
+        int i = BitBoard::extractSquare(mask) / 2;
+        U64 data = b.data[i].load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (b.frag[i].load(std::memory_order_relaxed) != frag)
+            continue;
+        TTEntry ent(key, data);
+        if (ent.getGeneration() != generation) {
+            ent.setGeneration(generation);
+            storeCompact(b, i, frag, frag, ent.getData());
+        }
+        result = ent;
+        return;
+    }
+    result.setType(TType::T_EMPTY);
+}
+
 inline void
 TranspositionTable::probe(U64 key, TTEntry& result) {
     key ^= contemptHash;
+    if (compact) {
+        probeCompact(key, result);
+        return;
+    }
     size_t idx0 = getIndex(key);
     TTEntry ent;
     for (int i = 0; i < 4; i++) {
@@ -506,6 +656,30 @@ TranspositionTable::putByte(U64 idx, U8 value) {
     }
 }
 
+inline bool
+TranspositionTable::compareExchangeByte(U64 idx, U8& expected, U8 desired) {
+    U64 ent = idx / 16;
+    int offs = idx & 0xf;
+    std::atomic<U64>& word = (offs < 8) ? table[ent].key : table[ent].data;
+    offs &= 0x07;
+    U64 data = word.load(std::memory_order_relaxed);
+    while (true) {
+        U8 old = (data >> (offs * 8)) & 0xff;
+        if (old != expected) {
+            expected = old;
+            return false;
+        }
+        U64 newData = (data & ~(0xffULL << (offs * 8))) | (((U64)desired) << (offs * 8));
+        if (word.compare_exchange_weak(data, newData, std::memory_order_relaxed))
+            return true;
+    }
+}
+
+inline U64
+TranspositionTable::numEntries() const {
+    return compact ? tableSize / 4 * compactEntries : tableSize;
+}
+
 inline U64
 TranspositionTable::byteSize() const {
     return tableSize * sizeof(TTEntryStorage);
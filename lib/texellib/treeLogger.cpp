@@ -31,6 +31,7 @@
 
 #include <iostream>
 #include <iomanip>
+#include <limits>
 #include <cassert>
 
 void
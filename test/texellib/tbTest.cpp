@@ -455,6 +455,156 @@ TBTest::rtbTest() {
     ASSERT_EQUAL(15, dtz);
 }
 
+/** Compare Syzygy::probe_wdl_batch() with individual Syzygy::probe_wdl() calls. */
+void
+TBTest::rtbBatchTest() {
+    Syzygy::BlockCache cache;
+    for (int p2 : { Piece::BKNIGHT, Piece::BPAWN }) {
+        for (int wtm = 0; wtm < 2; wtm++) {
+            std::vector<Position> positions;
+            for (int sq1 = 0; sq1 < 64; sq1++) {
+                for (int sq2 = 0; sq2 < 64; sq2++) {
+                    if (p2 == Piece::BPAWN && (Square::getY(sq2) == 0 || Square::getY(sq2) == 7))
+                        continue;
+                    Position pos = TextIO::readFEN("k7/8/8/8/8/8/8/7K w - - 0 1");
+                    if (sq1 == sq2 || pos.getPiece(sq1) != Piece::EMPTY ||
+                        pos.getPiece(sq2) != Piece::EMPTY)
+                        continue;
+                    pos.setPiece(sq1, Piece::WROOK);
+                    pos.setPiece(sq2, p2);
+                    pos.setWhiteMove(wtm);
+                    if (MoveGen::canTakeKing(pos))
+                        continue;
+                    positions.push_back(pos);
+                }
+            }
+            positions.push_back(TextIO::readFEN("8/8/8/8/3Pp3/8/8/K1k1R3 b - d3 0 1"));
+
+            const int n = positions.size();
+            std::vector<int> wdl(n), success(n);
+            Syzygy::probe_wdl_batch(positions.data(), n, wdl.data(), success.data(), cache);
+            for (int i = 0; i < n; i++) {
+                int success1;
+                int wdl1 = Syzygy::probe_wdl(positions[i], &success1);
+                ASSERT_EQUAL(success1, success[i]);
+                ASSERT_EQUAL(wdl1, wdl[i]);
+            }
+            ASSERT(cache.nDecoded < cache.nProbes);
+        }
+    }
+
+    // KPvKP for every 9th white king square, including en passant positions
+    // and positions where captures must be resolved by probe_ab().
+    for (int wk = 0; wk < 64; wk += 9) {
+        std::vector<Position> positions;
+        for (int bk = 0; bk < 64; bk++) {
+            for (int wp = 8; wp < 56; wp++) {
+                for (int bp = 8; bp < 56; bp++) {
+                    if (bk == wk || wp == wk || wp == bk || bp == wk || bp == bk || bp == wp)
+                        continue;
+                    for (int wtm = 0; wtm < 2; wtm++) {
+                        Position pos;
+                        pos.setPiece(wk, Piece::WKING);
+                        pos.setPiece(bk, Piece::BKING);
+                        pos.setPiece(wp, Piece::WPAWN);
+                        pos.setPiece(bp, Piece::BPAWN);
+                        pos.setWhiteMove(wtm);
+                        if (wtm && Square::getY(wp) == 4 && Square::getY(bp) == 4 &&
+                            std::abs(Square::getX(wp) - Square::getX(bp)) == 1 &&
+                            pos.getPiece(bp + 8) == Piece::EMPTY &&
+                            pos.getPiece(bp + 16) == Piece::EMPTY)
+                            pos.setEpSquare(bp + 8);
+                        if (!wtm && Square::getY(wp) == 3 && Square::getY(bp) == 3 &&
+                            std::abs(Square::getX(wp) - Square::getX(bp)) == 1 &&
+                            pos.getPiece(wp - 8) == Piece::EMPTY &&
+                            pos.getPiece(wp - 16) == Piece::EMPTY)
+                            pos.setEpSquare(wp - 8);
+                        if (MoveGen::canTakeKing(pos))
+                            continue;
+                        positions.push_back(pos);
+                    }
+                }
+            }
+        }
+
+        const int n = positions.size();
+        std::vector<int> wdl(n), success(n);
+        Syzygy::probe_wdl_batch(positions.data(), n, wdl.data(), success.data(), cache);
+        for (int i = 0; i < n; i++) {
+            int success1;
+            int wdl1 = Syzygy::probe_wdl(positions[i], &success1);
+            ASSERT(success1 != 0);
+            ASSERT_EQUAL(success1, success[i]);
+            ASSERT_EQUAL(wdl1, wdl[i]);
+        }
+    }
+}
+
+/** Check that WDL/DTZ probes give the same result with and without the block cache. */
+void
+TBTest::rtbBlockCacheTest() {
+    std::vector<Position> positions;
+    for (int sq1 = 0; sq1 < 64; sq1++) {
+        for (int sq2 = 8; sq2 < 56; sq2++) {
+            Position pos = TextIO::readFEN("k7/8/8/8/8/8/8/7K w - - 0 1");
+            if (sq1 == sq2 || pos.getPiece(sq1) != Piece::EMPTY ||
+                pos.getPiece(sq2) != Piece::EMPTY)
+                continue;
+            pos.setPiece(sq1, Piece::WROOK);
+            pos.setPiece(sq2, Piece::BPAWN);
+            if (MoveGen::canTakeKing(pos))
+                continue;
+            positions.push_back(pos);
+        }
+    }
+
+    const int n = positions.size();
+    std::vector<int> wdl(n), dtz(n), wdlSuccess(n), dtzSuccess(n);
+    TBProbe::setRtbBlockCache(0);
+    for (int i = 0; i < n; i++) {
+        wdl[i] = Syzygy::probe_wdl(positions[i], &wdlSuccess[i]);
+        ASSERT(wdlSuccess[i] != 0);
+        dtz[i] = Syzygy::probe_dtz(positions[i], &dtzSuccess[i]);
+        ASSERT(dtzSuccess[i] != 0);
+    }
+
+    uint64_t nProbes0, nHits0;
+    Syzygy::get_block_cache_stats(nProbes0, nHits0);
+    for (int cacheSize : { 0, 1, 4 }) {
+        TBProbe::setRtbBlockCache(cacheSize);
+        uint64_t passProbes[2], passHits[2];
+        for (int pass = 0; pass < 2; pass++) {
+            for (int i = 0; i < n; i++) {
+                int success1;
+                ASSERT_EQUAL(wdl[i], Syzygy::probe_wdl(positions[i], &success1));
+                ASSERT_EQUAL(wdlSuccess[i], success1);
+                ASSERT_EQUAL(dtz[i], Syzygy::probe_dtz(positions[i], &success1));
+                ASSERT_EQUAL(dtzSuccess[i], success1);
+            }
+            uint64_t nProbes, nHits;
+            Syzygy::get_block_cache_stats(nProbes, nHits);
+            passProbes[pass] = nProbes - nProbes0;
+            passHits[pass] = nHits - nHits0;
+            nProbes0 = nProbes;
+            nHits0 = nHits;
+        }
+        if (cacheSize == 0) {
+            ASSERT_EQUAL(0, passProbes[0]);
+            ASSERT_EQUAL(0, passHits[0]);
+        } else {
+            ASSERT(passProbes[0] > 0);
+            ASSERT_EQUAL(passProbes[0], passProbes[1]);
+            ASSERT(passHits[0] > 0);
+            ASSERT(passHits[0] <= passProbes[0]);
+            // The second pass starts with a warm cache, and LRU hits can not
+            // decrease when cache entries are added.
+            ASSERT(passHits[1] >= passHits[0]);
+            ASSERT(passHits[1] <= passProbes[1]);
+        }
+    }
+    TBProbe::setRtbBlockCache(0);
+}
+
 /** Test TBProbe::tbProbe() function. */
 void
 TBTest::tbTest() {
@@ -661,6 +811,8 @@ TBTest::getSuite() const {
     s.push_back(CUTE(dtmTest));
     s.push_back(CUTE(kpkTest));
     s.push_back(CUTE(rtbTest));
+    s.push_back(CUTE(rtbBatchTest));
+    s.push_back(CUTE(rtbBlockCacheTest));
     s.push_back(CUTE(tbTest));
     s.push_back(CUTE(testMissingTables));
     s.push_back(CUTE(testMaxSubMate));
@@ -50,6 +50,8 @@ private:
     static void dtmTest();
     static void kpkTest();
     static void rtbTest();
+    static void rtbBatchTest();
+    static void rtbBlockCacheTest();
     static void tbTest();
     static void testMissingTables();
     static void testMaxSubMate();
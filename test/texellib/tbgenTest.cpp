@@ -302,6 +302,24 @@ TBGenTest::testGenerate() {
     }
 }
 
+void
+TBGenTest::testGenerateThreads() {
+    for (const PieceCount& pc : { pieceCount(0,1,0,0, 0,0,0,0),
+                                  pieceCount(1,0,0,0, 0,1,0,0) }) {
+        RelaxedShared<S64> maxTimeMillis(-1);
+        VectorStorage vs1;
+        TBGenerator<VectorStorage> tbGen1(vs1, pc);
+        ASSERT(tbGen1.generate(maxTimeMillis, false, 1));
+        VectorStorage vsN;
+        TBGenerator<VectorStorage> tbGenN(vsN, pc);
+        ASSERT(tbGenN.generate(maxTimeMillis, false, 4));
+
+        TBPosition tbPos(pc);
+        for (U32 idx = 0; idx < tbPos.nPositions(); idx++)
+            ASSERT_EQUAL((int)vs1[idx].getState(), (int)vsN[idx].getState());
+    }
+}
+
 cute::suite
 TBGenTest::getSuite() const {
     cute::suite s;
@@ -310,5 +328,6 @@ TBGenTest::getSuite() const {
     s.push_back(CUTE(testTBPosition));
     s.push_back(CUTE(testMoveGen));
     s.push_back(CUTE(testGenerate));
+    s.push_back(CUTE(testGenerateThreads));
     return s;
 }
@@ -44,6 +44,7 @@ private:
     static void testMoveGen();
     static void testGenerate();
     static void testGenerateInternal(const PieceCount& pc);
+    static void testGenerateThreads();
 };
 
 #endif /* TBGENTEST_HPP_ */
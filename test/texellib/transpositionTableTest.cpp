@@ -28,6 +28,7 @@
 #include "position.hpp"
 #include "textio.hpp"
 #include "searchTest.hpp"
+#include "numa.hpp"
 #include <iostream>
 
 #include "cute.h"
@@ -126,8 +127,7 @@ testTTEntry() {
 }
 
 static void
-testInsert() {
-    TranspositionTable tt(64*1024);
+insertAndProbe(TranspositionTable& tt) {
     Position pos = TextIO::readFEN(TextIO::startPosFEN);
     std::string moves[] = {
         "e4", "e5", "Nf3", "Nc6", "Bb5", "a6", "Ba4", "b5", "Bb3", "Nf6", "O-O", "Be7", "Re1"
@@ -169,6 +169,44 @@ testInsert() {
     }
 }
 
+static void
+testInsert() {
+    TranspositionTable tt(64*1024);
+    insertAndProbe(tt);
+}
+
+static void
+testInsertCompact() {
+    TranspositionTable tt(64*1024);
+    tt.reSize(64*1024, true);
+    ASSERT(tt.isCompact());
+    ASSERT_EQUAL(96*1024, tt.numEntries());
+    insertAndProbe(tt);
+
+    // A compact bucket holds 6 entries with the same index bits
+    tt.reSize(4, true);
+    ASSERT_EQUAL(6, tt.numEntries());
+    Position pos = TextIO::readFEN(TextIO::startPosFEN);
+    Move m = TextIO::stringToMove(pos, "e4");
+    for (int i = 0; i < 6; i++) {
+        m.setScore(i);
+        tt.insert((U64)(i + 1) << 40, m, TType::T_EXACT, 0, 10, 0);
+    }
+    for (int i = 0; i < 6; i++) {
+        TTEntry ent;
+        tt.probe((U64)(i + 1) << 40, ent);
+        ASSERT_EQUAL(TType::T_EXACT, ent.getType());
+        ASSERT_EQUAL(i, ent.getScore(0));
+    }
+
+    tt.clear();
+    for (int i = 0; i < 6; i++) {
+        TTEntry ent;
+        tt.probe((U64)(i + 1) << 40, ent);
+        ASSERT_EQUAL(TType::T_EMPTY, ent.getType());
+    }
+}
+
 /**
  * Test special depth logic for mate scores.
  */
@@ -312,12 +350,26 @@ testHashFuncBackComp() {
     ASSERT_EQUAL(0x9CCCE083C803D732ULL, hash2);
 }
 
+/** Check that memory blocks that are not page aligned can be interleaved over
+ *  NUMA nodes. Only exercises mbind() when built with NUMA support and
+ *  running on a machine with more than one node. */
+static void
+testNumaInterleave() {
+    const size_t size = 4 * 1024 * 1024;
+    std::vector<char> mem(size + 64);
+    for (size_t offs : { 0, 8, 64 })
+        ASSERT(Numa::instance().interleaveMemory(&mem[offs], size));
+    ASSERT(Numa::instance().interleaveMemory(&mem[8], 16));
+}
+
 cute::suite
 TranspositionTableTest::getSuite() const {
     cute::suite s;
     s.push_back(CUTE(testTTEntry));
     s.push_back(CUTE(testInsert));
+    s.push_back(CUTE(testInsertCompact));
     s.push_back(CUTE(testMateDepth));
     s.push_back(CUTE(testHashFuncBackComp));
+    s.push_back(CUTE(testNumaInterleave));
     return s;
 }